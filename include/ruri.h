@@ -53,6 +53,15 @@
 #include <linux/securebits.h>
 #include <linux/version.h>
 #include <linux/loop.h>
+#include <linux/mempolicy.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#ifndef SECCOMP_FILTER_FLAG_SPEC_ALLOW
+#define SECCOMP_FILTER_FLAG_SPEC_ALLOW (1UL << 2)
+#endif
+#ifndef SECCOMP_USER_NOTIF_FLAG_CONTINUE
+#define SECCOMP_USER_NOTIF_FLAG_CONTINUE (1UL << 0)
+#endif
 #include <sys/mount.h>
 #include <linux/fs.h>
 #include <sys/ioctl.h>
@@ -60,6 +69,11 @@
 #include <sys/sendfile.h>
 #include <sys/prctl.h>
 #include <sys/socket.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include <sys/types.h>
@@ -67,6 +81,8 @@
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <sys/mman.h>
+#include <sys/sysinfo.h>
+#include <sys/resource.h>
 #include <time.h>
 #include <signal.h>
 #include <unistd.h>
@@ -86,6 +102,26 @@
 #else
 typedef int cap_value_t;
 #endif
+// For old libc without pidfd syscall numbers.
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_getfd
+#define SYS_pidfd_getfd 438
+#endif
+// For ioprio_set(2), glibc has no wrapper of it.
+#ifndef IOPRIO_WHO_PROCESS
+#define IOPRIO_WHO_PROCESS 1
+#endif
+#ifndef IOPRIO_CLASS_BE
+#define IOPRIO_CLASS_BE 2
+#endif
+#ifndef IOPRIO_CLASS_SHIFT
+#define IOPRIO_CLASS_SHIFT 13
+#endif
 // Fix definition of HOST_NAME_MAX
 #ifndef HOST_NAME_MAX
 #define HOST_NAME_MAX 64
@@ -123,6 +159,17 @@ typedef int cap_value_t;
 #define RURI_MAX_MOUNTPOINTS (512 * 2)
 #define RURI_MAX_CHAR_DEVS (128 * 3)
 #define RURI_MAX_SECCOMP_DENIED_SYSCALL (2048)
+#define RURI_MAX_IO_DEVS (64)
+#define RURI_MAX_HUGETLB_SIZES (8)
+#define RURI_MAX_RLIMITS (16)
+// Cache of compiled seccomp filters, on the host.
+#ifndef RURI_SECCOMP_CACHE_DIR
+#if defined(__ANDROID__)
+#define RURI_SECCOMP_CACHE_DIR "/data/local/tmp/ruri/seccomp"
+#else
+#define RURI_SECCOMP_CACHE_DIR "/var/cache/ruri/seccomp"
+#endif
+#endif
 // For configure.ac
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -172,10 +219,36 @@ struct RURI_CONTAINER {
 	bool ro_root;
 	// Cpuset.
 	char *_Nullable cpuset;
-	// Memory.
+	// Memory (memory.max).
 	char *_Nullable memory;
-	// Cpulimit.
+	// memory.high, memory.low, memory.min, memory.swap.max and memory.zswap.max.
+	char *_Nullable memory_high;
+	char *_Nullable memory_low;
+	char *_Nullable memory_min;
+	char *_Nullable memory_swap_max;
+	char *_Nullable memory_zswap_max;
+	// Cpulimit, can be more than 100 for multiple cores.
 	int cpupercent;
+	// cpu.max, like `350000 100000` or `max 100000`, overrides cpupercent.
+	char *_Nullable cpu_max;
+	// cpu.max.burst in microseconds.
+	int cpu_burst;
+	// cpu.weight (1-10000) or cpu.weight.nice (-20-19).
+	int cpu_weight;
+	int cpu_weight_nice;
+	// cpu.idle, 0 or 1, RURI_INIT_VALUE if not set.
+	int cpu_idle;
+	// I/O limits, in the format of io.max, io.weight and io.latency,
+	// like `8:0 rbps=1048576 wiops=120`, `default 100` and `8:0 target=10000`.
+	char *_Nonnull io_max[RURI_MAX_IO_DEVS + 1];
+	char *_Nonnull io_weight[RURI_MAX_IO_DEVS + 1];
+	char *_Nonnull io_latency[RURI_MAX_IO_DEVS + 1];
+	// Max number of processes (pids.max).
+	int pids_max;
+	// Hugepage limits (hugetlb.<size>.max), like `2MB=1G`.
+	char *_Nonnull hugetlb_max[RURI_MAX_HUGETLB_SIZES + 1];
+	// Mountpoint of hugetlbfs, /dev/hugepages by default if hugetlb_max is set.
+	char *_Nullable hugetlbfs;
 	// A number based on the time when creating container.
 	int container_id;
 	// Do not create runtime directory.
@@ -203,8 +276,36 @@ struct RURI_CONTAINER {
 	time_t timens_monotonic_offset;
 	// Denied syscalls.
 	char *_Nonnull seccomp_denied_syscall[RURI_MAX_SECCOMP_DENIED_SYSCALL];
+	// Allowlist seccomp profile, replaces the built-in profile.
+	char *_Nullable seccomp_profile;
+	// Do not force speculative store bypass mitigation for seccomp.
+	bool seccomp_spec_allow;
+	// Record syscalls of container to this profile, only from command line.
+	char *_Nullable seccomp_learn;
 	// OOM score.
 	int oom_score_adj;
+	// Scheduling policy, other/batch/idle/fifo/rr.
+	char *_Nullable sched_policy;
+	// Priority for fifo and rr, also used as RLIMIT_RTPRIO.
+	int sched_priority;
+	int sched_nice;
+	// Utilization clamp, 0-1024.
+	int uclamp_min;
+	int uclamp_max;
+	// CPU affinity, works without cpuset cgroup.
+	char *_Nullable cpu_affinity;
+	// Use a new core scheduling cookie.
+	bool sched_core;
+	// Timer slack in nanoseconds.
+	int timer_slack;
+	// Disable transparent hugepages.
+	bool thp_disable;
+	// NUMA memory policy, like `interleave:0-1`.
+	char *_Nullable mempolicy;
+	// Enable KSM for all anonymous memory.
+	bool ksm;
+	// Resource limits, like `NOFILE=65536:65536`.
+	char *_Nonnull rlimits[RURI_MAX_RLIMITS + 1];
 	// Masked path.
 	char *_Nonnull masked_path[RURI_MAX_MOUNTPOINTS + 2];
 	bool enable_tty_signals;
@@ -227,6 +328,167 @@ struct RURI_ID_MAP {
 	gid_t gid_lower;
 	gid_t gid_count;
 };
+// For ruri_read_proc_stat().
+struct RURI_PROC_STAT {
+	pid_t pid;
+	char comm[64];
+	char state;
+	pid_t ppid;
+	// In clock ticks.
+	unsigned long long utime;
+	unsigned long long stime;
+	long num_threads;
+	unsigned long long starttime;
+	// In pages.
+	long rss;
+};
+// For ruri_container_top().
+struct RURI_TOP_SAMPLE {
+	struct RURI_PROC_STAT stat;
+	// From /proc/<pid>/statm.
+	long rss_pages;
+	// From /proc/<pid>/io.
+	unsigned long long read_bytes;
+	unsigned long long write_bytes;
+};
+// For ruri_proc_tracker_new().
+struct RURI_PROC_TRACKER {
+	// NETLINK_CONNECTOR socket.
+	int sock;
+	// Sorted pids in container.
+	pid_t *_Nonnull pids;
+	size_t count;
+	size_t size;
+};
+// For ruri_stop_container().
+struct RURI_STOP_PROC {
+	pid_t pid;
+	// -1 if pidfd_open(2) is not supported.
+	int pidfd;
+	char comm[64];
+	// Time used to exit, -1 if still running.
+	long exit_ms;
+	// Killed by SIGKILL or cgroup.kill.
+	bool killed;
+};
+// For ruri_container_stats().
+// cpu some/full, memory some/full, io some/full.
+#define RURI_PSI_COUNT 6
+struct RURI_CGROUP_STATS {
+	// Memory in bytes.
+	bool has_memory;
+	unsigned long long memory_current;
+	// 0 if memory.peak is not supported.
+	unsigned long long memory_peak;
+	unsigned long long memory_anon;
+	unsigned long long memory_file;
+	unsigned long long pgfault;
+	unsigned long long pgmajfault;
+	// CPU time in microseconds.
+	bool has_cpu;
+	unsigned long long cpu_usage;
+	unsigned long long cpu_user;
+	unsigned long long cpu_system;
+	unsigned long long nr_throttled;
+	unsigned long long throttled_usec;
+	// I/O of all devices.
+	bool has_io;
+	unsigned long long read_bytes;
+	unsigned long long write_bytes;
+	unsigned long long read_ios;
+	unsigned long long write_ios;
+	// pids.max is ULLONG_MAX if not limited.
+	bool has_pids;
+	unsigned long long pids_current;
+	unsigned long long pids_max;
+	// Pressure stall information, cgroup v2 only.
+	bool has_psi;
+	double psi_avg10[RURI_PSI_COUNT];
+	unsigned long long psi_total[RURI_PSI_COUNT];
+	// KSM of processes in container, from /proc/<pid>/ksm_stat.
+	bool has_ksm;
+	unsigned long long ksm_merging_pages;
+	unsigned long long ksm_rmap_items;
+	// ksm_process_profit can be negative.
+	long long ksm_profit;
+};
+// Cgroup directories of container to read the stats, -1 if not available.
+struct RURI_STATS_CGROUP {
+	int v2_fd;
+	int memory_fd;
+	int cpu_fd;
+	int cpuacct_fd;
+	int io_fd;
+	int pids_fd;
+};
+// For ruri_container_monitor().
+#define RURI_MAX_PSI_TRIGGERS 8
+struct RURI_MONITOR {
+	// PSI triggers like `memory:some:150000:1000000`, NULL terminated.
+	char *psi[RURI_MAX_PSI_TRIGGERS + 1];
+	// Interval to check cpu.stat and if the cgroup is still there.
+	int interval_ms;
+	bool json;
+	// Append events to log_file instead of stdout.
+	char *log_file;
+	// Run `/bin/sh -c hook` for every event.
+	char *hook;
+};
+// A file watched by ruri_container_monitor().
+#define RURI_MONITOR_MAX_KEYS 8
+struct RURI_MONITOR_WATCH {
+	// RURI_WATCH_*.
+	int type;
+	// The fd to poll.
+	int fd;
+	// The control file opened by fd.
+	char file[32];
+	// Trigger written to pressure file, like `some 150000 1000000`.
+	char trigger[64];
+	// Last values of the counters in file.
+	unsigned long long counts[RURI_MONITOR_MAX_KEYS];
+};
+#define RURI_WATCH_PSI 1
+#define RURI_WATCH_EVENTS 2
+#define RURI_WATCH_OOM_CONTROL 3
+// For ruri_cgroup_open().
+#define RURI_CGROUP_MAX_V1 8
+struct RURI_CGROUP {
+	// Where we mounted the cgroup filesystems.
+	char mountpoint[64];
+	bool mounted;
+	// Cgroup v2 directory of container, -1 if not available.
+	int v2_fd;
+	// cgroup.controllers of the parent cgroup in cgroup v2.
+	char controllers[256];
+	// Controllers in cgroup v1 and their directories of container.
+	const char *_Nonnull v1_controller[RURI_CGROUP_MAX_V1];
+	int v1_fd[RURI_CGROUP_MAX_V1];
+	int v1_count;
+	bool no_warnings;
+};
+// A record in /proc/<pid>/mountinfo.
+struct RURI_MOUNTINFO_ENTRY {
+	int mount_id;
+	int parent_id;
+	dev_t dev;
+	char *_Nonnull root;
+	char *_Nonnull mount_point;
+	char *_Nonnull options;
+	char *_Nonnull fs_type;
+	char *_Nonnull source;
+	char *_Nonnull super_options;
+};
+// For ruri_read_mountinfo().
+struct RURI_MOUNTINFO {
+	// Records in mount order.
+	struct RURI_MOUNTINFO_ENTRY *_Nonnull entries;
+	size_t count;
+	// Index of entries sorted by mount_point.
+	size_t *_Nonnull sorted;
+	// All strings in entries point to buf.
+	char *_Nonnull buf;
+};
 // Warnings.
 #define ruri_warning(format, ...)                                                                \
 	{                                                                                        \
@@ -254,7 +516,10 @@ struct RURI_ID_MAP {
 #endif
 // Shared functions.
 void ruri_register_signal(void);
+void ruri_prepare_seccomp(const struct RURI_CONTAINER *_Nonnull container);
 void ruri_setup_seccomp(const struct RURI_CONTAINER *_Nonnull container);
+void ruri_prepare_seccomp_learn(const struct RURI_CONTAINER *_Nonnull container);
+void ruri_setup_seccomp_learn(const struct RURI_CONTAINER *_Nonnull container);
 void ruri_show_version_info(void);
 void ruri_show_version_code(void);
 void ruri_show_helps(void);
@@ -271,11 +536,55 @@ char *ruri_container_info_to_k2v(const struct RURI_CONTAINER *_Nonnull container
 void ruri_run_chroot_container(struct RURI_CONTAINER *_Nonnull container);
 int ruri_trymount(const char *_Nonnull source, const char *_Nonnull target, unsigned int mountflags);
 void ruri_umount_container(const char *_Nonnull container_dir);
+int ruri_umount_containers(char *const *_Nonnull container_dirs, int count);
+int ruri_umount_all_containers(void);
 void ruri_read_config(struct RURI_CONTAINER *_Nonnull container, const char *_Nonnull path);
 void ruri_set_limit(const struct RURI_CONTAINER *_Nonnull container);
+struct RURI_CGROUP *ruri_cgroup_open(const struct RURI_CONTAINER *_Nonnull container);
+int ruri_cgroup_fd(const struct RURI_CGROUP *_Nonnull cgroup, const char *_Nullable controller);
+void ruri_cgroup_apply(const struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container);
+void ruri_cgroup_join(const struct RURI_CGROUP *_Nonnull cgroup, pid_t pid);
+void ruri_cgroup_close(struct RURI_CGROUP *_Nullable cgroup);
+void ruri_update_limit(const struct RURI_CONTAINER *_Nonnull container);
+char *ruri_parse_cpu_max(const char *_Nonnull cpu_max);
+bool ruri_parse_memory_size(const char *_Nonnull size, unsigned long long *_Nonnull bytes);
+char *ruri_parse_io_limit(const char *_Nonnull limit, bool weight);
+char *ruri_parse_hugetlb_limit(const char *_Nonnull limit);
+int ruri_open_cgroup(const struct RURI_CONTAINER *_Nonnull container, const struct RURI_MOUNTINFO *_Nonnull info, const char *_Nullable controller);
+pid_t *ruri_read_cgroup_procs(int cgroup_fd, size_t *_Nonnull count);
+bool ruri_read_cgroup_value(int cgroup_fd, const char *_Nonnull file, const char *_Nullable key, unsigned long long *_Nonnull value);
+bool ruri_parse_cpu_list(const char *_Nonnull list, cpu_set_t *_Nonnull set);
+void ruri_format_cpu_list(const cpu_set_t *_Nonnull set, char *_Nonnull buf, size_t size);
+char *ruri_auto_cpuset(int count, const cpu_set_t *_Nonnull used);
+char *ruri_cpuset_mems(const char *_Nonnull cpus);
+bool ruri_parse_mempolicy(const char *_Nonnull policy, int *_Nonnull mode, cpu_set_t *_Nonnull nodes);
+void ruri_check_isolated_cpus(const char *_Nonnull cpus);
+bool ruri_kill_cgroup(const struct RURI_CONTAINER *_Nonnull container, const struct RURI_MOUNTINFO *_Nonnull info);
 struct RURI_ID_MAP ruri_get_idmap(uid_t uid, gid_t gid);
 void ruri_container_ps(char *_Nonnull container_dir);
 void ruri_kill_container(const char *_Nonnull container_dir);
+void ruri_kill_containers(const char *const *_Nonnull container_dirs, int count);
+bool ruri_read_proc_stat(pid_t pid, struct RURI_PROC_STAT *_Nonnull st);
+pid_t *ruri_get_container_pids(const char *_Nonnull container_dir, const struct RURI_CONTAINER *_Nonnull container, size_t *_Nonnull count);
+void ruri_container_top(const char *_Nonnull container_dir, int interval_ms, int iterations, bool json);
+struct RURI_PROC_TRACKER *ruri_proc_tracker_new(void);
+void ruri_proc_tracker_free(struct RURI_PROC_TRACKER *_Nullable tracker);
+void ruri_proc_tracker_add(struct RURI_PROC_TRACKER *_Nonnull tracker, pid_t pid);
+bool ruri_proc_tracker_has(const struct RURI_PROC_TRACKER *_Nonnull tracker, pid_t pid);
+int ruri_proc_tracker_poll(struct RURI_PROC_TRACKER *_Nonnull tracker, int timeout_ms);
+void ruri_stop_container(const char *_Nonnull container_dir, int timeout_s);
+void ruri_container_stats(const char *_Nonnull container_dir, int interval_ms, int iterations, bool json, const char *_Nullable prometheus_file);
+void ruri_show_exit_summary(const struct RURI_CONTAINER *_Nonnull container, int status, const struct rusage *_Nonnull usage);
+void ruri_open_stats_cgroup(const struct RURI_CONTAINER *_Nonnull container, struct RURI_STATS_CGROUP *_Nonnull cgroup);
+void ruri_close_stats_cgroup(struct RURI_STATS_CGROUP *_Nonnull cgroup);
+void ruri_container_monitor(const char *_Nonnull container_dir, const struct RURI_MONITOR *_Nonnull monitor);
+void ruri_update_container(const char *_Nonnull container_dir, struct RURI_CONTAINER *_Nonnull limits);
+int ruri_parse_sched_policy(const char *_Nonnull name);
+void ruri_parse_sched_setting(const char *_Nonnull str, struct RURI_CONTAINER *_Nonnull container);
+void ruri_set_sched(const struct RURI_CONTAINER *_Nonnull container);
+char *ruri_parse_rlimit(const char *_Nonnull limit);
+bool ruri_add_rlimit(char *_Nonnull list[], const char *_Nonnull limit);
+void ruri_set_rlimits(const struct RURI_CONTAINER *_Nonnull container);
 bool ruri_user_exist(const char *_Nonnull username);
 uid_t ruri_get_user_uid(const char *_Nonnull username);
 gid_t ruri_get_user_gid(const char *_Nonnull username);
@@ -290,6 +599,10 @@ extern int RURI_PWD_ERRNO;
 int ruri_cap_from_name(const char *str, cap_value_t *cap);
 #endif
 void ruri_clear_env(char *const *_Nonnull argv);
+struct RURI_MOUNTINFO *ruri_read_mountinfo(pid_t pid);
+void ruri_free_mountinfo(struct RURI_MOUNTINFO *_Nullable info);
+struct RURI_MOUNTINFO_ENTRY *ruri_mountinfo_find_fstype(const struct RURI_MOUNTINFO *_Nonnull info, const char *_Nonnull fs_type);
+struct RURI_MOUNTINFO_ENTRY **ruri_mountinfo_under(const struct RURI_MOUNTINFO *_Nonnull info, const char *_Nonnull dir, size_t *_Nonnull count);
 //   ██╗ ██╗  ███████╗   ████╗   ███████╗
 //  ████████╗ ██╔════╝ ██╔═══██╗ ██╔════╝
 //  ╚██╔═██╔╝ █████╗   ██║   ██║ █████╗
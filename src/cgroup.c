@@ -33,503 +33,1026 @@
  * ${container_id} is set by the time creating the container,
  * And it will be unified by .rurienv file.
  *
+ * All limits are set in one cgroup session:
+ * ruri_cgroup_open() mounts (or reuses) the cgroup filesystems once,
+ * reads cgroup.controllers once and enables only the controllers we need,
+ * ruri_cgroup_apply() writes all control files by the cgroup directory fd,
+ * and ruri_cgroup_join() writes cgroup.procs once for each hierarchy.
+ *
  * TODO:
  * Add more cgroups support.
  */
-static void mount_cgroup_v1_memory(void)
-{
-	/*
-	 * Mount Cgroup v1 memory controller.
-	 * Nothing to return because if this function run failed,
-	 * that means cgroup is fully not supported on the device.
-	 */
-	mkdir("/sys/fs/cgroup", S_IRUSR | S_IWUSR);
-	// Maybe needless.
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-	// Mount /sys/fs/cgroup as tmpfs.
-	mount("tmpfs", "/sys/fs/cgroup", "tmpfs", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, NULL);
-	// Mount memory controller.
-	mkdir("/sys/fs/cgroup/memory", S_IRUSR | S_IWUSR);
-	usleep(2000);
-	mount("none", "/sys/fs/cgroup/memory", "cgroup", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, "memory");
-	ruri_log("{base}Tried to mount cgroup v1 memory\n");
-}
-static void mount_cgroup_v1_cpu(void)
-{
-	/*
-	 * Mount Cgroup v1 cpu controller.
-	 * Nothing to return because if this function run failed,
-	 * that means cgroup is fully not supported on the device.
-	 */
-	mkdir("/sys/fs/cgroup", S_IRUSR | S_IWUSR);
-	// Maybe needless.
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-	// Mount /sys/fs/cgroup as tmpfs.
-	mount("tmpfs", "/sys/fs/cgroup", "tmpfs", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, NULL);
-	// Mount cpu controller.
-	mkdir("/sys/fs/cgroup/cpu", S_IRUSR | S_IWUSR);
-	usleep(2000);
-	mount("none", "/sys/fs/cgroup/cpu", "cgroup", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, "cpu");
-	ruri_log("{base}Tried to mount cgroup v1 cpu\n");
-}
-static void mount_cgroup_v1_cpuset(void)
-{
-	/*
-	 * Mount Cgroup v1 cpuset controller.
-	 * Nothing to return because if this function run failed,
-	 * that means cgroup is fully not supported on the device.
-	 */
-	mkdir("/sys/fs/cgroup", S_IRUSR | S_IWUSR);
-	// Maybe needless.
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-	// Mount /sys/fs/cgroup as tmpfs.
-	mount("tmpfs", "/sys/fs/cgroup", "tmpfs", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, NULL);
-	// Mount cpuset controller.
-	mkdir("/sys/fs/cgroup/cpuset", S_IRUSR | S_IWUSR);
-	usleep(2000);
-	mount("none", "/sys/fs/cgroup/cpuset", "cgroup", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, "cpuset");
-	ruri_log("{base}Tried to mount cgroup v1 cpuset\n");
-}
-static bool is_cgroupv2_support(const char *_Nonnull type)
-{
-	/*
-	 * Check if cgroup v2 supports type controller.
-	 * Return true if cgroup.controllers contains type.
-	 */
-	mkdir("/sys/fs/cgroup", S_IRUSR | S_IWUSR);
-	// Maybe needless.
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-	// I love cgroup2, because it's easy to mount and control.
-	int stat = mount("none", "/sys/fs/cgroup", "cgroup2", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, NULL);
-	if (stat != 0) {
+// Controllers that ruri might set limits of.
+static const char *const cgroup_controllers[] = { "memory", "cpu", "cpuset", "io", "pids", "hugetlb" };
+static const char *cgroup_v1_name(const char *_Nonnull controller)
+{
+	/*
+	 * The name of controller in cgroup v1.
+	 */
+	if (strcmp(controller, "io") == 0) {
+		return "blkio";
+	}
+	return controller;
+}
+static bool in_list(const char *_Nonnull list, const char *_Nonnull item, char sep)
+{
+	/*
+	 * Check if item is in list separated by sep, like `cpu,cpuacct` or `cpuset cpu io`.
+	 * The list might end with `\n`.
+	 */
+	size_t len = strlen(item);
+	const char *p = list;
+	while ((p = strstr(p, item)) != NULL) {
+		if ((p == list || p[-1] == sep) && (p[len] == sep || p[len] == '\0' || p[len] == '\n')) {
+			return true;
+		}
+		p += len;
+	}
+	return false;
+}
+static bool write_cgroup_file(int cgroup_fd, const char *_Nonnull file, const char *_Nonnull value)
+{
+	int fd = openat(cgroup_fd, file, O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
 		return false;
 	}
-	usleep(200);
-	int subtree_control_fd = open("/sys/fs/cgroup/cgroup.subtree_control", O_RDWR | O_CLOEXEC);
-	write(subtree_control_fd, "+memory\n", strlen("+memory\n"));
-	write(subtree_control_fd, "+cpu\n", strlen("+cpu\n"));
-	write(subtree_control_fd, "+cpuset\n", strlen("+cpuset\n"));
-	close(subtree_control_fd);
-	usleep(200);
-	// Check if we have a controlable cgroup for `type`.
-	mkdir("/sys/fs/cgroup/ruri", S_IRUSR | S_IWUSR);
-	int fd = open("/sys/fs/cgroup/ruri/cgroup.controllers", O_RDONLY | O_CLOEXEC);
+	bool ret = write(fd, value, strlen(value)) > 0;
+	close(fd);
+	return ret;
+}
+static bool read_cgroup_file(int cgroup_fd, const char *_Nonnull file, char *_Nonnull buf, size_t size)
+{
+	/*
+	 * Read the control file under cgroup_fd into buf, without the last `\n`.
+	 * Return false if failed.
+	 */
+	int fd = openat(cgroup_fd, file, O_RDONLY | O_CLOEXEC);
 	if (fd < 0) {
-		umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-		ruri_log("{base}Cgroup v2 does not support %s\n", type);
-		ruri_log("{base}cgroup.controllers does not exist\n");
 		return false;
 	}
-	char buf[256] = { '\0' };
-	ssize_t len = read(fd, buf, 255);
-	if (len <= 0) {
-		umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-		ruri_log("{base}Cgroup v2 does not support %s\n", type);
-		ruri_log("{base}cgroup.controllers read failed\n");
+	ssize_t len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0) {
 		return false;
 	}
 	buf[len] = '\0';
-	char str_to_find[32] = { '\0' };
-	ruri_log("{base}cgroup.controllers: %s\n", buf);
-	sprintf(str_to_find, "%s", type);
-	ruri_log("{base}str_to_find: %s\n", str_to_find);
-	// If str_to_find is in buf and str_to_find+1 is space (' ') or end ('\0').
-	// We return true.
-	if (strstr(buf, str_to_find) != NULL && (strstr(buf, str_to_find)[strlen(str_to_find)] == ' ' || strstr(buf, str_to_find)[strlen(str_to_find)] == '\0')) {
-		umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-		ruri_log("{base}Cgroup v2 supports %s\n", type);
-		return true;
+	if (len > 0 && buf[len - 1] == '\n') {
+		buf[len - 1] = '\0';
+	}
+	return true;
+}
+static void set_cgroup_file(const struct RURI_CGROUP *_Nonnull cgroup, int cgroup_fd, const char *_Nonnull file, const char *_Nonnull value)
+{
+	/*
+	 * Write value to the control file, and warn if failed.
+	 */
+	ruri_log("{base}Set %s to %s\n", file, value);
+	if (!write_cgroup_file(cgroup_fd, file, value) && !cgroup->no_warnings) {
+		ruri_warning("{yellow}Set %s failed{clear}\n", file);
+	}
+}
+static bool controller_needed(const struct RURI_CONTAINER *_Nonnull container, const char *_Nonnull controller)
+{
+	/*
+	 * Check if the container has limits of the controller.
+	 */
+	if (strcmp(controller, "memory") == 0) {
+		return container->memory != NULL || container->memory_high != NULL || container->memory_low != NULL || container->memory_min != NULL || container->memory_swap_max != NULL || container->memory_zswap_max != NULL;
+	}
+	if (strcmp(controller, "cpu") == 0) {
+		return container->cpupercent > 0 || container->cpu_max != NULL || container->cpu_burst >= 0 || container->cpu_weight > 0 || (container->cpu_weight_nice >= -20 && container->cpu_weight_nice <= 19) || container->cpu_idle != RURI_INIT_VALUE;
+	}
+	if (strcmp(controller, "cpuset") == 0) {
+		return container->cpuset != NULL;
+	}
+	if (strcmp(controller, "io") == 0) {
+		return container->io_max[0] != NULL || container->io_weight[0] != NULL || container->io_latency[0] != NULL;
+	}
+	if (strcmp(controller, "pids") == 0) {
+		return container->pids_max > 0;
+	}
+	if (strcmp(controller, "hugetlb") == 0) {
+		return container->hugetlb_max[0] != NULL;
 	}
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-	ruri_log("{base}Cgroup v2 does not support %s\n", type);
 	return false;
 }
-static char *memory_to_bytes(const char *_Nonnull memory)
-{
-	/*
-	 * Convert memory string to bytes.
-	 * Return a string of bytes.
-	 */
-	char *bytes = NULL;
-	char *memory_dup = strdup(memory);
-	char *ret = malloc(1024);
-	if (strstr(memory_dup, "K") != NULL) {
-		bytes = strtok(memory_dup, "K");
-		int kilobytes = atoi(bytes);
-		sprintf(ret, "%d", kilobytes * 1024);
-	} else if (strstr(memory_dup, "M") != NULL) {
-		bytes = strtok(memory_dup, "M");
-		int megabytes = atoi(bytes);
-		sprintf(ret, "%d", megabytes * 1024 * 1024);
-	} else if (strstr(memory_dup, "G") != NULL) {
-		bytes = strtok(memory_dup, "G");
-		int gigabytes = atoi(bytes);
-		sprintf(ret, "%ld", (long)gigabytes * 1024 * 1024 * 1024);
-	} else {
-		ruri_error("Memory format error, only K M G is supported\n");
+// Parse memory size with units.
+bool ruri_parse_memory_size(const char *_Nonnull size, unsigned long long *_Nonnull bytes)
+{
+	/*
+	 * Accept `max`, bytes, K/M/G/T units (1024 based, `KB`, `KiB` and lowercase are also accepted),
+	 * and percentage of host RAM like `50%`.
+	 * `max` is ULLONG_MAX.
+	 * Return false if the format is invalid or the value overflows.
+	 */
+	if (strcmp(size, "max") == 0) {
+		*bytes = ULLONG_MAX;
+		return true;
 	}
-	free(memory_dup);
-	return ret;
+	char *end = NULL;
+	errno = 0;
+	unsigned long long value = strtoull(size, &end, 10);
+	if (end == size || size[0] == '-' || errno == ERANGE) {
+		return false;
+	}
+	if (strcmp(end, "%") == 0) {
+		struct sysinfo info;
+		if (value > 100 || sysinfo(&info) != 0) {
+			return false;
+		}
+		*bytes = (unsigned long long)info.totalram * info.mem_unit / 100 * value;
+		return true;
+	}
+	int shift = 0;
+	switch (*end) {
+	case '\0':
+		break;
+	case 'k':
+	case 'K':
+		shift = 10;
+		break;
+	case 'm':
+	case 'M':
+		shift = 20;
+		break;
+	case 'g':
+	case 'G':
+		shift = 30;
+		break;
+	case 't':
+	case 'T':
+		shift = 40;
+		break;
+	default:
+		return false;
+	}
+	if (*end != '\0') {
+		end++;
+		if (strcmp(end, "") != 0 && strcmp(end, "B") != 0 && strcmp(end, "b") != 0 && strcmp(end, "iB") != 0) {
+			return false;
+		}
+	}
+	if (value > (ULLONG_MAX >> shift)) {
+		return false;
+	}
+	*bytes = value << shift;
+	return true;
 }
-static void set_cgroup_v1_memory(const struct RURI_CONTAINER *_Nonnull container)
+static bool mount_cgroup_tmpfs(struct RURI_CGROUP *_Nonnull cgroup)
 {
 	/*
-	 * Mount cgroupv1 memory controller and set limit.
-	 * Nothing to return, only warnings to show if cgroup is not supported.
-	 * Control file:
-	 * /sys/fs/cgroup/memory/${container_id}/memory.limit_in_bytes
+	 * Mount /sys/fs/cgroup as tmpfs, so that we can create mountpoints of
+	 * cgroup2 and cgroup v1 hierarchies in it.
+	 * It will only be mounted once in a session.
 	 */
-	mount_cgroup_v1_memory();
-	pid_t pid = getpid();
-	char buf[128] = { '\0' };
-	char memory_cgroup_path[PATH_MAX] = { '\0' };
-	sprintf(memory_cgroup_path, "/sys/fs/cgroup/memory/%d", container->container_id);
-	mkdir(memory_cgroup_path, S_IRUSR | S_IWUSR);
-	usleep(200);
-	int fd = -1;
-	if (container->memory != NULL) {
-		// Set memory limit.
-		char memory_cgroup_limit_path[PATH_MAX] = { '\0' };
-		sprintf(memory_cgroup_limit_path, "/sys/fs/cgroup/memory/%d/memory.limit_in_bytes", container->container_id);
-		fd = open(memory_cgroup_limit_path, O_RDWR | O_CLOEXEC);
-		if (fd < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set memory limit failed{clear}\n");
-			umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-			return;
+	if (cgroup->mounted) {
+		return true;
+	}
+	strcpy(cgroup->mountpoint, "/sys/fs/cgroup");
+	mkdir(cgroup->mountpoint, S_IRUSR | S_IWUSR);
+	// Umount the mask of /sys/fs/cgroup.
+	umount2(cgroup->mountpoint, MNT_DETACH | MNT_FORCE);
+	if (mount("tmpfs", cgroup->mountpoint, "tmpfs", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, NULL) != 0) {
+		ruri_log("{base}Failed to mount tmpfs on %s\n", cgroup->mountpoint);
+		return false;
+	}
+	cgroup->mounted = true;
+	return true;
+}
+static void get_cgroup_v1_options(const char *_Nonnull controller, char *_Nonnull options)
+{
+	/*
+	 * Controllers might be co-mounted in cgroup v1, like `cpu,cpuacct`,
+	 * and mounting one of them only will fail with EBUSY.
+	 * Co-mounted controllers have the same hierarchy ID in /proc/cgroups.
+	 */
+	strcpy(options, controller);
+	int fd = open("/proc/cgroups", O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+	char buf[4096] = { '\0' };
+	ssize_t len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0) {
+		return;
+	}
+	buf[len] = '\0';
+	// Format: subsys_name hierarchy num_cgroups enabled
+	char names[64][64] = { { '\0' } };
+	int hierarchies[64] = { 0 };
+	int count = 0;
+	int target = 0;
+	char *saveptr = NULL;
+	for (char *line = strtok_r(buf, "\n", &saveptr); line != NULL && count < 64; line = strtok_r(NULL, "\n", &saveptr)) {
+		if (sscanf(line, "%63s %d", names[count], &hierarchies[count]) != 2 || names[count][0] == '#') {
+			continue;
 		}
-		char *memory = memory_to_bytes(container->memory);
-		sprintf(buf, "%s\n", memory);
-		if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set memory limit failed{clear}\n");
+		if (strcmp(names[count], controller) == 0) {
+			target = hierarchies[count];
 		}
-		free(memory);
-		close(fd);
-		char memory_oom[PATH_MAX] = { '\0' };
-		sprintf(memory_oom, "/sys/fs/cgroup/memory/%d/memory.oom_control", container->container_id);
-		fd = open(memory_oom, O_RDWR | O_CLOEXEC);
-		if (fd < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set memory limit failed{clear}\n");
-			umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-			return;
+		count++;
+	}
+	if (target <= 0) {
+		return;
+	}
+	options[0] = '\0';
+	for (int i = 0; i < count; i++) {
+		if (hierarchies[i] == target) {
+			if (options[0] != '\0') {
+				strcat(options, ",");
+			}
+			strcat(options, names[i]);
 		}
-		sprintf(buf, "1\n");
-		if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set memory limit failed{clear}\n");
+	}
+	ruri_log("{base}Cgroup v1 options of %s: %s\n", controller, options);
+}
+static void open_cgroup_v1(struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container, const char *_Nonnull controller)
+{
+	/*
+	 * Mount cgroup v1 hierarchy of controller and create cgroup ${container_id}.
+	 * Nothing to return, the controller will be skipped if failed.
+	 */
+	if (cgroup->v1_count >= RURI_CGROUP_MAX_V1 || !mount_cgroup_tmpfs(cgroup)) {
+		return;
+	}
+	char path[PATH_MAX] = { '\0' };
+	sprintf(path, "%s/%s", cgroup->mountpoint, cgroup_v1_name(controller));
+	mkdir(path, S_IRUSR | S_IWUSR);
+	char options[256] = { '\0' };
+	get_cgroup_v1_options(cgroup_v1_name(controller), options);
+	if (mount("none", path, "cgroup", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, options) != 0) {
+		ruri_log("{base}Failed to mount cgroup v1 %s\n", cgroup_v1_name(controller));
+		return;
+	}
+	int root_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (root_fd < 0) {
+		return;
+	}
+	char id[32] = { '\0' };
+	sprintf(id, "%d", container->container_id);
+	mkdirat(root_fd, id, S_IRUSR | S_IWUSR);
+	int fd = openat(root_fd, id, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd >= 0 && strcmp(controller, "cpuset") == 0) {
+		// A new cpuset cgroup has empty cpuset.cpus and cpuset.mems,
+		// and no process can join it, so inherit them from the root.
+		char buf[4096] = { '\0' };
+		const char *files[] = { "cpuset.cpus", "cpuset.mems" };
+		for (int i = 0; i < 2; i++) {
+			if (read_cgroup_file(fd, files[i], buf, sizeof(buf)) && buf[0] == '\0' && read_cgroup_file(root_fd, files[i], buf, sizeof(buf))) {
+				write_cgroup_file(fd, files[i], buf);
+			}
 		}
-		close(fd);
 	}
-	char memory_cgroup_procs_path[PATH_MAX] = { '\0' };
-	sprintf(memory_cgroup_procs_path, "/sys/fs/cgroup/memory/%d/cgroup.procs", container->container_id);
-	// Add pid to container_id memory cgroup.
-	fd = open(memory_cgroup_procs_path, O_RDWR | O_CLOEXEC);
+	close(root_fd);
 	if (fd < 0) {
-		umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
 		return;
 	}
-	sprintf(buf, "%d\n", pid);
-	write(fd, buf, strlen(buf));
-	close(fd);
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
+	ruri_log("{base}Using cgroup v1 %s\n", controller);
+	cgroup->v1_controller[cgroup->v1_count] = controller;
+	cgroup->v1_fd[cgroup->v1_count] = fd;
+	cgroup->v1_count++;
 }
-static void set_cgroup_v1_cpu(const struct RURI_CONTAINER *_Nonnull container)
+static void enable_cgroup_v2_controllers(struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container, int root_fd)
 {
 	/*
-	 * Mount cgroupv1 cpu controller and set limit.
-	 * Nothing to return, only warnings to show if cgroup is not supported.
-	 * Control file:
-	 * /sys/fs/cgroup/cpu/${container_id}/cpu.cfs_quota_us
-	 * /sys/fs/cgroup/cpu/${container_id}/cpu.cfs_period_us
-	 */
-	mount_cgroup_v1_cpu();
-	char cpu_cgroup_path[PATH_MAX] = { '\0' };
-	sprintf(cpu_cgroup_path, "/sys/fs/cgroup/cpu/%d", container->container_id);
-	mkdir(cpu_cgroup_path, S_IRUSR | S_IWUSR);
-	pid_t pid = getpid();
-	char buf[128] = { '\0' };
-	usleep(200);
-	int fd = -1;
-	if (container->cpupercent > 0) {
-		// Set memory limit.
-		char cpu_cgroup_quota_path[PATH_MAX] = { '\0' };
-		sprintf(cpu_cgroup_quota_path, "/sys/fs/cgroup/cpu/%d/cpu.cfs_quota_us", container->container_id);
-		fd = open(cpu_cgroup_quota_path, O_RDWR | O_CLOEXEC);
-		if (fd < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set memory limit failed{clear}\n");
-			umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-			return;
+	 * Enable the controllers that we need in cgroup.subtree_control.
+	 * Controllers not in cgroup.controllers are left to cgroup v1.
+	 */
+	char buf[256] = { '\0' };
+	for (size_t i = 0; i < sizeof(cgroup_controllers) / sizeof(cgroup_controllers[0]); i++) {
+		if (controller_needed(container, cgroup_controllers[i]) && in_list(cgroup->controllers, cgroup_controllers[i], ' ')) {
+			strcat(buf, buf[0] == '\0' ? "+" : " +");
+			strcat(buf, cgroup_controllers[i]);
 		}
-		sprintf(buf, "%d\n", container->cpupercent * 1000);
-		if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set cpupercent limit failed{clear}\n");
+	}
+	if (buf[0] == '\0') {
+		return;
+	}
+	ruri_log("{base}Enable controllers: %s\n", buf);
+	if (write_cgroup_file(root_fd, "cgroup.subtree_control", buf)) {
+		return;
+	}
+	// Try them one by one, so that one controller does not break others.
+	char *saveptr = NULL;
+	for (char *c = strtok_r(buf, " ", &saveptr); c != NULL; c = strtok_r(NULL, " ", &saveptr)) {
+		if (!write_cgroup_file(root_fd, "cgroup.subtree_control", c) && !container->no_warnings) {
+			ruri_warning("{yellow}Failed to enable cgroup controller %s{clear}\n", c + 1);
 		}
-		close(fd);
-		char cpu_cgroup_period_path[PATH_MAX] = { '\0' };
-		sprintf(cpu_cgroup_period_path, "/sys/fs/cgroup/cpu/%d/cpu.cfs_period_us", container->container_id);
-		fd = open(cpu_cgroup_period_path, O_RDWR | O_CLOEXEC);
-		if (fd < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set cpupercent limit failed{clear}\n");
-			umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
+	}
+}
+static void open_cgroup_v2(struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Use the cgroup2 mount we can see, or mount cgroup2 by ourselves.
+	 * Then read cgroup.controllers, enable the controllers we need,
+	 * and create cgroup ${container_id}.
+	 */
+	char path[PATH_MAX] = { '\0' };
+	struct RURI_MOUNTINFO *info = ruri_read_mountinfo(0);
+	if (info != NULL) {
+		const struct RURI_MOUNTINFO_ENTRY *entry = ruri_mountinfo_find_fstype(info, "cgroup2");
+		if (entry != NULL) {
+			strcpy(path, entry->mount_point);
+		}
+		ruri_free_mountinfo(info);
+	}
+	if (path[0] == '\0') {
+		if (!mount_cgroup_tmpfs(cgroup)) {
 			return;
 		}
-		sprintf(buf, "%d\n", 100000);
-		if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set cpupercent limit failed{clear}\n");
+		sprintf(path, "%s/unified", cgroup->mountpoint);
+		mkdir(path, S_IRUSR | S_IWUSR);
+		// I love cgroup2, because it's easy to mount and control.
+		if (mount("none", path, "cgroup2", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, NULL) != 0) {
+			ruri_log("{base}Cgroup v2 is not supported\n");
+			return;
 		}
-		close(fd);
 	}
-	char cpu_cgroup_procs_path[PATH_MAX] = { '\0' };
-	sprintf(cpu_cgroup_procs_path, "/sys/fs/cgroup/cpu/%d/cgroup.procs", container->container_id);
-	// Add pid to container_id cpupercent cgroup.
-	fd = open(cpu_cgroup_procs_path, O_RDWR | O_CLOEXEC);
-	if (fd < 0) {
-		umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
+	ruri_log("{base}Using cgroup v2 on %s\n", path);
+	int root_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (root_fd < 0) {
 		return;
 	}
-	sprintf(buf, "%d\n", pid);
-	write(fd, buf, strlen(buf));
-	close(fd);
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
+	read_cgroup_file(root_fd, "cgroup.controllers", cgroup->controllers, sizeof(cgroup->controllers));
+	ruri_log("{base}cgroup.controllers: %s\n", cgroup->controllers);
+	enable_cgroup_v2_controllers(cgroup, container, root_fd);
+	char id[32] = { '\0' };
+	sprintf(id, "%d", container->container_id);
+	mkdirat(root_fd, id, S_IRUSR | S_IWUSR);
+	cgroup->v2_fd = openat(root_fd, id, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	close(root_fd);
+	if (cgroup->v2_fd < 0 && !container->no_warnings) {
+		ruri_warning("{yellow}Failed to create cgroup %s/%s{clear}\n", path, id);
+	}
 }
-static void set_cgroup_v1_cpuset(const struct RURI_CONTAINER *_Nonnull container)
+// Open a cgroup session for the container.
+struct RURI_CGROUP *ruri_cgroup_open(const struct RURI_CONTAINER *_Nonnull container)
 {
 	/*
-	 * Mount cgroupv1 cpuset controller and set limit.
-	 * Nothing to return, only warnings to show if cgroup is not supported.
-	 * Control file: /sys/fs/cgroup/cpuset/${container_id}/cpuset.cpus
+	 * Create cgroup ${container_id} in cgroup v2, and in cgroup v1 hierarchies
+	 * for the controllers that cgroup v2 does not support.
+	 * Without cgroup v2, we also use cgroup v1 for the controllers without limits,
+	 * so that we can find the processes in container by cgroup.
+	 * Warning: free the session by ruri_cgroup_close().
 	 */
-	mount_cgroup_v1_cpuset();
-	char cpuset_cgroup_path[PATH_MAX] = { '\0' };
-	sprintf(cpuset_cgroup_path, "/sys/fs/cgroup/cpuset/%d", container->container_id);
-	mkdir(cpuset_cgroup_path, S_IRUSR | S_IWUSR);
-	pid_t pid = getpid();
-	char buf[128] = { '\0' };
-	int fd = -1;
-	if (container->cpuset != NULL) {
-		// Set cpuset limit.
-		char cpuset_cgroup_mems_path[PATH_MAX] = { '\0' };
-		sprintf(cpuset_cgroup_mems_path, "/sys/fs/cgroup/cpuset/%d/cpuset.mems", container->container_id);
-		fd = open(cpuset_cgroup_mems_path, O_RDWR | O_CLOEXEC);
-		if (fd < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set cpuset limit failed{clear}\n");
-			// Do not keep the apifs mounted.
-			umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-			return;
+	struct RURI_CGROUP *cgroup = malloc(sizeof(struct RURI_CGROUP));
+	memset(cgroup, 0, sizeof(struct RURI_CGROUP));
+	cgroup->v2_fd = -1;
+	cgroup->no_warnings = container->no_warnings;
+	open_cgroup_v2(cgroup, container);
+	for (size_t i = 0; i < sizeof(cgroup_controllers) / sizeof(cgroup_controllers[0]); i++) {
+		if (cgroup->v2_fd >= 0 && in_list(cgroup->controllers, cgroup_controllers[i], ' ')) {
+			continue;
 		}
-		write(fd, "0\n", strlen("0\n"));
-		close(fd);
-		char cpuset_cgroup_cpus_path[PATH_MAX] = { '\0' };
-		sprintf(cpuset_cgroup_cpus_path, "/sys/fs/cgroup/cpuset/%d/cpuset.cpus", container->container_id);
-		fd = open(cpuset_cgroup_cpus_path, O_RDWR | O_CLOEXEC);
-		if (fd < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set cpuset limit failed{clear}\n");
-			// Do not keep the apifs mounted.
-			umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-			return;
+		if (cgroup->v2_fd < 0 || controller_needed(container, cgroup_controllers[i])) {
+			open_cgroup_v1(cgroup, container, cgroup_controllers[i]);
 		}
-		sprintf(buf, "%s\n", container->cpuset);
-		if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set cpu limit failed{clear}\n");
+	}
+	return cgroup;
+}
+// Get the cgroup directory fd of controller.
+int ruri_cgroup_fd(const struct RURI_CGROUP *_Nonnull cgroup, const char *_Nullable controller)
+{
+	/*
+	 * Return the fd of cgroup v1 directory if controller is in cgroup v1,
+	 * or the fd of cgroup v2 directory, -1 if not available.
+	 * The fd is owned by the session, do not close() it.
+	 */
+	if (controller != NULL) {
+		for (int i = 0; i < cgroup->v1_count; i++) {
+			if (strcmp(cgroup->v1_controller[i], controller) == 0) {
+				return cgroup->v1_fd[i];
+			}
+		}
+		// Not in cgroup v1, and not supported by cgroup v2.
+		if (cgroup->v2_fd >= 0 && !in_list(cgroup->controllers, controller, ' ')) {
+			return -1;
 		}
-		close(fd);
 	}
-	char cpuset_cgroup_procs_path[PATH_MAX] = { '\0' };
-	sprintf(cpuset_cgroup_procs_path, "/sys/fs/cgroup/cpuset/%d/cgroup.procs", container->container_id);
-	// Add pid to container_id cpuset cgroup.
-	fd = open(cpuset_cgroup_procs_path, O_RDWR | O_CLOEXEC);
-	if (fd < 0) {
-		// Do not keep the apifs mounted.
-		umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
+	return cgroup->v2_fd;
+}
+static bool is_cgroup_v1(const struct RURI_CGROUP *_Nonnull cgroup, const char *_Nonnull controller)
+{
+	return ruri_cgroup_fd(cgroup, controller) != cgroup->v2_fd;
+}
+static void set_memory_file(const struct RURI_CGROUP *_Nonnull cgroup, int cgroup_fd, const char *_Nonnull file, const char *_Nonnull size, unsigned long long extra)
+{
+	/*
+	 * Write size in bytes to the control file, `max` is -1 in cgroup v1,
+	 * where the files are named like *_in_bytes.
+	 * extra is added to the size, for memory.memsw.limit_in_bytes.
+	 */
+	unsigned long long bytes = 0;
+	if (!ruri_parse_memory_size(size, &bytes)) {
+		if (!cgroup->no_warnings) {
+			ruri_warning("{yellow}Invalid memory size %s for %s{clear}\n", size, file);
+		}
 		return;
 	}
-	sprintf(buf, "%d\n", pid);
-	write(fd, buf, strlen(buf));
-	close(fd);
-	// Do not keep the apifs mounted.
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
+	char buf[64] = { '\0' };
+	if (bytes == ULLONG_MAX || extra == ULLONG_MAX || bytes > ULLONG_MAX - extra) {
+		strcpy(buf, strstr(file, "_in_bytes") != NULL ? "-1" : "max");
+	} else {
+		sprintf(buf, "%llu", bytes + extra);
+	}
+	set_cgroup_file(cgroup, cgroup_fd, file, buf);
 }
-static void set_cgroup_v2_memory(const struct RURI_CONTAINER *_Nonnull container)
+static void set_memory_limit(const struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container)
 {
 	/*
-	 * Mount cgroupv2 memory controller and set limit.
-	 * Nothing to return, only warnings to show if cgroup is not supported.
-	 * Control file: /sys/fs/cgroup/${container_id}/memory.max
-	 */
-	mkdir("/sys/fs/cgroup", S_IRUSR | S_IWUSR);
-	// Maybe needless.
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-	// Mount /sys/fs/cgroup as cgroup2.
-	mount("none", "/sys/fs/cgroup", "cgroup2", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, NULL);
-	pid_t pid = getpid();
-	char buf[128] = { '\0' };
-	char cgroup_path[PATH_MAX] = { '\0' };
-	sprintf(cgroup_path, "/sys/fs/cgroup/%d", container->container_id);
-	mkdir(cgroup_path, S_IRUSR | S_IWUSR);
-	usleep(200);
-	char cgroup_procs_path[PATH_MAX] = { '\0' };
-	sprintf(cgroup_procs_path, "/sys/fs/cgroup/%d/cgroup.procs", container->container_id);
-	// Add pid to container_id cgroup.
-	int fd = open(cgroup_procs_path, O_RDWR | O_CLOEXEC);
-	if (fd < 0 && !container->no_warnings) {
-		ruri_warning("{yellow}Set cgroup.procs failed{clear}\n");
-		// Do not keep the apifs mounted.
-		umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
+	 * Control files:
+	 * cgroup v2: memory.max, memory.high, memory.low, memory.min,
+	 *            memory.swap.max, memory.zswap.max, memory.oom.group
+	 * cgroup v1: memory.limit_in_bytes, memory.soft_limit_in_bytes (for memory.low),
+	 *            memory.memsw.limit_in_bytes (memory + swap), memory.oom_control
+	 * memory.low and memory.min protect the memory of container from being reclaimed
+	 * when other containers or the host need memory.
+	 */
+	int fd = ruri_cgroup_fd(cgroup, "memory");
+	if (is_cgroup_v1(cgroup, "memory")) {
+		// memory.memsw.limit_in_bytes can not be less than memory.limit_in_bytes,
+		// so unset it first, in case that we are raising the limits of a running container.
+		if (container->memory != NULL && container->memory_swap_max != NULL) {
+			write_cgroup_file(fd, "memory.memsw.limit_in_bytes", "-1");
+		}
+		if (container->memory != NULL) {
+			set_memory_file(cgroup, fd, "memory.limit_in_bytes", container->memory, 0);
+			set_cgroup_file(cgroup, fd, "memory.oom_control", "1");
+		}
+		if (container->memory_low != NULL) {
+			set_memory_file(cgroup, fd, "memory.soft_limit_in_bytes", container->memory_low, 0);
+		}
+		// memory.memsw.limit_in_bytes should be set after memory.limit_in_bytes.
+		if (container->memory_swap_max != NULL) {
+			unsigned long long swap = 0;
+			if (container->memory != NULL && ruri_parse_memory_size(container->memory_swap_max, &swap)) {
+				set_memory_file(cgroup, fd, "memory.memsw.limit_in_bytes", container->memory, swap);
+			} else if (!cgroup->no_warnings) {
+				ruri_warning("{yellow}memory.swap.max needs memory limit to be set in cgroup v1{clear}\n");
+			}
+		}
+		if ((container->memory_high != NULL || container->memory_min != NULL || container->memory_zswap_max != NULL) && !cgroup->no_warnings) {
+			ruri_warning("{yellow}memory.high, memory.min and memory.zswap.max are not supported by cgroup v1{clear}\n");
+		}
 		return;
 	}
-	sprintf(buf, "%d\n", pid);
-	write(fd, buf, strlen(buf));
-	close(fd);
+	const char *files[] = { "memory.min", "memory.low", "memory.high", "memory.max", "memory.swap.max", "memory.zswap.max" };
+	const char *sizes[] = { container->memory_min, container->memory_low, container->memory_high, container->memory, container->memory_swap_max, container->memory_zswap_max };
+	for (int i = 0; i < 6; i++) {
+		if (sizes[i] != NULL) {
+			set_memory_file(cgroup, fd, files[i], sizes[i], 0);
+		}
+	}
 	if (container->memory != NULL) {
-		// Set memory limit.
-		char cgroup_memlimit_path[PATH_MAX] = { '\0' };
-		sprintf(cgroup_memlimit_path, "/sys/fs/cgroup/%d/memory.high", container->container_id);
-		fd = open(cgroup_memlimit_path, O_RDWR | O_CLOEXEC);
-		if (fd < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set memory limit failed{clear}\n");
-			// Do not keep the apifs mounted.
-			umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-			return;
+		set_cgroup_file(cgroup, fd, "memory.oom.group", "1");
+	}
+}
+// Parse cpu.max limit.
+char *ruri_parse_cpu_max(const char *_Nonnull cpu_max)
+{
+	/*
+	 * Accept `QUOTA PERIOD`, `QUOTA,PERIOD`, `QUOTA/PERIOD` or `QUOTA` in microseconds,
+	 * QUOTA can be `max`, PERIOD is 100000 by default.
+	 * Return the malloc()ed string in the format of cpu.max,
+	 * or NULL if the format is invalid.
+	 */
+	char quota[32] = { '\0' };
+	long period = 100000;
+	char sep = '\0';
+	int n = sscanf(cpu_max, "%31[^ ,/]%c%ld", quota, &sep, &period);
+	if (n == 2 || n < 1) {
+		return NULL;
+	}
+	char *end = NULL;
+	long quota_us = strtol(quota, &end, 10);
+	if (strcmp(quota, "max") != 0 && (*end != '\0' || quota_us < 1000)) {
+		return NULL;
+	}
+	// Limits of the kernel.
+	if (period < 1000 || period > 1000000) {
+		return NULL;
+	}
+	char *ret = malloc(64);
+	sprintf(ret, "%s %ld", quota, period);
+	return ret;
+}
+static int nice_to_shares(int nice)
+{
+	/*
+	 * The weight of nice value in the kernel (sched_prio_to_weight[]),
+	 * nice 0 is 1024, the default of cpu.shares.
+	 */
+	static const int weights[40] = {
+		88761, 71755, 56483, 46273, 36291,
+		29154, 23254, 18705, 14949, 11916,
+		9548, 7620, 6100, 4904, 3906,
+		3121, 2501, 1991, 1586, 1277,
+		1024, 820, 655, 526, 423,
+		335, 272, 215, 172, 137,
+		110, 87, 70, 56, 45,
+		36, 29, 23, 18, 15
+	};
+	return weights[nice + 20];
+}
+static void set_cpu_limit(const struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Control files:
+	 * cgroup v2: cpu.max, cpu.max.burst, cpu.weight, cpu.weight.nice, cpu.idle
+	 * cgroup v1: cpu.cfs_quota_us, cpu.cfs_period_us, cpu.cfs_burst_us, cpu.shares, cpu.idle
+	 * cpu.max is `QUOTA PERIOD`, so cpupercent 350 is `350000 100000`, 3.5 cores.
+	 */
+	int fd = ruri_cgroup_fd(cgroup, "cpu");
+	bool v1 = is_cgroup_v1(cgroup, "cpu");
+	char buf[128] = { '\0' };
+	char quota[32] = { '\0' };
+	long period = 100000;
+	if (container->cpu_max != NULL) {
+		sscanf(container->cpu_max, "%31s %ld", quota, &period);
+	} else if (container->cpupercent > 0) {
+		sprintf(quota, "%lld", (long long)container->cpupercent * period / 100);
+	}
+	if (quota[0] != '\0') {
+		if (v1) {
+			// Period first, so that the quota is checked with the new period.
+			sprintf(buf, "%ld", period);
+			set_cgroup_file(cgroup, fd, "cpu.cfs_period_us", buf);
+			set_cgroup_file(cgroup, fd, "cpu.cfs_quota_us", strcmp(quota, "max") == 0 ? "-1" : quota);
+		} else {
+			sprintf(buf, "%s %ld", quota, period);
+			set_cgroup_file(cgroup, fd, "cpu.max", buf);
 		}
-		sprintf(buf, "%s\n", container->memory);
-		if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set memory limit failed{clear}\n");
+	}
+	if (container->cpu_burst >= 0) {
+		sprintf(buf, "%d", container->cpu_burst);
+		set_cgroup_file(cgroup, fd, v1 ? "cpu.cfs_burst_us" : "cpu.max.burst", buf);
+	}
+	if (container->cpu_weight > 0) {
+		// cpu.weight 100 is cpu.shares 1024.
+		sprintf(buf, "%lld", v1 ? (long long)container->cpu_weight * 1024 / 100 : (long long)container->cpu_weight);
+		set_cgroup_file(cgroup, fd, v1 ? "cpu.shares" : "cpu.weight", buf);
+	} else if (container->cpu_weight_nice >= -20 && container->cpu_weight_nice <= 19) {
+		sprintf(buf, "%d", v1 ? nice_to_shares(container->cpu_weight_nice) : container->cpu_weight_nice);
+		set_cgroup_file(cgroup, fd, v1 ? "cpu.shares" : "cpu.weight.nice", buf);
+	}
+	if (container->cpu_idle == 1) {
+		// cpu.idle is also available in cgroup v1 since Linux 5.15,
+		// or we use the minimum cpu.shares.
+		if (!write_cgroup_file(fd, "cpu.idle", "1")) {
+			set_cgroup_file(cgroup, fd, v1 ? "cpu.shares" : "cpu.weight", v1 ? "2" : "1");
 		}
-		close(fd);
-		char cgroup_memlimit_path2[PATH_MAX] = { '\0' };
-		sprintf(cgroup_memlimit_path2, "/sys/fs/cgroup/%d/memory.max", container->container_id);
-		fd = open(cgroup_memlimit_path2, O_RDWR | O_CLOEXEC);
-		if (fd < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set memory limit failed{clear}\n");
-			// Do not keep the apifs mounted.
-			umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-			return;
+	} else if (container->cpu_idle == 0) {
+		// Unset by `ruri --update`, restore the default weight
+		// if it was set to the minimum above instead of cpu.idle.
+		if (!write_cgroup_file(fd, "cpu.idle", "0") && container->cpu_weight <= 0 && !(container->cpu_weight_nice >= -20 && container->cpu_weight_nice <= 19)) {
+			set_cgroup_file(cgroup, fd, v1 ? "cpu.shares" : "cpu.weight", v1 ? "1024" : "100");
 		}
-		sprintf(buf, "%s\n", container->memory);
-		if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set memory limit failed{clear}\n");
+	}
+}
+static void get_used_cpus(int cgroup_fd, int container_id, cpu_set_t *_Nonnull used)
+{
+	/*
+	 * Get CPUs assigned to other running ruri containers,
+	 * they are the cgroups named by container_id next to ours.
+	 * A cgroup using all CPUs of the parent has no cpuset limit.
+	 */
+	CPU_ZERO(used);
+	int parent_fd = openat(cgroup_fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (parent_fd < 0) {
+		return;
+	}
+	char all[4096] = { '\0' };
+	if (!read_cgroup_file(parent_fd, "cpuset.cpus.effective", all, sizeof(all))) {
+		read_cgroup_file(parent_fd, "cpuset.cpus", all, sizeof(all));
+	}
+	DIR *dir = fdopendir(parent_fd);
+	if (dir == NULL) {
+		close(parent_fd);
+		return;
+	}
+	struct dirent *entry = NULL;
+	while ((entry = readdir(dir)) != NULL) {
+		char *end = NULL;
+		long id = strtol(entry->d_name, &end, 10);
+		if (entry->d_type != DT_DIR || end == entry->d_name || *end != '\0' || id == container_id) {
+			continue;
+		}
+		int fd = openat(parent_fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd < 0) {
+			continue;
+		}
+		char buf[4096] = { '\0' };
+		cpu_set_t set;
+		// Only count the containers that are running.
+		if (read_cgroup_file(fd, "cgroup.procs", buf, sizeof(buf)) && buf[0] != '\0' && read_cgroup_file(fd, "cpuset.cpus", buf, sizeof(buf)) && buf[0] != '\0' && strcmp(buf, all) != 0 && ruri_parse_cpu_list(buf, &set)) {
+			CPU_OR(used, used, &set);
 		}
 		close(fd);
-		char cgroup_oom[PATH_MAX] = { '\0' };
-		sprintf(cgroup_oom, "/sys/fs/cgroup/%d/memory.oom.group", container->container_id);
-		fd = open(cgroup_oom, O_RDWR | O_CLOEXEC);
-		if (fd < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set memory limit failed{clear}\n");
-			// Do not keep the apifs mounted.
-			umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
+	}
+	closedir(dir);
+}
+static void set_cpuset_limit(const struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Control files:
+	 * cgroup v2: cpuset.mems, cpuset.cpus
+	 * cgroup v1: cpuset.mems, cpuset.cpus
+	 * `auto:N` picks N CPUs by the topology, see cpuset.c.
+	 * cpuset.mems is set to the NUMA nodes of the CPUs,
+	 * so that the container will not get remote memory.
+	 */
+	int fd = ruri_cgroup_fd(cgroup, "cpuset");
+	char *cpus = NULL;
+	if (strncmp(container->cpuset, "auto:", 5) == 0) {
+		cpu_set_t used;
+		get_used_cpus(fd, container->container_id, &used);
+		cpus = ruri_auto_cpuset(atoi(container->cpuset + 5), &used);
+		if (cpus == NULL || cpus[0] == '\0') {
+			if (!cgroup->no_warnings) {
+				ruri_warning("{yellow}Warning: failed to pick CPUs for cpuset=%s\n", container->cpuset);
+			}
+			free(cpus);
 			return;
 		}
-		sprintf(buf, "1\n");
-		if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set memory limit failed{clear}\n");
+	} else {
+		cpus = strdup(container->cpuset);
+	}
+	if (!cgroup->no_warnings) {
+		ruri_check_isolated_cpus(cpus);
+	}
+	char *mems = ruri_cpuset_mems(cpus);
+	set_cgroup_file(cgroup, fd, "cpuset.mems", mems);
+	set_cgroup_file(cgroup, fd, "cpuset.cpus", cpus);
+	free(mems);
+	free(cpus);
+}
+static bool read_block_dev(const char *_Nonnull sys_path, unsigned int *_Nonnull major, unsigned int *_Nonnull minor)
+{
+	/*
+	 * Read `MAJ:MIN` from the dev file in sysfs.
+	 */
+	int fd = open(sys_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	char buf[32] = { '\0' };
+	ssize_t len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	return len > 0 && sscanf(buf, "%u:%u", major, minor) == 2;
+}
+static bool get_loop_dev(const char *_Nonnull image, unsigned int *_Nonnull major, unsigned int *_Nonnull minor)
+{
+	/*
+	 * Find the loop device that image is attached to.
+	 */
+	char image_path[PATH_MAX] = { '\0' };
+	if (realpath(image, image_path) == NULL) {
+		return false;
+	}
+	DIR *dir = opendir("/sys/block");
+	if (dir == NULL) {
+		return false;
+	}
+	bool ret = false;
+	struct dirent *file = NULL;
+	while ((file = readdir(dir)) != NULL) {
+		if (strncmp(file->d_name, "loop", 4) != 0) {
+			continue;
+		}
+		char path[PATH_MAX] = { '\0' };
+		sprintf(path, "/sys/block/%s/loop/backing_file", file->d_name);
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			continue;
 		}
+		char backing_file[PATH_MAX] = { '\0' };
+		ssize_t len = read(fd, backing_file, PATH_MAX - 1);
 		close(fd);
+		if (len > 0 && backing_file[len - 1] == '\n') {
+			backing_file[len - 1] = '\0';
+		}
+		if (strcmp(backing_file, image_path) == 0) {
+			sprintf(path, "/sys/block/%s/dev", file->d_name);
+			ret = read_block_dev(path, major, minor);
+			break;
+		}
 	}
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
+	closedir(dir);
+	return ret;
 }
-static void set_cgroup_v2_cpuset(const struct RURI_CONTAINER *_Nonnull container)
+static bool get_block_dev(const char *_Nonnull dev, unsigned int *_Nonnull major, unsigned int *_Nonnull minor)
 {
 	/*
-	 * Mount cgroupv2 cpuset controller and set limit.
-	 * Nothing to return, only warnings to show if cgroup is not supported.
-	 * Control file: /sys/fs/cgroup/${container_id}/cpuset.cpus
-	 */
-	mkdir("/sys/fs/cgroup", S_IRUSR | S_IWUSR);
-	// Maybe needless.
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-	// Mount /sys/fs/cgroup as cgroup2.
-	mount("none", "/sys/fs/cgroup", "cgroup2", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, NULL);
-	pid_t pid = getpid();
-	char buf[128] = { '\0' };
-	char cgroup_path[PATH_MAX] = { '\0' };
-	sprintf(cgroup_path, "/sys/fs/cgroup/%d", container->container_id);
-	mkdir(cgroup_path, S_IRUSR | S_IWUSR);
-	usleep(200);
-	char cgroup_procs_path[PATH_MAX] = { '\0' };
-	sprintf(cgroup_procs_path, "/sys/fs/cgroup/%d/cgroup.procs", container->container_id);
-	// Add pid to container_id cgroup.
-	int fd = open(cgroup_procs_path, O_RDWR | O_CLOEXEC);
-	if (fd < 0 && !container->no_warnings) {
-		ruri_warning("{yellow}Set cgroup.procs failed{clear}\n");
-		// Do not keep the apifs mounted.
-		umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
+	 * dev can be `MAJ:MIN`, a block device, a loop image attached to a loop device,
+	 * or any other file or directory, that means the device it's on, like the rootfs of container.
+	 * A partition will be resolved to its disk, because io controller only works for disks.
+	 * Return false if it's not on a block device, for example, tmpfs or overlayfs.
+	 */
+	char end = '\0';
+	if (sscanf(dev, "%u:%u%c", major, minor, &end) == 2) {
+		return true;
+	}
+	struct stat st;
+	if (stat(dev, &st) != 0) {
+		return false;
+	}
+	if (S_ISBLK(st.st_mode)) {
+		*major = major(st.st_rdev);
+		*minor = minor(st.st_rdev);
+	} else if (S_ISREG(st.st_mode) && get_loop_dev(dev, major, minor)) {
+		ruri_log("{base}%s is attached to loop device %u:%u\n", dev, *major, *minor);
+	} else {
+		*major = major(st.st_dev);
+		*minor = minor(st.st_dev);
+	}
+	char path[PATH_MAX] = { '\0' };
+	sprintf(path, "/sys/dev/block/%u:%u/partition", *major, *minor);
+	if (access(path, F_OK) == 0) {
+		// The parent directory of the partition is the disk.
+		sprintf(path, "/sys/dev/block/%u:%u/../dev", *major, *minor);
+		return read_block_dev(path, major, minor);
+	}
+	sprintf(path, "/sys/dev/block/%u:%u", *major, *minor);
+	return access(path, F_OK) == 0;
+}
+// Parse I/O limit to the format of io.max/io.latency or io.weight.
+char *ruri_parse_io_limit(const char *_Nonnull limit, bool weight)
+{
+	/*
+	 * Format:
+	 * io.max/io.latency: `DEV:rbps=1048576,wiops=120` -> `MAJ:MIN rbps=1048576 wiops=120`.
+	 * io.weight: `100` -> `default 100`, `DEV:200` -> `MAJ:MIN 200`.
+	 * DEV is split at the last `:` before the first `=`,
+	 * so both `/dev/sda:rbps=1` and `8:0:rbps=1` are valid.
+	 * Limits already in kernel format (with space) are kept as is,
+	 * so that limits in config file can be read again.
+	 * Return the malloc()ed string, or exit if the device is not found.
+	 */
+	if (strchr(limit, ' ') != NULL) {
+		return strdup(limit);
+	}
+	char *ret = malloc(strlen(limit) + 64);
+	if (weight && strchr(limit, ':') == NULL) {
+		sprintf(ret, "default %s", limit);
+		return ret;
+	}
+	char *dev = strdup(limit);
+	char *eq = strchr(dev, '=');
+	if (eq != NULL) {
+		*eq = '\0';
+	}
+	char *sep = strrchr(dev, ':');
+	if (eq != NULL) {
+		*eq = '=';
+	}
+	if (sep == NULL || sep[1] == '\0') {
+		ruri_error("{red}Error: I/O limit should be like `/dev/sda:rbps=1048576` QwQ\n");
+	}
+	*sep = '\0';
+	unsigned int major = 0;
+	unsigned int minor = 0;
+	if (!get_block_dev(dev, &major, &minor)) {
+		ruri_error("{red}Error: cannot find block device of %s QwQ\n", dev);
+	}
+	sprintf(ret, "%u:%u %s", major, minor, sep + 1);
+	// `,` separated keys to ` `.
+	for (char *p = ret; *p != '\0'; p++) {
+		if (*p == ',') {
+			*p = ' ';
+		}
+	}
+	free(dev);
+	return ret;
+}
+static void set_io_limit(const struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Control files:
+	 * cgroup v2: io.max, io.weight, io.latency
+	 * cgroup v1: blkio.throttle.{read,write}_{bps,iops}_device, blkio.bfq.weight or blkio.weight
+	 * Every device is a line in control file, so we write them one by one.
+	 */
+	int fd = ruri_cgroup_fd(cgroup, "io");
+	if (!is_cgroup_v1(cgroup, "io")) {
+		for (int i = 0; container->io_max[i] != NULL; i++) {
+			set_cgroup_file(cgroup, fd, "io.max", container->io_max[i]);
+		}
+		for (int i = 0; container->io_weight[i] != NULL; i++) {
+			set_cgroup_file(cgroup, fd, "io.weight", container->io_weight[i]);
+		}
+		for (int i = 0; container->io_latency[i] != NULL; i++) {
+			set_cgroup_file(cgroup, fd, "io.latency", container->io_latency[i]);
+		}
 		return;
 	}
-	sprintf(buf, "%d\n", pid);
-	if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
-		ruri_warning("{yellow}Set cgroup.procs failed{clear}\n");
+	// `8:0 rbps=1048576 wiops=max` -> blkio.throttle.read_bps_device: `8:0 1048576`.
+	const char *keys[] = { "rbps", "wbps", "riops", "wiops" };
+	const char *files[] = { "blkio.throttle.read_bps_device", "blkio.throttle.write_bps_device", "blkio.throttle.read_iops_device", "blkio.throttle.write_iops_device" };
+	for (int i = 0; container->io_max[i] != NULL; i++) {
+		char dev[32] = { '\0' };
+		sscanf(container->io_max[i], "%31s", dev);
+		for (int j = 0; j < 4; j++) {
+			char key[16] = { '\0' };
+			sprintf(key, " %s=", keys[j]);
+			const char *value = strstr(container->io_max[i], key);
+			if (value == NULL) {
+				continue;
+			}
+			value += strlen(key);
+			char buf[128] = { '\0' };
+			// `max` means no limit, that is 0 in cgroup v1.
+			sprintf(buf, "%s %llu", dev, strncmp(value, "max", 3) == 0 ? 0ULL : strtoull(value, NULL, 10));
+			set_cgroup_file(cgroup, fd, files[j], buf);
+		}
 	}
-	close(fd);
-	if (container->cpuset != NULL) {
-		// Set cpuset limit.
-		char cgroup_cpuset_path[PATH_MAX] = { '\0' };
-		sprintf(cgroup_cpuset_path, "/sys/fs/cgroup/%d/cpuset.cpus", container->container_id);
-		fd = open(cgroup_cpuset_path, O_RDWR | O_CLOEXEC);
-		if (fd < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set cpuset limit failed{clear}\n");
-			// Do not keep the apifs mounted.
-			umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-			return;
+	for (int i = 0; container->io_weight[i] != NULL; i++) {
+		// blkio.bfq.weight is in the same format as io.weight, but only exists with BFQ scheduler.
+		// Failures are ignored here, because we will also set ioprio as fallback.
+		if (!write_cgroup_file(fd, "blkio.bfq.weight", container->io_weight[i]) && strncmp(container->io_weight[i], "default ", 8) == 0) {
+			write_cgroup_file(fd, "blkio.weight", container->io_weight[i] + 8);
 		}
-		sprintf(buf, "%s\n", container->cpuset);
-		if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set cpuset limit failed{clear}\n");
+	}
+	if (container->io_latency[0] != NULL && !cgroup->no_warnings) {
+		ruri_warning("{yellow}io.latency is not supported by cgroup v1{clear}\n");
+	}
+}
+static void set_ioprio(const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Fallback of io.weight without cgroup v2 io controller.
+	 * Map the default weight (1-10000, default 100) to the best-effort
+	 * I/O priority (0-7, default 4) of the init process of container,
+	 * every doubling of the weight means a higher priority.
+	 * The priority will be inherited by its children.
+	 */
+	for (int i = 0; container->io_weight[i] != NULL; i++) {
+		if (strncmp(container->io_weight[i], "default ", 8) != 0) {
+			continue;
 		}
-		close(fd);
+		int weight = atoi(container->io_weight[i] + 8);
+		int level = 4;
+		for (int w = 100; w < weight && level > 0; w *= 2) {
+			level--;
+		}
+		for (int w = 100; w / 2 >= weight && level < 7; w /= 2) {
+			level++;
+		}
+		ruri_log("{base}Set ioprio to best-effort level %d\n", level);
+		if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | level) != 0 && !container->no_warnings) {
+			ruri_warning("{yellow}Set ioprio failed{clear}\n");
+		}
+		return;
 	}
-	// Do not keep the apifs mounted.
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
 }
-static void set_cgroup_v2_cpu(const struct RURI_CONTAINER *_Nonnull container)
+static void set_pids_limit(const struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Control file: pids.max, same in cgroup v1 and v2.
+	 */
+	char buf[32] = { '\0' };
+	sprintf(buf, "%d", container->pids_max);
+	set_cgroup_file(cgroup, ruri_cgroup_fd(cgroup, "pids"), "pids.max", buf);
+}
+// Parse hugetlb limit.
+char *ruri_parse_hugetlb_limit(const char *_Nonnull limit)
+{
+	/*
+	 * `2M=1G`, `2MB=1G` or `2048KB=512M` -> `2MB=1G`.
+	 * The hugepage size is converted to the name used in control files,
+	 * it's in GB if >= 1G, or in MB if >= 1M, or in KB.
+	 * Return the malloc()ed string, or NULL if the format is invalid.
+	 */
+	const char *eq = strchr(limit, '=');
+	if (eq == NULL || eq == limit || strlen(eq) > 64) {
+		return NULL;
+	}
+	char size[32] = { '\0' };
+	if ((size_t)(eq - limit) >= sizeof(size)) {
+		return NULL;
+	}
+	memcpy(size, limit, (size_t)(eq - limit));
+	unsigned long long page_size = 0;
+	unsigned long long bytes = 0;
+	if (!ruri_parse_memory_size(size, &page_size) || page_size == ULLONG_MAX || page_size < 1024 || (page_size & (page_size - 1)) != 0) {
+		return NULL;
+	}
+	if (!ruri_parse_memory_size(eq + 1, &bytes)) {
+		return NULL;
+	}
+	char *ret = malloc(strlen(eq) + 32);
+	if (page_size >= (1ULL << 30)) {
+		sprintf(ret, "%lluGB%s", page_size >> 30, eq);
+	} else if (page_size >= (1ULL << 20)) {
+		sprintf(ret, "%lluMB%s", page_size >> 20, eq);
+	} else {
+		sprintf(ret, "%lluKB%s", page_size >> 10, eq);
+	}
+	return ret;
+}
+static void set_hugetlb_limit(const struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Control files:
+	 * cgroup v2: hugetlb.<size>.max
+	 * cgroup v1: hugetlb.<size>.limit_in_bytes
+	 * The limit is in bytes, and rounded down to hugepages by kernel.
+	 */
+	int fd = ruri_cgroup_fd(cgroup, "hugetlb");
+	for (int i = 0; container->hugetlb_max[i] != NULL; i++) {
+		char size[32] = { '\0' };
+		char file[64] = { '\0' };
+		sscanf(container->hugetlb_max[i], "%31[^=]", size);
+		sprintf(file, is_cgroup_v1(cgroup, "hugetlb") ? "hugetlb.%s.limit_in_bytes" : "hugetlb.%s.max", size);
+		if (faccessat(fd, file, F_OK, 0) != 0) {
+			if (!cgroup->no_warnings) {
+				ruri_warning("{yellow}Hugepage size %s is not supported{clear}\n", size);
+			}
+			continue;
+		}
+		set_memory_file(cgroup, fd, file, strchr(container->hugetlb_max[i], '=') + 1, 0);
+	}
+}
+// Apply all limits of the container.
+static bool controller_available(const struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container, const char *_Nonnull controller)
+{
+	/*
+	 * Check if the container has limits of the controller,
+	 * and warn if the controller is not available.
+	 */
+	if (!controller_needed(container, controller)) {
+		return false;
+	}
+	if (ruri_cgroup_fd(cgroup, controller) < 0) {
+		if (!cgroup->no_warnings) {
+			ruri_warning("{yellow}Cgroup %s controller is not available, %s limits are not set{clear}\n", controller, controller);
+		}
+		return false;
+	}
+	return true;
+}
+void ruri_cgroup_apply(const struct RURI_CGROUP *_Nonnull cgroup, const struct RURI_CONTAINER *_Nonnull container)
 {
 	/*
-	 * Mount cgroupv2 cpu controller and set limit.
+	 * Write the limits to control files of the session.
 	 * Nothing to return, only warnings to show if cgroup is not supported.
-	 * Control file: /sys/fs/cgroup/${container_id}/cpu.max
-	 */
-	mkdir("/sys/fs/cgroup", S_IRUSR | S_IWUSR);
-	// Maybe needless.
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-	// Mount /sys/fs/cgroup as cgroup2.
-	mount("none", "/sys/fs/cgroup", "cgroup2", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, NULL);
-	pid_t pid = getpid();
-	char buf[128] = { '\0' };
-	char cgroup_path[PATH_MAX] = { '\0' };
-	sprintf(cgroup_path, "/sys/fs/cgroup/%d", container->container_id);
-	mkdir(cgroup_path, S_IRUSR | S_IWUSR);
-	usleep(200);
-	char cgroup_procs_path[PATH_MAX] = { '\0' };
-	sprintf(cgroup_procs_path, "/sys/fs/cgroup/%d/cgroup.procs", container->container_id);
-	// Add pid to container_id cgroup.
-	int fd = open(cgroup_procs_path, O_RDWR | O_CLOEXEC);
-	if (fd < 0 && !container->no_warnings) {
-		ruri_warning("{yellow}Set cgroup.procs failed{clear}\n");
-		// Do not keep the apifs mounted.
-		umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-		return;
+	 */
+	if (controller_available(cgroup, container, "memory")) {
+		set_memory_limit(cgroup, container);
+	}
+	if (controller_available(cgroup, container, "cpu")) {
+		set_cpu_limit(cgroup, container);
+	}
+	if (controller_available(cgroup, container, "cpuset")) {
+		set_cpuset_limit(cgroup, container);
 	}
+	if (controller_available(cgroup, container, "io")) {
+		set_io_limit(cgroup, container);
+	}
+	if (controller_available(cgroup, container, "pids")) {
+		set_pids_limit(cgroup, container);
+	}
+	if (controller_available(cgroup, container, "hugetlb")) {
+		set_hugetlb_limit(cgroup, container);
+	}
+}
+// Move pid into the cgroup of the session.
+void ruri_cgroup_join(const struct RURI_CGROUP *_Nonnull cgroup, pid_t pid)
+{
+	/*
+	 * Write pid to cgroup.procs once for every hierarchy.
+	 */
+	char buf[32] = { '\0' };
 	sprintf(buf, "%d\n", pid);
-	if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
+	if (cgroup->v2_fd >= 0 && !write_cgroup_file(cgroup->v2_fd, "cgroup.procs", buf) && !cgroup->no_warnings) {
 		ruri_warning("{yellow}Set cgroup.procs failed{clear}\n");
 	}
-	close(fd);
-	if (container->cpupercent > 0) {
-		// Set cpuset limit.
-		char cgroup_cpu_path[PATH_MAX] = { '\0' };
-		sprintf(cgroup_cpu_path, "/sys/fs/cgroup/%d/cpu.max", container->container_id);
-		fd = open(cgroup_cpu_path, O_RDWR | O_CLOEXEC);
-		if (fd < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set cpupercent limit failed{clear}\n");
-			// Do not keep the apifs mounted.
-			umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
-			return;
-		}
-		sprintf(buf, "%d 100000\n", container->cpupercent * 1000);
-		if (write(fd, buf, strlen(buf)) < 0 && !container->no_warnings) {
-			ruri_warning("{yellow}Set cpupercent limit failed{clear}\n");
+	for (int i = 0; i < cgroup->v1_count; i++) {
+		if (!write_cgroup_file(cgroup->v1_fd[i], "cgroup.procs", buf) && !cgroup->no_warnings) {
+			ruri_warning("{yellow}Set cgroup.procs of %s failed{clear}\n", cgroup->v1_controller[i]);
 		}
-		close(fd);
+	}
+}
+// Close the cgroup session.
+void ruri_cgroup_close(struct RURI_CGROUP *_Nullable cgroup)
+{
+	/*
+	 * Close all fds and umount the cgroup filesystems mounted by the session.
+	 */
+	if (cgroup == NULL) {
+		return;
+	}
+	if (cgroup->v2_fd >= 0) {
+		close(cgroup->v2_fd);
+	}
+	for (int i = 0; i < cgroup->v1_count; i++) {
+		close(cgroup->v1_fd[i]);
 	}
 	// Do not keep the apifs mounted.
-	umount2("/sys/fs/cgroup", MNT_DETACH | MNT_FORCE);
+	if (cgroup->mounted) {
+		umount2(cgroup->mountpoint, MNT_DETACH | MNT_FORCE);
+	}
+	free(cgroup);
 }
 void ruri_set_limit(const struct RURI_CONTAINER *_Nonnull container)
 {
@@ -541,23 +1064,348 @@ void ruri_set_limit(const struct RURI_CONTAINER *_Nonnull container)
 	if (!container->unmask_dirs) {
 		umount2("/sys/fs", MNT_DETACH | MNT_FORCE);
 	}
-	if (is_cgroupv2_support("memory")) {
-		set_cgroup_v2_memory(container);
-	} else {
-		set_cgroup_v1_memory(container);
-	}
-	if (is_cgroupv2_support("cpu")) {
-		set_cgroup_v2_cpu(container);
-	} else {
-		set_cgroup_v1_cpu(container);
-	}
-	if (is_cgroupv2_support("cpuset")) {
-		set_cgroup_v2_cpuset(container);
-	} else {
-		set_cgroup_v1_cpuset(container);
+	struct RURI_CGROUP *cgroup = ruri_cgroup_open(container);
+	// Set limits before joining, so that the container is never out of limits.
+	ruri_cgroup_apply(cgroup, container);
+	ruri_cgroup_join(cgroup, getpid());
+	// Without io controller in cgroup v2, io.weight might not work, so set ioprio as fallback.
+	if (container->io_weight[0] != NULL && (cgroup->v2_fd < 0 || !in_list(cgroup->controllers, "io", ' '))) {
+		set_ioprio(container);
 	}
+	ruri_cgroup_close(cgroup);
 	// Mask /sys/fs again.
 	if (!container->unmask_dirs) {
 		mount("tmpfs", "/sys/fs", "tmpfs", MS_RDONLY, NULL);
 	}
 }
+static bool get_cgroup_of_pid(pid_t pid, const char *_Nullable controller, char *_Nonnull buf)
+{
+	/*
+	 * Get the cgroup path of pid from /proc/pid/cgroup.
+	 * If controller is NULL, get the cgroup v2 path (`0::/path`),
+	 * or get the path of cgroup v1 controller (`N:controller,...:/path`).
+	 * Return false if not found.
+	 */
+	char path[PATH_MAX] = { '\0' };
+	sprintf(path, "/proc/%d/cgroup", pid);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	char content[8192] = { '\0' };
+	ssize_t len = read(fd, content, sizeof(content) - 1);
+	close(fd);
+	if (len <= 0) {
+		return false;
+	}
+	content[len] = '\0';
+	char *saveptr = NULL;
+	for (char *line = strtok_r(content, "\n", &saveptr); line != NULL; line = strtok_r(NULL, "\n", &saveptr)) {
+		// Format: hierarchy-ID:controller-list:cgroup-path
+		char *controllers = strchr(line, ':');
+		if (controllers == NULL) {
+			continue;
+		}
+		controllers++;
+		char *cgroup_path = strchr(controllers, ':');
+		if (cgroup_path == NULL) {
+			continue;
+		}
+		*cgroup_path = '\0';
+		cgroup_path++;
+		if (controller == NULL) {
+			if (strncmp(line, "0:", 2) == 0 && controllers[0] == '\0') {
+				strcpy(buf, cgroup_path);
+				return true;
+			}
+			continue;
+		}
+		// The controller list is separated by `,`.
+		char *saveptr2 = NULL;
+		for (char *c = strtok_r(controllers, ",", &saveptr2); c != NULL; c = strtok_r(NULL, ",", &saveptr2)) {
+			if (strcmp(c, controller) == 0) {
+				strcpy(buf, cgroup_path);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+// Open the cgroup directory of the container from the host.
+int ruri_open_cgroup(const struct RURI_CONTAINER *_Nonnull container, const struct RURI_MOUNTINFO *_Nonnull info, const char *_Nullable controller)
+{
+	/*
+	 * ruri_set_limit() creates cgroup ${container_id} in the root of
+	 * the cgroup hierarchy seen by the container.
+	 * For unshare container, that is the root of its cgroup namespace,
+	 * so we get the real path from /proc/${ns_pid}/cgroup.
+	 * If controller is NULL, open the cgroup v2 directory,
+	 * or open the directory in cgroup v1 controller hierarchy.
+	 * Return the fd of the directory, or -1 if not found.
+	 */
+	if (container->container_id < 0) {
+		return -1;
+	}
+	// Find the mountpoint of the hierarchy.
+	const struct RURI_MOUNTINFO_ENTRY *entry = NULL;
+	if (controller == NULL) {
+		entry = ruri_mountinfo_find_fstype(info, "cgroup2");
+	}
+	for (size_t i = 0; controller != NULL && i < info->count; i++) {
+		const struct RURI_MOUNTINFO_ENTRY *e = &info->entries[i];
+		if (strcmp(e->root, "/") == 0 && strcmp(e->fs_type, "cgroup") == 0 && in_list(e->super_options, controller, ',')) {
+			entry = e;
+			break;
+		}
+	}
+	if (entry == NULL) {
+		ruri_log("{base}No cgroup %s hierarchy found\n", controller == NULL ? "v2" : controller);
+		return -1;
+	}
+	char cgroup_path[PATH_MAX] = { '\0' };
+	char path[PATH_MAX] = { '\0' };
+	if (container->ns_pid > 0 && get_cgroup_of_pid(container->ns_pid, controller, cgroup_path)) {
+		sprintf(path, "%s%s", entry->mount_point, cgroup_path);
+	} else {
+		sprintf(path, "%s/%d", entry->mount_point, container->container_id);
+	}
+	// The path of the cgroup must end with ${container_id}.
+	char id[32] = { '\0' };
+	sprintf(id, "/%d", container->container_id);
+	if (strlen(path) < strlen(id) || strcmp(path + strlen(path) - strlen(id), id) != 0) {
+		ruri_log("{base}%s is not the cgroup of container\n", path);
+		return -1;
+	}
+	ruri_log("{base}Cgroup of container: %s\n", path);
+	return open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+void ruri_update_limit(const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Rewrite the control files of a running container in place, for `ruri --update`.
+	 * The cgroup of container is found in the hierarchies mounted on the host,
+	 * like ruri_open_cgroup() does for `ruri -P`.
+	 * Controllers of cgroup v2 can be enabled for the existing cgroup,
+	 * but the container can not be moved into a new cgroup v1 hierarchy.
+	 */
+	struct RURI_MOUNTINFO *info = ruri_read_mountinfo(0);
+	if (info == NULL) {
+		ruri_error("{red}Error: failed to read mountinfo QwQ\n");
+	}
+	struct RURI_CGROUP *cgroup = malloc(sizeof(struct RURI_CGROUP));
+	memset(cgroup, 0, sizeof(struct RURI_CGROUP));
+	cgroup->no_warnings = container->no_warnings;
+	cgroup->v2_fd = ruri_open_cgroup(container, info, NULL);
+	if (cgroup->v2_fd >= 0) {
+		read_cgroup_file(cgroup->v2_fd, "cgroup.controllers", cgroup->controllers, sizeof(cgroup->controllers));
+		int parent_fd = openat(cgroup->v2_fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		char available[256] = { '\0' };
+		if (parent_fd >= 0 && read_cgroup_file(parent_fd, "cgroup.controllers", available, sizeof(available))) {
+			for (size_t i = 0; i < sizeof(cgroup_controllers) / sizeof(cgroup_controllers[0]); i++) {
+				if (controller_needed(container, cgroup_controllers[i]) && !in_list(cgroup->controllers, cgroup_controllers[i], ' ') && in_list(available, cgroup_controllers[i], ' ')) {
+					char buf[32] = { '\0' };
+					sprintf(buf, "+%s", cgroup_controllers[i]);
+					write_cgroup_file(parent_fd, "cgroup.subtree_control", buf);
+				}
+			}
+			read_cgroup_file(cgroup->v2_fd, "cgroup.controllers", cgroup->controllers, sizeof(cgroup->controllers));
+		}
+		if (parent_fd >= 0) {
+			close(parent_fd);
+		}
+	}
+	for (size_t i = 0; i < sizeof(cgroup_controllers) / sizeof(cgroup_controllers[0]); i++) {
+		if (!controller_needed(container, cgroup_controllers[i]) || (cgroup->v2_fd >= 0 && in_list(cgroup->controllers, cgroup_controllers[i], ' '))) {
+			continue;
+		}
+		int fd = ruri_open_cgroup(container, info, cgroup_v1_name(cgroup_controllers[i]));
+		// Warned by ruri_cgroup_apply().
+		if (fd < 0) {
+			continue;
+		}
+		cgroup->v1_controller[cgroup->v1_count] = cgroup_controllers[i];
+		cgroup->v1_fd[cgroup->v1_count] = fd;
+		cgroup->v1_count++;
+	}
+	ruri_free_mountinfo(info);
+	if (cgroup->v2_fd < 0 && cgroup->v1_count == 0) {
+		ruri_error("{red}Error: cgroup of container not found, is the container running? QwQ\n");
+	}
+	ruri_cgroup_apply(cgroup, container);
+	ruri_cgroup_close(cgroup);
+}
+// Read pids in cgroup.procs.
+pid_t *ruri_read_cgroup_procs(int cgroup_fd, size_t *_Nonnull count)
+{
+	/*
+	 * Read cgroup.procs under cgroup_fd.
+	 * Return NULL if failed.
+	 * Warning: free() after use.
+	 */
+	*count = 0;
+	int fd = openat(cgroup_fd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+	size_t bufsize = 4096;
+	size_t used = 0;
+	char *buf = malloc(bufsize + 1);
+	ssize_t len = 0;
+	while ((len = read(fd, buf + used, bufsize - used)) > 0) {
+		used += (size_t)len;
+		if (used == bufsize) {
+			bufsize *= 2;
+			buf = realloc(buf, bufsize + 1);
+		}
+	}
+	close(fd);
+	buf[used] = '\0';
+	// Every pid takes at least 2 bytes.
+	pid_t *ret = malloc(sizeof(pid_t) * (used / 2 + 1));
+	char *p = buf;
+	while (*p != '\0') {
+		char *end = NULL;
+		long pid = strtol(p, &end, 10);
+		if (end == p) {
+			break;
+		}
+		if (pid > 0) {
+			ret[*count] = (pid_t)pid;
+			(*count)++;
+		}
+		p = end;
+		while (*p == '\n') {
+			p++;
+		}
+	}
+	free(buf);
+	return ret;
+}
+// Read a value in control file.
+bool ruri_read_cgroup_value(int cgroup_fd, const char *_Nonnull file, const char *_Nullable key, unsigned long long *_Nonnull value)
+{
+	/*
+	 * If key is NULL, read the single value file like pids.current,
+	 * or read the value of `key value` line in file like pids.events.
+	 * `max` is read as ULLONG_MAX.
+	 * Return false if not found.
+	 */
+	char buf[4096] = { '\0' };
+	if (!read_cgroup_file(cgroup_fd, file, buf, sizeof(buf))) {
+		return false;
+	}
+	char *p = buf;
+	if (key != NULL) {
+		size_t len = strlen(key);
+		p = NULL;
+		char *saveptr = NULL;
+		for (char *line = strtok_r(buf, "\n", &saveptr); line != NULL; line = strtok_r(NULL, "\n", &saveptr)) {
+			if (strncmp(line, key, len) == 0 && line[len] == ' ') {
+				p = line + len + 1;
+				break;
+			}
+		}
+		if (p == NULL) {
+			return false;
+		}
+	}
+	if (strncmp(p, "max", 3) == 0) {
+		*value = ULLONG_MAX;
+		return true;
+	}
+	char *end = NULL;
+	*value = strtoull(p, &end, 10);
+	return end != p;
+}
+static bool kill_cgroup_procs(int cgroup_fd)
+{
+	/*
+	 * Kill all pids in cgroup.procs.
+	 * New processes might be forked while we are killing,
+	 * so we read cgroup.procs again until it's empty.
+	 * Return false if cgroup.procs is not readable.
+	 */
+	for (int i = 0; i < 100; i++) {
+		size_t count = 0;
+		pid_t *pids = ruri_read_cgroup_procs(cgroup_fd, &count);
+		if (pids == NULL) {
+			return false;
+		}
+		for (size_t j = 0; j < count; j++) {
+			ruri_log("{base}Killing pid: {cyan}%d\n", pids[j]);
+			kill(pids[j], SIGKILL);
+		}
+		free(pids);
+		if (count == 0) {
+			return true;
+		}
+		usleep(1000);
+	}
+	return true;
+}
+static void remove_cgroup(int cgroup_fd)
+{
+	/*
+	 * Remove the cgroup directory after all processes exited.
+	 * A cgroup can only be removed when it's empty.
+	 */
+	char path[PATH_MAX] = { '\0' };
+	char fd_path[PATH_MAX] = { '\0' };
+	sprintf(fd_path, "/proc/self/fd/%d", cgroup_fd);
+	ssize_t len = readlink(fd_path, path, PATH_MAX - 1);
+	if (len <= 0) {
+		return;
+	}
+	path[len] = '\0';
+	for (int i = 0; i < 50; i++) {
+		if (rmdir(path) == 0 || errno == ENOENT) {
+			ruri_log("{base}Removed cgroup %s\n", path);
+			return;
+		}
+		usleep(2000);
+	}
+}
+// Kill all processes in the cgroup of container.
+bool ruri_kill_cgroup(const struct RURI_CONTAINER *_Nonnull container, const struct RURI_MOUNTINFO *_Nonnull info)
+{
+	/*
+	 * Kill all processes in container by its cgroup, and remove the cgroup.
+	 * For cgroup v2, we write `1` to cgroup.kill (Linux 5.14+),
+	 * or freeze the cgroup and kill every pid in cgroup.procs.
+	 * For cgroup v1, we kill every pid in cgroup.procs.
+	 * Return false if no cgroup of the container is found,
+	 * so that the caller can fallback to scan /proc.
+	 */
+	bool killed = false;
+	int cgroup_fd = ruri_open_cgroup(container, info, NULL);
+	if (cgroup_fd >= 0) {
+		if (write_cgroup_file(cgroup_fd, "cgroup.kill", "1")) {
+			ruri_log("{base}Killed container by cgroup.kill\n");
+			killed = true;
+		} else {
+			// Freeze the cgroup, so that no new process can be forked.
+			bool frozen = write_cgroup_file(cgroup_fd, "cgroup.freeze", "1");
+			killed = kill_cgroup_procs(cgroup_fd);
+			if (frozen) {
+				write_cgroup_file(cgroup_fd, "cgroup.freeze", "0");
+			}
+		}
+		if (killed) {
+			remove_cgroup(cgroup_fd);
+		}
+		close(cgroup_fd);
+	}
+	// ruri_set_limit() might put the container into any of these v1 controllers.
+	for (size_t i = 0; i < sizeof(cgroup_controllers) / sizeof(cgroup_controllers[0]); i++) {
+		cgroup_fd = ruri_open_cgroup(container, info, cgroup_v1_name(cgroup_controllers[i]));
+		if (cgroup_fd < 0) {
+			continue;
+		}
+		if (kill_cgroup_procs(cgroup_fd)) {
+			killed = true;
+			remove_cgroup(cgroup_fd);
+		}
+		close(cgroup_fd);
+	}
+	return killed;
+}
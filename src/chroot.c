@@ -34,6 +34,9 @@
  * Bisic functions of ruri is implemented here.
  * Thanks docker and podman for the device list and mask/protect list.
  */
+#ifndef PR_SET_MEMORY_MERGE
+#define PR_SET_MEMORY_MERGE 67
+#endif
 static bool su_biany_exist(char *_Nonnull container_dir)
 {
 	/*
@@ -88,6 +91,48 @@ static void check_binary(const struct RURI_CONTAINER *_Nonnull container)
 		}
 	}
 }
+static void mount_hugetlbfs(const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Mount hugetlbfs for every hugepage size in hugetlb_max,
+	 * the first one on container->hugetlbfs (/dev/hugepages by default),
+	 * and others on ${hugetlbfs}-${size}, like /dev/hugepages-1GB.
+	 * The size of hugetlbfs is the hugetlb limit.
+	 * If only hugetlbfs is set, mount it with the default hugepage size.
+	 */
+	const char *path = container->hugetlbfs == NULL ? "/dev/hugepages" : container->hugetlbfs;
+	if (strcmp(path, "none") == 0 || (container->hugetlbfs == NULL && container->hugetlb_max[0] == NULL)) {
+		return;
+	}
+	// If only hugetlbfs is set, mount it once without pagesize.
+	const char *const default_size[] = { NULL, NULL };
+	char *const *limits = container->hugetlb_max[0] == NULL ? (char *const *)default_size : container->hugetlb_max;
+	for (int i = 0; i == 0 || limits[i] != NULL; i++) {
+		char mountpoint[PATH_MAX] = { '\0' };
+		char options[128] = { '\0' };
+		strcpy(options, "mode=1777");
+		strcpy(mountpoint, path);
+		if (limits[i] != NULL) {
+			char size[32] = { '\0' };
+			unsigned long long page_size = 0;
+			unsigned long long bytes = 0;
+			sscanf(limits[i], "%31[^=]", size);
+			ruri_parse_memory_size(size, &page_size);
+			ruri_parse_memory_size(strchr(limits[i], '=') + 1, &bytes);
+			if (i > 0) {
+				snprintf(mountpoint, sizeof(mountpoint), "%s-%s", path, size);
+			}
+			sprintf(options + strlen(options), ",pagesize=%llu", page_size);
+			if (bytes != ULLONG_MAX) {
+				sprintf(options + strlen(options), ",size=%llu", bytes);
+			}
+		}
+		ruri_mkdirs(mountpoint, S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+		if (mount("hugetlbfs", mountpoint, "hugetlbfs", MS_NOSUID | MS_NODEV, options) != 0 && !container->no_warnings) {
+			ruri_warning("{yellow}Warning: failed to mount hugetlbfs on %s with %s: %s{clear}\n", mountpoint, options, strerror(errno));
+		}
+	}
+}
 // Run after chroot(2), called by ruri_run_chroot_container().
 static void init_container(struct RURI_CONTAINER *_Nonnull container)
 {
@@ -127,6 +172,8 @@ static void init_container(struct RURI_CONTAINER *_Nonnull container)
 		mount("tmpfs", "/dev/shm", "tmpfs", MS_NOSUID | MS_NOEXEC | MS_NODEV, devshm_options);
 		usleep(1000);
 		free(devshm_options);
+		// Mount hugetlbfs.
+		mount_hugetlbfs(container);
 		// Mount binfmt_misc.
 		mount("binfmt_misc", "/proc/sys/fs/binfmt_misc", "binfmt_misc", 0, NULL);
 		// Create system runtime files in /dev and then fix permissions.
@@ -255,11 +302,13 @@ static void mount_host_runtime(const struct RURI_CONTAINER *_Nonnull container)
 	mount("/dev/pts", buf, "none", MS_BIND, NULL);
 	// Mount devshm.
 	char *devshm_options = NULL;
-	if (container->memory == NULL) {
+	unsigned long long memory = ULLONG_MAX;
+	if (container->memory == NULL || !ruri_parse_memory_size(container->memory, &memory) || memory == ULLONG_MAX) {
 		devshm_options = strdup("mode=1777");
 	} else {
-		devshm_options = malloc(strlen(container->memory) + strlen("mode=1777") + 114);
-		sprintf(devshm_options, "size=%s,mode=1777", container->memory);
+		// Limit the size of /dev/shm to the memory limit.
+		devshm_options = malloc(strlen("size=,mode=1777") + 32);
+		sprintf(devshm_options, "size=%llu,mode=1777", memory);
 	}
 	memset(buf, '\0', sizeof(buf));
 	sprintf(buf, "%s/dev/shm", container->container_dir);
@@ -701,6 +750,54 @@ static void set_oom_score(int score)
 	write(fd, score_str, strlen(score_str));
 	close(fd);
 }
+static void set_memory_policy(const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Disable transparent hugepages, enable KSM and set NUMA memory policy.
+	 * They are inherited by child processes and kept across execve(2).
+	 * It's called after the cgroup limits are set,
+	 * the nodes should be in cpuset.mems of the container.
+	 */
+	if (container->thp_disable) {
+		// This feature need linux kernel 3.15 or later.
+		if (prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0) != 0 && !container->no_warnings) {
+			ruri_warning("{yellow}Warning: failed to disable transparent hugepages: %s{clear}\n", strerror(errno));
+		}
+	}
+	if (container->ksm) {
+		// This feature need linux kernel 6.4 or later.
+		// For older kernels, only the memory madvise(MADV_MERGEABLE)ed by programs is merged.
+		if (prctl(PR_SET_MEMORY_MERGE, 1, 0, 0, 0) != 0) {
+			if (!container->no_warnings) {
+				ruri_warning("{yellow}Warning: failed to enable KSM for container: %s, it needs linux 6.4 or later{clear}\n", strerror(errno));
+			}
+		} else {
+			char run[8] = { '\0' };
+			int fd = open("/sys/kernel/mm/ksm/run", O_RDONLY | O_CLOEXEC);
+			if (fd >= 0) {
+				read(fd, run, sizeof(run) - 1);
+				close(fd);
+			}
+			if (run[0] != '1' && !container->no_warnings) {
+				ruri_warning("{yellow}Warning: ksmd is not running, pages will not be merged until `echo 1 > /sys/kernel/mm/ksm/run`{clear}\n");
+			}
+		}
+	}
+	if (container->mempolicy == NULL) {
+		return;
+	}
+	int mode = 0;
+	cpu_set_t nodes;
+	if (!ruri_parse_mempolicy(container->mempolicy, &mode, &nodes)) {
+		ruri_warning("{yellow}Warning: invalid memory policy %s{clear}\n", container->mempolicy);
+		return;
+	}
+	// The kernel ignores the last bit of maxnode.
+	bool has_nodes = CPU_COUNT(&nodes) > 0;
+	if (syscall(SYS_set_mempolicy, mode, has_nodes ? (unsigned long *)&nodes : NULL, has_nodes ? CPU_SETSIZE + 1 : 0) != 0 && !container->no_warnings) {
+		ruri_warning("{yellow}Warning: failed to set memory policy %s: %s{clear}\n", container->mempolicy, strerror(errno));
+	}
+}
 // Run chroot container.
 void ruri_run_chroot_container(struct RURI_CONTAINER *_Nonnull container)
 {
@@ -773,6 +870,12 @@ void ruri_run_chroot_container(struct RURI_CONTAINER *_Nonnull container)
 	}
 	// Check binary used.
 	check_binary(container);
+	// Build Seccomp BPF before chroot(2), the cache is on the host.
+	if (container->seccomp_learn != NULL) {
+		ruri_prepare_seccomp_learn(container);
+	} else if (container->enable_default_seccomp || container->seccomp_denied_syscall[0] != NULL || container->seccomp_profile != NULL) {
+		ruri_prepare_seccomp(container);
+	}
 	// chroot(2) into container, or use pivot_root(2) if `-u` is set.
 	if (!container->enable_unshare) {
 		chdir(container->container_dir);
@@ -823,8 +926,16 @@ void ruri_run_chroot_container(struct RURI_CONTAINER *_Nonnull container)
 	if (container->oom_score_adj != 0) {
 		set_oom_score(container->oom_score_adj);
 	}
+	// Set THP, KSM and NUMA memory policy.
+	set_memory_policy(container);
+	// Set scheduling attributes, before the capabilities are dropped.
+	ruri_set_sched(container);
+	// Set resource limits, before the capabilities are dropped.
+	ruri_set_rlimits(container);
 	// Set up Seccomp BPF.
-	if (container->enable_default_seccomp || container->seccomp_denied_syscall[0] != NULL) {
+	if (container->seccomp_learn != NULL) {
+		ruri_setup_seccomp_learn(container);
+	} else if (container->enable_default_seccomp || container->seccomp_denied_syscall[0] != NULL || container->seccomp_profile != NULL) {
 		ruri_setup_seccomp(container);
 	}
 	// Drop caps.
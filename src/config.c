@@ -65,6 +65,11 @@ void ruri_init_config(struct RURI_CONTAINER *_Nonnull container)
 	container->ro_root = false;
 	container->cpuset = NULL;
 	container->memory = NULL;
+	container->memory_high = NULL;
+	container->memory_low = NULL;
+	container->memory_min = NULL;
+	container->memory_swap_max = NULL;
+	container->memory_zswap_max = NULL;
 	container->work_dir = NULL;
 	container->just_chroot = false;
 	container->rootfs_source = NULL;
@@ -72,13 +77,39 @@ void ruri_init_config(struct RURI_CONTAINER *_Nonnull container)
 	container->user = NULL;
 	container->hostname = NULL;
 	container->cpupercent = RURI_INIT_VALUE;
+	container->cpu_max = NULL;
+	container->cpu_burst = RURI_INIT_VALUE;
+	container->cpu_weight = RURI_INIT_VALUE;
+	container->cpu_weight_nice = RURI_INIT_VALUE;
+	container->cpu_idle = RURI_INIT_VALUE;
+	container->io_max[0] = NULL;
+	container->io_weight[0] = NULL;
+	container->io_latency[0] = NULL;
+	container->pids_max = RURI_INIT_VALUE;
+	container->hugetlb_max[0] = NULL;
+	container->hugetlbfs = NULL;
 	container->use_kvm = false;
 	container->char_devs[0] = NULL;
 	container->hidepid = RURI_INIT_VALUE;
 	container->timens_realtime_offset = 0;
 	container->timens_monotonic_offset = 0;
 	container->seccomp_denied_syscall[0] = NULL;
+	container->seccomp_profile = NULL;
+	container->seccomp_spec_allow = false;
+	container->seccomp_learn = NULL;
 	container->oom_score_adj = 0;
+	container->sched_policy = NULL;
+	container->sched_priority = RURI_INIT_VALUE;
+	container->sched_nice = RURI_INIT_VALUE;
+	container->uclamp_min = RURI_INIT_VALUE;
+	container->uclamp_max = RURI_INIT_VALUE;
+	container->cpu_affinity = NULL;
+	container->sched_core = false;
+	container->timer_slack = RURI_INIT_VALUE;
+	container->rlimits[0] = NULL;
+	container->thp_disable = false;
+	container->mempolicy = NULL;
+	container->ksm = false;
 	// Use the time now for container_id.
 	time_t tm = time(NULL);
 	// We need a int value for container_id, so use long%86400.
@@ -189,21 +220,124 @@ char *ruri_container_info_to_k2v(const struct RURI_CONTAINER *_Nonnull container
 	ret = k2v_add_newline(ret);
 	// cpuset.
 	ret = k2v_add_comment(ret, "Cgroup cpuset limit.");
-	ret = k2v_add_comment(ret, "For example, 0-2 or 0 is valid.");
+	ret = k2v_add_comment(ret, "For example, 0-2 or 0 is valid, auto:N picks N CPUs by the CPU topology.");
 	ret = k2v_add_comment(ret, "Set it to empty to disable.");
 	ret = k2v_add_config(char, ret, "cpuset", container->cpuset);
 	ret = k2v_add_newline(ret);
 	// cpupercent.
 	ret = k2v_add_comment(ret, "Cgroup cpu limit.");
-	ret = k2v_add_comment(ret, "The value is in percentage, set it <=0 to disable.");
+	ret = k2v_add_comment(ret, "The value is in percentage, 100 means one core, so 350 is 3.5 cores.");
+	ret = k2v_add_comment(ret, "Set it <=0 to disable.");
 	ret = k2v_add_config(int, ret, "cpupercent", container->cpupercent);
 	ret = k2v_add_newline(ret);
+	// cpu_max.
+	ret = k2v_add_comment(ret, "Cgroup cpu.max limit, \"QUOTA PERIOD\" in microseconds, overrides cpupercent.");
+	ret = k2v_add_comment(ret, "For example, \"350000 100000\" or \"max 100000\" is valid.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char, ret, "cpu_max", container->cpu_max);
+	ret = k2v_add_newline(ret);
+	// cpu_burst.
+	ret = k2v_add_comment(ret, "Cgroup cpu.max.burst limit in microseconds.");
+	ret = k2v_add_comment(ret, "Set it <0 to disable.");
+	ret = k2v_add_config(int, ret, "cpu_burst", container->cpu_burst);
+	ret = k2v_add_newline(ret);
+	// cpu_weight.
+	ret = k2v_add_comment(ret, "Cgroup cpu.weight, range 1-10000, default of the kernel is 100.");
+	ret = k2v_add_comment(ret, "Set it <=0 to disable.");
+	ret = k2v_add_config(int, ret, "cpu_weight", container->cpu_weight);
+	ret = k2v_add_newline(ret);
+	// cpu_weight_nice.
+	ret = k2v_add_comment(ret, "Cgroup cpu.weight.nice, range -20-19, only used if cpu_weight is disabled.");
+	ret = k2v_add_comment(ret, "Set it out of range to disable.");
+	ret = k2v_add_config(int, ret, "cpu_weight_nice", container->cpu_weight_nice);
+	ret = k2v_add_newline(ret);
+	// cpu_idle.
+	ret = k2v_add_comment(ret, "Cgroup cpu.idle, run the container with SCHED_IDLE priority.");
+	ret = k2v_add_comment(ret, "Default is false.");
+	ret = k2v_add_config(bool, ret, "cpu_idle", container->cpu_idle == 1);
+	ret = k2v_add_newline(ret);
 	// memory.
-	ret = k2v_add_comment(ret, "Cgroup memory limit.");
-	ret = k2v_add_comment(ret, "For example, 1G or 1024M is valid.");
+	ret = k2v_add_comment(ret, "Cgroup memory limit (memory.max).");
+	ret = k2v_add_comment(ret, "For example, 1G, 1024M, 50% (of host RAM) or max is valid.");
 	ret = k2v_add_comment(ret, "Set it to empty to disable.");
 	ret = k2v_add_config(char, ret, "memory", container->memory);
 	ret = k2v_add_newline(ret);
+	// memory_high.
+	ret = k2v_add_comment(ret, "Cgroup memory.high, memory usage will be throttled above it.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char, ret, "memory_high", container->memory_high);
+	ret = k2v_add_newline(ret);
+	// memory_low.
+	ret = k2v_add_comment(ret, "Cgroup memory.low and memory.min, memory below them is protected from reclaim.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char, ret, "memory_low", container->memory_low);
+	ret = k2v_add_config(char, ret, "memory_min", container->memory_min);
+	ret = k2v_add_newline(ret);
+	// memory_swap_max.
+	ret = k2v_add_comment(ret, "Cgroup memory.swap.max and memory.zswap.max.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char, ret, "memory_swap_max", container->memory_swap_max);
+	ret = k2v_add_config(char, ret, "memory_zswap_max", container->memory_zswap_max);
+	ret = k2v_add_newline(ret);
+	// io_max.
+	for (int i = 0; true; i++) {
+		if (container->io_max[i] == NULL) {
+			len = i;
+			break;
+		}
+	}
+	ret = k2v_add_comment(ret, "Cgroup io.max limit, one device per item.");
+	ret = k2v_add_comment(ret, "Format: \"DEV:key=value,...\", DEV is a block device, a file on it or MAJ:MIN.");
+	ret = k2v_add_comment(ret, "For example, [\"/dev/sda:rbps=1048576,wiops=120\"] is valid.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char_array, ret, "io_max", container->io_max, len);
+	ret = k2v_add_newline(ret);
+	// io_weight.
+	for (int i = 0; true; i++) {
+		if (container->io_weight[i] == NULL) {
+			len = i;
+			break;
+		}
+	}
+	ret = k2v_add_comment(ret, "Cgroup io.weight limit, range 1-10000.");
+	ret = k2v_add_comment(ret, "For example, [\"200\",\"/dev/sda:500\"] is valid.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char_array, ret, "io_weight", container->io_weight, len);
+	ret = k2v_add_newline(ret);
+	// io_latency.
+	for (int i = 0; true; i++) {
+		if (container->io_latency[i] == NULL) {
+			len = i;
+			break;
+		}
+	}
+	ret = k2v_add_comment(ret, "Cgroup io.latency limit, target is in microseconds.");
+	ret = k2v_add_comment(ret, "For example, [\"/dev/sda:target=10000\"] is valid.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char_array, ret, "io_latency", container->io_latency, len);
+	ret = k2v_add_newline(ret);
+	// pids_max.
+	ret = k2v_add_comment(ret, "Cgroup pids limit, max number of processes.");
+	ret = k2v_add_comment(ret, "Set it <=0 to disable.");
+	ret = k2v_add_config(int, ret, "pids_max", container->pids_max);
+	ret = k2v_add_newline(ret);
+	// hugetlb_max.
+	for (int i = 0; true; i++) {
+		if (container->hugetlb_max[i] == NULL) {
+			len = i;
+			break;
+		}
+	}
+	ret = k2v_add_comment(ret, "Cgroup hugetlb limit, one hugepage size per item.");
+	ret = k2v_add_comment(ret, "For example, [\"2MB=1G\",\"1GB=4G\"] is valid.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char_array, ret, "hugetlb_max", container->hugetlb_max, len);
+	ret = k2v_add_newline(ret);
+	// hugetlbfs.
+	ret = k2v_add_comment(ret, "Mountpoint of hugetlbfs in container.");
+	ret = k2v_add_comment(ret, "Default is /dev/hugepages if hugetlb_max is set, set it to \"none\" to disable.");
+	ret = k2v_add_config(char, ret, "hugetlbfs", container->hugetlbfs);
+	ret = k2v_add_newline(ret);
 	// just_chroot.
 	ret = k2v_add_comment(ret, "Just chroot, do not create runtime dirs.");
 	ret = k2v_add_comment(ret, "Default is false.");
@@ -253,6 +387,61 @@ char *ruri_container_info_to_k2v(const struct RURI_CONTAINER *_Nonnull container
 	ret = k2v_add_comment(ret, "Set it to 0 to disable.");
 	ret = k2v_add_config(int, ret, "oom_score_adj", container->oom_score_adj);
 	ret = k2v_add_newline(ret);
+	// Scheduling attributes.
+	ret = k2v_add_comment(ret, "Scheduling policy, other/batch/idle/fifo/rr.");
+	ret = k2v_add_comment(ret, "sched_priority is for fifo and rr, in range 1-99.");
+	ret = k2v_add_comment(ret, "Set them to empty and -114 to disable.");
+	ret = k2v_add_config(char, ret, "sched_policy", container->sched_policy);
+	ret = k2v_add_config(int, ret, "sched_priority", container->sched_priority);
+	ret = k2v_add_newline(ret);
+	ret = k2v_add_comment(ret, "Nice value, in range -20-19.");
+	ret = k2v_add_comment(ret, "Set it to -114 to disable.");
+	ret = k2v_add_config(int, ret, "sched_nice", container->sched_nice);
+	ret = k2v_add_newline(ret);
+	ret = k2v_add_comment(ret, "Utilization clamp, in range 0-1024.");
+	ret = k2v_add_comment(ret, "Set them to -114 to disable.");
+	ret = k2v_add_config(int, ret, "uclamp_min", container->uclamp_min);
+	ret = k2v_add_config(int, ret, "uclamp_max", container->uclamp_max);
+	ret = k2v_add_newline(ret);
+	ret = k2v_add_comment(ret, "CPU affinity, works without cpuset cgroup.");
+	ret = k2v_add_comment(ret, "For example, \"0-3,6\" is valid.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char, ret, "cpu_affinity", container->cpu_affinity);
+	ret = k2v_add_newline(ret);
+	ret = k2v_add_comment(ret, "Use a new core scheduling cookie,");
+	ret = k2v_add_comment(ret, "so that container never shares SMT siblings with other processes.");
+	ret = k2v_add_config(bool, ret, "sched_core", container->sched_core);
+	ret = k2v_add_newline(ret);
+	ret = k2v_add_comment(ret, "Timer slack in nanoseconds.");
+	ret = k2v_add_comment(ret, "Set it to -114 to disable.");
+	ret = k2v_add_config(int, ret, "timer_slack", container->timer_slack);
+	ret = k2v_add_newline(ret);
+	// Memory policy.
+	ret = k2v_add_comment(ret, "Disable transparent hugepages.");
+	ret = k2v_add_comment(ret, "Default is false.");
+	ret = k2v_add_config(bool, ret, "thp_disable", container->thp_disable);
+	ret = k2v_add_newline(ret);
+	ret = k2v_add_comment(ret, "NUMA memory policy, interleave/bind/preferred/local/default.");
+	ret = k2v_add_comment(ret, "For example, \"interleave:0-1\" and \"bind:0\" are valid.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char, ret, "mempolicy", container->mempolicy);
+	ret = k2v_add_newline(ret);
+	ret = k2v_add_comment(ret, "Merge identical anonymous pages of container with KSM.");
+	ret = k2v_add_comment(ret, "Default is false.");
+	ret = k2v_add_config(bool, ret, "ksm", container->ksm);
+	ret = k2v_add_newline(ret);
+	// rlimits.
+	for (int i = 0; true; i++) {
+		if (container->rlimits[i] == NULL) {
+			len = i;
+			break;
+		}
+	}
+	ret = k2v_add_comment(ret, "Resource limits, NAME=SOFT:HARD, one resource per item.");
+	ret = k2v_add_comment(ret, "For example, [\"NOFILE=65536:65536\",\"MEMLOCK=unlimited:unlimited\"] is valid.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char_array, ret, "rlimits", container->rlimits, len);
+	ret = k2v_add_newline(ret);
 	// extra_mountpoint.
 	for (int i = 0; true; i++) {
 		if (container->extra_mountpoint[i] == NULL) {
@@ -342,6 +531,17 @@ char *ruri_container_info_to_k2v(const struct RURI_CONTAINER *_Nonnull container
 	ret = k2v_add_comment(ret, "Set it to empty to disable.");
 	ret = k2v_add_config(char_array, ret, "deny_syscall", container->seccomp_denied_syscall, len);
 	ret = k2v_add_newline(ret);
+	// seccomp_profile.
+	ret = k2v_add_comment(ret, "Allowlist seccomp profile, replaces the built-in profile.");
+	ret = k2v_add_comment(ret, "One syscall per line, with optional argument conditions like `arg0&0x10000==0`.");
+	ret = k2v_add_comment(ret, "Set it to empty to disable.");
+	ret = k2v_add_config(char, ret, "seccomp_profile", container->seccomp_profile);
+	ret = k2v_add_newline(ret);
+	// seccomp_spec_allow.
+	ret = k2v_add_comment(ret, "Do not force speculative store bypass mitigation for seccomp.");
+	ret = k2v_add_comment(ret, "Default is false.");
+	ret = k2v_add_config(bool, ret, "seccomp_spec_allow", container->seccomp_spec_allow);
+	ret = k2v_add_newline(ret);
 	// masked_path.
 	for (int i = 0; true; i++) {
 		if (container->masked_path[i] == NULL) {
@@ -364,6 +564,59 @@ char *ruri_container_info_to_k2v(const struct RURI_CONTAINER *_Nonnull container
 	ret = k2v_add_config(bool, ret, "skip_setgroups", container->skip_setgroups);
 	return ret;
 }
+static void read_hugetlb_limits(char *_Nonnull list[], const char *_Nonnull buf)
+{
+	/*
+	 * Read hugetlb limits and convert the hugepage sizes to the names in control files.
+	 */
+	int len = 0;
+	if (have_key("hugetlb_max", buf)) {
+		len = k2v_get_key(char_array, "hugetlb_max", buf, list, RURI_MAX_HUGETLB_SIZES);
+	}
+	list[len] = NULL;
+	for (int i = 0; i < len; i++) {
+		char *limit = ruri_parse_hugetlb_limit(list[i]);
+		if (limit == NULL) {
+			ruri_error("{red}Error: invalid hugetlb limit %s, should be like `2MB=1G`\n", list[i]);
+		}
+		free(list[i]);
+		list[i] = limit;
+	}
+}
+static void read_rlimits(char *_Nonnull list[], const char *_Nonnull buf)
+{
+	/*
+	 * Read rlimits and normalize them.
+	 */
+	char *raw[RURI_MAX_RLIMITS + 1] = { NULL };
+	int len = 0;
+	if (have_key("rlimits", buf)) {
+		len = k2v_get_key(char_array, "rlimits", buf, raw, RURI_MAX_RLIMITS);
+	}
+	list[0] = NULL;
+	for (int i = 0; i < len; i++) {
+		if (!ruri_add_rlimit(list, raw[i])) {
+			ruri_error("{red}Error: invalid rlimit %s, should be like `NOFILE=1024:65536`\n", raw[i]);
+		}
+		free(raw[i]);
+	}
+}
+static void read_io_limits(char *_Nonnull list[], const char *_Nonnull key, const char *_Nonnull buf, bool weight)
+{
+	/*
+	 * Read I/O limits and convert them to the format of control files.
+	 */
+	int len = 0;
+	if (have_key(key, buf)) {
+		len = k2v_get_key(char_array, key, buf, list, RURI_MAX_IO_DEVS);
+	}
+	list[len] = NULL;
+	for (int i = 0; i < len; i++) {
+		char *limit = ruri_parse_io_limit(list[i], weight);
+		free(list[i]);
+		list[i] = limit;
+	}
+}
 void ruri_read_config(struct RURI_CONTAINER *_Nonnull container, const char *_Nonnull path)
 {
 	/*
@@ -434,8 +687,37 @@ void ruri_read_config(struct RURI_CONTAINER *_Nonnull container, const char *_No
 	container->cpuset = k2v_get_key(char, "cpuset", buf);
 	// Get memory.
 	container->memory = k2v_get_key(char, "memory", buf);
+	// Get other memory limits.
+	container->memory_high = k2v_get_key(char, "memory_high", buf);
+	container->memory_low = k2v_get_key(char, "memory_low", buf);
+	container->memory_min = k2v_get_key(char, "memory_min", buf);
+	container->memory_swap_max = k2v_get_key(char, "memory_swap_max", buf);
+	container->memory_zswap_max = k2v_get_key(char, "memory_zswap_max", buf);
 	// Get cpupercent.
 	container->cpupercent = k2v_get_key(int, "cpupercent", buf);
+	// Get other cpu limits.
+	container->cpu_max = k2v_get_key(char, "cpu_max", buf);
+	if (have_key("cpu_burst", buf)) {
+		container->cpu_burst = k2v_get_key(int, "cpu_burst", buf);
+	}
+	if (have_key("cpu_weight", buf)) {
+		container->cpu_weight = k2v_get_key(int, "cpu_weight", buf);
+	}
+	if (have_key("cpu_weight_nice", buf)) {
+		container->cpu_weight_nice = k2v_get_key(int, "cpu_weight_nice", buf);
+	}
+	container->cpu_idle = k2v_get_key(bool, "cpu_idle", buf) ? 1 : RURI_INIT_VALUE;
+	// Get I/O limits.
+	read_io_limits(container->io_max, "io_max", buf, false);
+	read_io_limits(container->io_weight, "io_weight", buf, true);
+	read_io_limits(container->io_latency, "io_latency", buf, false);
+	// Get pids_max.
+	if (have_key("pids_max", buf)) {
+		container->pids_max = k2v_get_key(int, "pids_max", buf);
+	}
+	// Get hugetlb_max and hugetlbfs.
+	read_hugetlb_limits(container->hugetlb_max, buf);
+	container->hugetlbfs = k2v_get_key(char, "hugetlbfs", buf);
 	// Get just_chroot.
 	container->just_chroot = k2v_get_key(bool, "just_chroot", buf);
 	// Get work_dir.
@@ -454,6 +736,23 @@ void ruri_read_config(struct RURI_CONTAINER *_Nonnull container, const char *_No
 	container->hidepid = k2v_get_key(int, "hidepid", buf);
 	// Get oom_score_adj.
 	container->oom_score_adj = k2v_get_key(int, "oom_score_adj", buf);
+	// Get scheduling attributes.
+	container->sched_policy = k2v_get_key(char, "sched_policy", buf);
+	const char *sched_keys[] = { "sched_priority", "sched_nice", "uclamp_min", "uclamp_max", "timer_slack" };
+	int *sched_values[] = { &container->sched_priority, &container->sched_nice, &container->uclamp_min, &container->uclamp_max, &container->timer_slack };
+	for (int i = 0; i < 5; i++) {
+		if (have_key(sched_keys[i], buf)) {
+			*sched_values[i] = k2v_get_key(int, sched_keys[i], buf);
+		}
+	}
+	container->cpu_affinity = k2v_get_key(char, "cpu_affinity", buf);
+	container->sched_core = k2v_get_key(bool, "sched_core", buf);
+	// Get rlimits.
+	read_rlimits(container->rlimits, buf);
+	// Get thp_disable and mempolicy.
+	container->thp_disable = k2v_get_key(bool, "thp_disable", buf);
+	container->mempolicy = k2v_get_key(char, "mempolicy", buf);
+	container->ksm = k2v_get_key(bool, "ksm", buf);
 	// Get skip_setgroups.
 	container->skip_setgroups = k2v_get_key(bool, "skip_setgroups", buf);
 	// Get user.
@@ -490,6 +789,9 @@ void ruri_read_config(struct RURI_CONTAINER *_Nonnull container, const char *_No
 	// Get seccomp_denied_syscall.
 	int seccomplen = k2v_get_key(char_array, "deny_syscall", buf, container->seccomp_denied_syscall, RURI_MAX_SECCOMP_DENIED_SYSCALL);
 	container->seccomp_denied_syscall[seccomplen] = NULL;
+	// Get seccomp_profile and seccomp_spec_allow.
+	container->seccomp_profile = k2v_get_key(char, "seccomp_profile", buf);
+	container->seccomp_spec_allow = k2v_get_key(bool, "seccomp_spec_allow", buf);
 	// Get time offset.
 	container->timens_realtime_offset = k2v_get_key(long, "timens_realtime_offset", buf);
 	container->timens_monotonic_offset = k2v_get_key(long, "timens_monotonic_offset", buf);
@@ -627,6 +929,18 @@ void ruri_correct_config(const char *_Nonnull path)
 	} else {
 		container.enable_default_seccomp = k2v_get_key(bool, "enable_seccomp", buf);
 	}
+	if (!have_key("seccomp_profile", buf)) {
+		ruri_warning("{green}No key seccomp_profile found, set to NULL\n{clear}");
+		container.seccomp_profile = NULL;
+	} else {
+		container.seccomp_profile = k2v_get_key(char, "seccomp_profile", buf);
+	}
+	if (!have_key("seccomp_spec_allow", buf)) {
+		ruri_warning("{green}No key seccomp_spec_allow found, set to false\n{clear}");
+		container.seccomp_spec_allow = false;
+	} else {
+		container.seccomp_spec_allow = k2v_get_key(bool, "seccomp_spec_allow", buf);
+	}
 	if (!have_key("no_warnings", buf)) {
 		ruri_warning("{green}No key no_warnings found, set to false\n{clear}");
 		container.no_warnings = false;
@@ -690,12 +1004,88 @@ void ruri_correct_config(const char *_Nonnull path)
 	} else {
 		container.memory = k2v_get_key(char, "memory", buf);
 	}
+	if (!have_key("memory_high", buf)) {
+		ruri_warning("{green}No key memory_high found, set to NULL\n{clear}");
+		container.memory_high = NULL;
+	} else {
+		container.memory_high = k2v_get_key(char, "memory_high", buf);
+	}
+	if (!have_key("memory_low", buf)) {
+		ruri_warning("{green}No key memory_low found, set to NULL\n{clear}");
+		container.memory_low = NULL;
+	} else {
+		container.memory_low = k2v_get_key(char, "memory_low", buf);
+	}
+	if (!have_key("memory_min", buf)) {
+		ruri_warning("{green}No key memory_min found, set to NULL\n{clear}");
+		container.memory_min = NULL;
+	} else {
+		container.memory_min = k2v_get_key(char, "memory_min", buf);
+	}
+	if (!have_key("memory_swap_max", buf)) {
+		ruri_warning("{green}No key memory_swap_max found, set to NULL\n{clear}");
+		container.memory_swap_max = NULL;
+	} else {
+		container.memory_swap_max = k2v_get_key(char, "memory_swap_max", buf);
+	}
+	if (!have_key("memory_zswap_max", buf)) {
+		ruri_warning("{green}No key memory_zswap_max found, set to NULL\n{clear}");
+		container.memory_zswap_max = NULL;
+	} else {
+		container.memory_zswap_max = k2v_get_key(char, "memory_zswap_max", buf);
+	}
 	if (!have_key("cpupercent", buf)) {
 		ruri_warning("{green}No key cpupercent found, set to -114\n{clear}");
 		container.cpupercent = RURI_INIT_VALUE;
 	} else {
 		container.cpupercent = k2v_get_key(int, "cpupercent", buf);
 	}
+	if (!have_key("cpu_max", buf)) {
+		ruri_warning("{green}No key cpu_max found, set to NULL\n{clear}");
+		container.cpu_max = NULL;
+	} else {
+		container.cpu_max = k2v_get_key(char, "cpu_max", buf);
+	}
+	if (!have_key("cpu_burst", buf)) {
+		ruri_warning("{green}No key cpu_burst found, set to -114\n{clear}");
+		container.cpu_burst = RURI_INIT_VALUE;
+	} else {
+		container.cpu_burst = k2v_get_key(int, "cpu_burst", buf);
+	}
+	if (!have_key("cpu_weight", buf)) {
+		ruri_warning("{green}No key cpu_weight found, set to -114\n{clear}");
+		container.cpu_weight = RURI_INIT_VALUE;
+	} else {
+		container.cpu_weight = k2v_get_key(int, "cpu_weight", buf);
+	}
+	if (!have_key("cpu_weight_nice", buf)) {
+		ruri_warning("{green}No key cpu_weight_nice found, set to -114\n{clear}");
+		container.cpu_weight_nice = RURI_INIT_VALUE;
+	} else {
+		container.cpu_weight_nice = k2v_get_key(int, "cpu_weight_nice", buf);
+	}
+	if (!have_key("cpu_idle", buf)) {
+		ruri_warning("{green}No key cpu_idle found, set to false\n{clear}");
+		container.cpu_idle = RURI_INIT_VALUE;
+	} else {
+		container.cpu_idle = k2v_get_key(bool, "cpu_idle", buf) ? 1 : RURI_INIT_VALUE;
+	}
+	read_io_limits(container.io_max, "io_max", buf, false);
+	read_io_limits(container.io_weight, "io_weight", buf, true);
+	read_io_limits(container.io_latency, "io_latency", buf, false);
+	if (!have_key("pids_max", buf)) {
+		ruri_warning("{green}No key pids_max found, set to -114\n{clear}");
+		container.pids_max = RURI_INIT_VALUE;
+	} else {
+		container.pids_max = k2v_get_key(int, "pids_max", buf);
+	}
+	read_hugetlb_limits(container.hugetlb_max, buf);
+	if (!have_key("hugetlbfs", buf)) {
+		ruri_warning("{green}No key hugetlbfs found, set to NULL\n{clear}");
+		container.hugetlbfs = NULL;
+	} else {
+		container.hugetlbfs = k2v_get_key(char, "hugetlbfs", buf);
+	}
 	if (!have_key("just_chroot", buf)) {
 		ruri_warning("{green}No key just_chroot found, set to false\n{clear}");
 		container.just_chroot = false;
@@ -759,6 +1149,53 @@ void ruri_correct_config(const char *_Nonnull path)
 	} else {
 		container.oom_score_adj = k2v_get_key(int, "oom_score_adj", buf);
 	}
+	if (!have_key("sched_policy", buf)) {
+		ruri_warning("{green}No key sched_policy found, set to NULL\n{clear}");
+		container.sched_policy = NULL;
+	} else {
+		container.sched_policy = k2v_get_key(char, "sched_policy", buf);
+	}
+	const char *sched_keys[] = { "sched_priority", "sched_nice", "uclamp_min", "uclamp_max", "timer_slack" };
+	int *sched_values[] = { &container.sched_priority, &container.sched_nice, &container.uclamp_min, &container.uclamp_max, &container.timer_slack };
+	for (int i = 0; i < 5; i++) {
+		if (!have_key(sched_keys[i], buf)) {
+			ruri_warning("{green}No key %s found, set to -114\n{clear}", sched_keys[i]);
+			*sched_values[i] = RURI_INIT_VALUE;
+		} else {
+			*sched_values[i] = k2v_get_key(int, sched_keys[i], buf);
+		}
+	}
+	if (!have_key("cpu_affinity", buf)) {
+		ruri_warning("{green}No key cpu_affinity found, set to NULL\n{clear}");
+		container.cpu_affinity = NULL;
+	} else {
+		container.cpu_affinity = k2v_get_key(char, "cpu_affinity", buf);
+	}
+	if (!have_key("sched_core", buf)) {
+		ruri_warning("{green}No key sched_core found, set to false\n{clear}");
+		container.sched_core = false;
+	} else {
+		container.sched_core = k2v_get_key(bool, "sched_core", buf);
+	}
+	read_rlimits(container.rlimits, buf);
+	if (!have_key("thp_disable", buf)) {
+		ruri_warning("{green}No key thp_disable found, set to false\n{clear}");
+		container.thp_disable = false;
+	} else {
+		container.thp_disable = k2v_get_key(bool, "thp_disable", buf);
+	}
+	if (!have_key("mempolicy", buf)) {
+		ruri_warning("{green}No key mempolicy found, set to NULL\n{clear}");
+		container.mempolicy = NULL;
+	} else {
+		container.mempolicy = k2v_get_key(char, "mempolicy", buf);
+	}
+	if (!have_key("ksm", buf)) {
+		ruri_warning("{green}No key ksm found, set to false\n{clear}");
+		container.ksm = false;
+	} else {
+		container.ksm = k2v_get_key(bool, "ksm", buf);
+	}
 	free(buf);
 	unlink(path);
 	remove(path);
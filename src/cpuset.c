@@ -0,0 +1,478 @@
+// SPDX-License-Identifier: MIT
+/*
+ *
+ * This file is part of ruri, with ABSOLUTELY NO WARRANTY.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022-2024 Moe-hacker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+#include "include/ruri.h"
+/*
+ * This file provides the CPU topology support for cpuset limit.
+ * It reads /sys/devices/system/cpu and /sys/devices/system/node
+ * to pick CPUs for `-l cpuset=auto:N` and to get cpuset.mems of CPUs.
+ */
+struct CPU_TOPOLOGY {
+	// NUMA node of each CPU.
+	int node[CPU_SETSIZE];
+	// First CPU in the last level cache of each CPU.
+	int llc[CPU_SETSIZE];
+	// First CPU in the SMT siblings of each CPU.
+	int core[CPU_SETSIZE];
+	// Max NUMA node id.
+	int max_node;
+};
+static bool read_sys_file(const char *_Nonnull path, char *_Nonnull buf, size_t size)
+{
+	/*
+	 * Read a file in sysfs into buf, without the last `\n`.
+	 */
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	ssize_t len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0) {
+		return false;
+	}
+	buf[len] = '\0';
+	if (len > 0 && buf[len - 1] == '\n') {
+		buf[len - 1] = '\0';
+	}
+	return true;
+}
+bool ruri_parse_cpu_list(const char *_Nonnull list, cpu_set_t *_Nonnull set)
+{
+	/*
+	 * Parse cpu list like `0-3,5` into set.
+	 * Return false if the format is invalid.
+	 */
+	CPU_ZERO(set);
+	const char *p = list;
+	while (*p != '\0' && *p != '\n') {
+		char *end = NULL;
+		long start = strtol(p, &end, 10);
+		if (end == p || start < 0 || start >= CPU_SETSIZE) {
+			return false;
+		}
+		long stop = start;
+		p = end;
+		if (*p == '-') {
+			p++;
+			stop = strtol(p, &end, 10);
+			if (end == p || stop < start || stop >= CPU_SETSIZE) {
+				return false;
+			}
+			p = end;
+		}
+		for (long i = start; i <= stop; i++) {
+			CPU_SET((size_t)i, set);
+		}
+		if (*p == ',') {
+			p++;
+		} else if (*p != '\0' && *p != '\n') {
+			return false;
+		}
+	}
+	return true;
+}
+void ruri_format_cpu_list(const cpu_set_t *_Nonnull set, char *_Nonnull buf, size_t size)
+{
+	/*
+	 * Format set into cpu list like `0-3,5`.
+	 */
+	buf[0] = '\0';
+	size_t len = 0;
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (!CPU_ISSET((size_t)i, set)) {
+			continue;
+		}
+		int j = i;
+		while (j + 1 < CPU_SETSIZE && CPU_ISSET((size_t)(j + 1), set)) {
+			j++;
+		}
+		int n = 0;
+		if (j == i) {
+			n = snprintf(buf + len, size - len, "%s%d", len == 0 ? "" : ",", i);
+		} else {
+			n = snprintf(buf + len, size - len, "%s%d-%d", len == 0 ? "" : ",", i, j);
+		}
+		if (n < 0 || (size_t)n >= size - len) {
+			break;
+		}
+		len += (size_t)n;
+		i = j;
+	}
+}
+static int first_cpu_in_file(const char *_Nonnull path, int def)
+{
+	/*
+	 * Return the first CPU in the cpu list file,
+	 * or def if failed.
+	 */
+	char buf[4096] = { '\0' };
+	cpu_set_t set;
+	if (!read_sys_file(path, buf, sizeof(buf)) || !ruri_parse_cpu_list(buf, &set)) {
+		return def;
+	}
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (CPU_ISSET((size_t)i, &set)) {
+			return i;
+		}
+	}
+	return def;
+}
+static void read_cpu_topology(struct CPU_TOPOLOGY *_Nonnull topo, const cpu_set_t *_Nonnull cpus)
+{
+	/*
+	 * Get NUMA node, LLC and SMT siblings of CPUs in cpus.
+	 * If the info is not available, every CPU is a core and LLC of its own on node 0.
+	 */
+	char path[PATH_MAX] = { '\0' };
+	char buf[4096] = { '\0' };
+	topo->max_node = 0;
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		topo->node[i] = 0;
+		topo->llc[i] = i;
+		topo->core[i] = i;
+	}
+	// NUMA nodes.
+	DIR *dir = opendir("/sys/devices/system/node");
+	if (dir != NULL) {
+		struct dirent *entry = NULL;
+		while ((entry = readdir(dir)) != NULL) {
+			int node = 0;
+			char tail = '\0';
+			if (sscanf(entry->d_name, "node%d%c", &node, &tail) != 1 || node < 0) {
+				continue;
+			}
+			cpu_set_t set;
+			sprintf(path, "/sys/devices/system/node/%s/cpulist", entry->d_name);
+			if (!read_sys_file(path, buf, sizeof(buf)) || !ruri_parse_cpu_list(buf, &set)) {
+				continue;
+			}
+			for (int i = 0; i < CPU_SETSIZE; i++) {
+				if (CPU_ISSET((size_t)i, &set)) {
+					topo->node[i] = node;
+				}
+			}
+			if (node > topo->max_node) {
+				topo->max_node = node;
+			}
+		}
+		closedir(dir);
+	}
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (!CPU_ISSET((size_t)i, cpus)) {
+			continue;
+		}
+		// SMT siblings.
+		sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", i);
+		topo->core[i] = first_cpu_in_file(path, i);
+		// The cache with the highest level is the LLC.
+		int max_level = 0;
+		for (int j = 0; true; j++) {
+			sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/level", i, j);
+			if (!read_sys_file(path, buf, sizeof(buf))) {
+				break;
+			}
+			int level = atoi(buf);
+			if (level > max_level) {
+				max_level = level;
+				sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", i, j);
+				topo->llc[i] = first_cpu_in_file(path, i);
+			}
+		}
+	}
+}
+static int pick_cpus(const cpu_set_t *_Nonnull candidates, const struct CPU_TOPOLOGY *_Nonnull topo, int count, cpu_set_t *_Nonnull picked)
+{
+	/*
+	 * Pick at most count CPUs from candidates into picked.
+	 * Whole cores are picked first, so the container will not share
+	 * a core with others through SMT, and then the rest of CPUs.
+	 * Return the number of CPUs picked.
+	 */
+	int ret = 0;
+	for (int i = 0; i < CPU_SETSIZE && ret < count; i++) {
+		if (!CPU_ISSET((size_t)i, candidates) || CPU_ISSET((size_t)i, picked) || topo->core[i] != i) {
+			continue;
+		}
+		int siblings = 0;
+		bool whole = true;
+		for (int j = 0; j < CPU_SETSIZE; j++) {
+			if (topo->core[j] == i && CPU_ISSET((size_t)j, candidates)) {
+				siblings++;
+			} else if (topo->core[j] == i && j != i) {
+				whole = false;
+			}
+		}
+		if (!whole || siblings > count - ret) {
+			continue;
+		}
+		for (int j = 0; j < CPU_SETSIZE; j++) {
+			if (topo->core[j] == i && CPU_ISSET((size_t)j, candidates)) {
+				CPU_SET((size_t)j, picked);
+				ret++;
+			}
+		}
+	}
+	for (int i = 0; i < CPU_SETSIZE && ret < count; i++) {
+		if (CPU_ISSET((size_t)i, candidates) && !CPU_ISSET((size_t)i, picked)) {
+			CPU_SET((size_t)i, picked);
+			ret++;
+		}
+	}
+	return ret;
+}
+static void node_cpus(const cpu_set_t *_Nonnull cpus, const struct CPU_TOPOLOGY *_Nonnull topo, int node, cpu_set_t *_Nonnull ret)
+{
+	/*
+	 * Get CPUs in cpus on the node.
+	 */
+	CPU_ZERO(ret);
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (CPU_ISSET((size_t)i, cpus) && topo->node[i] == node) {
+			CPU_SET((size_t)i, ret);
+		}
+	}
+}
+static bool pick_in_llc(const cpu_set_t *_Nonnull free_cpus, const struct CPU_TOPOLOGY *_Nonnull topo, int count, cpu_set_t *_Nonnull picked)
+{
+	/*
+	 * Pick count CPUs sharing one LLC from free_cpus.
+	 * The LLC with the least free CPUs that is enough is used,
+	 * to keep bigger LLCs for bigger containers.
+	 */
+	int best = -1;
+	int best_free = 0;
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (!CPU_ISSET((size_t)i, free_cpus)) {
+			continue;
+		}
+		int n = 0;
+		for (int j = 0; j < CPU_SETSIZE; j++) {
+			if (CPU_ISSET((size_t)j, free_cpus) && topo->llc[j] == topo->llc[i]) {
+				n++;
+			}
+		}
+		if (n >= count && (best < 0 || n < best_free)) {
+			best = topo->llc[i];
+			best_free = n;
+		}
+	}
+	if (best < 0) {
+		return false;
+	}
+	cpu_set_t candidates;
+	CPU_ZERO(&candidates);
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (CPU_ISSET((size_t)i, free_cpus) && topo->llc[i] == best) {
+			CPU_SET((size_t)i, &candidates);
+		}
+	}
+	CPU_ZERO(picked);
+	pick_cpus(&candidates, topo, count, picked);
+	return true;
+}
+char *ruri_auto_cpuset(int count, const cpu_set_t *_Nonnull used)
+{
+	/*
+	 * Pick count CPUs for `-l cpuset=auto:N`.
+	 * used is the CPUs already assigned to other containers.
+	 * The CPUs are picked from the least loaded NUMA node,
+	 * the load of node is the ratio of CPUs used by other containers,
+	 * and we try to pick CPUs sharing one LLC, and whole cores first.
+	 * Return the malloc()ed cpu list, or NULL if failed.
+	 */
+	cpu_set_t avail;
+	char buf[4096] = { '\0' };
+	// Only CPUs that are online and allowed for us.
+	if (sched_getaffinity(0, sizeof(avail), &avail) != 0) {
+		return NULL;
+	}
+	cpu_set_t online;
+	if (read_sys_file("/sys/devices/system/cpu/online", buf, sizeof(buf)) && ruri_parse_cpu_list(buf, &online)) {
+		CPU_AND(&avail, &avail, &online);
+	}
+	if (CPU_COUNT(&avail) == 0) {
+		return NULL;
+	}
+	cpu_set_t free_cpus;
+	CPU_ZERO(&free_cpus);
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (CPU_ISSET((size_t)i, &avail) && !CPU_ISSET((size_t)i, used)) {
+			CPU_SET((size_t)i, &free_cpus);
+		}
+	}
+	if (CPU_COUNT(&free_cpus) < count && CPU_COUNT(&avail) >= count) {
+		ruri_warning("{yellow}Warning: only %d CPUs are not used by other containers, CPUs will be shared\n", CPU_COUNT(&free_cpus));
+		free_cpus = avail;
+	}
+	if (CPU_COUNT(&avail) < count) {
+		ruri_warning("{yellow}Warning: only %d CPUs are available, but %d CPUs are required\n", CPU_COUNT(&avail), count);
+		count = CPU_COUNT(&avail);
+		free_cpus = avail;
+	}
+	struct CPU_TOPOLOGY *topo = malloc(sizeof(struct CPU_TOPOLOGY));
+	read_cpu_topology(topo, &avail);
+	// Sort nodes by load, and then by id.
+	int nodes[topo->max_node + 1];
+	double load[topo->max_node + 1];
+	int node_count = 0;
+	for (int node = 0; node <= topo->max_node; node++) {
+		cpu_set_t all;
+		cpu_set_t busy;
+		node_cpus(&avail, topo, node, &all);
+		if (CPU_COUNT(&all) == 0) {
+			continue;
+		}
+		CPU_AND(&busy, &all, used);
+		double node_load = (double)CPU_COUNT(&busy) / CPU_COUNT(&all);
+		int j = node_count;
+		while (j > 0 && load[j - 1] > node_load) {
+			nodes[j] = nodes[j - 1];
+			load[j] = load[j - 1];
+			j--;
+		}
+		nodes[j] = node;
+		load[j] = node_load;
+		node_count++;
+	}
+	cpu_set_t picked;
+	CPU_ZERO(&picked);
+	bool done = false;
+	// CPUs sharing one LLC on the least loaded node.
+	for (int i = 0; i < node_count && !done; i++) {
+		cpu_set_t candidates;
+		node_cpus(&free_cpus, topo, nodes[i], &candidates);
+		done = pick_in_llc(&candidates, topo, count, &picked);
+	}
+	// CPUs on one node.
+	for (int i = 0; i < node_count && !done; i++) {
+		cpu_set_t candidates;
+		node_cpus(&free_cpus, topo, nodes[i], &candidates);
+		if (CPU_COUNT(&candidates) >= count) {
+			pick_cpus(&candidates, topo, count, &picked);
+			done = true;
+		}
+	}
+	// CPUs across nodes.
+	int picked_count = 0;
+	for (int i = 0; i < node_count && !done; i++) {
+		cpu_set_t candidates;
+		node_cpus(&free_cpus, topo, nodes[i], &candidates);
+		picked_count += pick_cpus(&candidates, topo, count - picked_count, &picked);
+		done = (picked_count >= count);
+	}
+	free(topo);
+	ruri_format_cpu_list(&picked, buf, sizeof(buf));
+	ruri_log("{base}Picked CPUs {cyan}%s{base} for cpuset=auto:%d\n", buf, count);
+	return strdup(buf);
+}
+char *ruri_cpuset_mems(const char *_Nonnull cpus)
+{
+	/*
+	 * Get the NUMA nodes of CPUs for cpuset.mems,
+	 * so that the memory of container is local to its CPUs.
+	 * Return the malloc()ed node list, `0` if not available.
+	 */
+	cpu_set_t set;
+	if (!ruri_parse_cpu_list(cpus, &set) || CPU_COUNT(&set) == 0) {
+		return strdup("0");
+	}
+	struct CPU_TOPOLOGY *topo = malloc(sizeof(struct CPU_TOPOLOGY));
+	read_cpu_topology(topo, &set);
+	cpu_set_t mems;
+	CPU_ZERO(&mems);
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (CPU_ISSET((size_t)i, &set)) {
+			CPU_SET((size_t)topo->node[i], &mems);
+		}
+	}
+	free(topo);
+	char buf[4096] = { '\0' };
+	ruri_format_cpu_list(&mems, buf, sizeof(buf));
+	return strdup(buf);
+}
+bool ruri_parse_mempolicy(const char *_Nonnull policy, int *_Nonnull mode, cpu_set_t *_Nonnull nodes)
+{
+	/*
+	 * Parse memory policy like `interleave:0-1`, `bind:0`, `preferred:1`, `local` or `default`.
+	 * The nodes are stored in cpu_set_t, it's also a bitmask of unsigned long.
+	 * Return false if the format is invalid.
+	 */
+	const char *names[] = { "default", "preferred", "bind", "interleave", "local" };
+	const int modes[] = { MPOL_DEFAULT, MPOL_PREFERRED, MPOL_BIND, MPOL_INTERLEAVE, MPOL_LOCAL };
+	size_t len = strcspn(policy, ":");
+	CPU_ZERO(nodes);
+	*mode = -1;
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (strlen(names[i]) == len && strncmp(policy, names[i], len) == 0) {
+			*mode = modes[i];
+		}
+	}
+	if (*mode < 0) {
+		return false;
+	}
+	if (policy[len] == '\0') {
+		// bind and interleave need nodes.
+		return *mode != MPOL_BIND && *mode != MPOL_INTERLEAVE;
+	}
+	if (*mode == MPOL_DEFAULT || *mode == MPOL_LOCAL) {
+		return false;
+	}
+	if (!ruri_parse_cpu_list(policy + len + 1, nodes) || CPU_COUNT(nodes) == 0) {
+		return false;
+	}
+	// MPOL_PREFERRED only uses the first node.
+	return *mode != MPOL_PREFERRED || CPU_COUNT(nodes) == 1;
+}
+void ruri_check_isolated_cpus(const char *_Nonnull cpus)
+{
+	/*
+	 * Warn if CPUs overlap isolcpus or nohz_full,
+	 * the scheduler will not balance the load on isolated CPUs,
+	 * and the container might run on a CPU in nohz_full mode.
+	 */
+	cpu_set_t set;
+	if (!ruri_parse_cpu_list(cpus, &set)) {
+		return;
+	}
+	const char *files[] = { "/sys/devices/system/cpu/isolated", "/sys/devices/system/cpu/nohz_full" };
+	const char *names[] = { "isolcpus", "nohz_full" };
+	for (int i = 0; i < 2; i++) {
+		char buf[4096] = { '\0' };
+		cpu_set_t isolated;
+		if (!read_sys_file(files[i], buf, sizeof(buf)) || !ruri_parse_cpu_list(buf, &isolated)) {
+			continue;
+		}
+		CPU_AND(&isolated, &isolated, &set);
+		if (CPU_COUNT(&isolated) > 0) {
+			ruri_format_cpu_list(&isolated, buf, sizeof(buf));
+			ruri_warning("{yellow}Warning: CPUs %s of cpuset are in %s\n", buf, names[i]);
+		}
+	}
+}
@@ -157,6 +157,10 @@ static char *build_container_info(const struct RURI_CONTAINER *_Nonnull containe
 	}
 	ret = k2v_add_comment(ret, "Denied syscalls, use seccomp.");
 	ret = k2v_add_config(char_array, ret, "deny_syscall", container->seccomp_denied_syscall, len);
+	// seccomp_profile.
+	ret = k2v_add_comment(ret, "Allowlist seccomp profile.");
+	ret = k2v_add_config(char, ret, "seccomp_profile", container->seccomp_profile);
+	ret = k2v_add_config(bool, ret, "seccomp_spec_allow", container->seccomp_spec_allow);
 	ret = k2v_add_newline(ret);
 	// ns_pid.
 	ret = k2v_add_comment(ret, "PID owning unshare namespace.");
@@ -179,6 +183,69 @@ static char *build_container_info(const struct RURI_CONTAINER *_Nonnull containe
 	// OOM score.
 	ret = k2v_add_comment(ret, "OOM score.");
 	ret = k2v_add_config(int, ret, "oom_score_adj", container->oom_score_adj);
+	// Scheduling attributes, also set for processes joining the container.
+	ret = k2v_add_comment(ret, "Scheduling attributes.");
+	ret = k2v_add_config(char, ret, "sched_policy", container->sched_policy);
+	ret = k2v_add_config(int, ret, "sched_priority", container->sched_priority);
+	ret = k2v_add_config(int, ret, "sched_nice", container->sched_nice);
+	ret = k2v_add_config(int, ret, "uclamp_min", container->uclamp_min);
+	ret = k2v_add_config(int, ret, "uclamp_max", container->uclamp_max);
+	ret = k2v_add_config(char, ret, "cpu_affinity", container->cpu_affinity);
+	ret = k2v_add_config(bool, ret, "sched_core", container->sched_core);
+	ret = k2v_add_config(int, ret, "timer_slack", container->timer_slack);
+	// Memory policy, also set for processes joining the container.
+	ret = k2v_add_comment(ret, "Memory policy.");
+	ret = k2v_add_config(bool, ret, "thp_disable", container->thp_disable);
+	ret = k2v_add_config(char, ret, "mempolicy", container->mempolicy);
+	ret = k2v_add_config(bool, ret, "ksm", container->ksm);
+	// Resource limits, also set for processes joining the container.
+	ret = k2v_add_comment(ret, "Resource limits.");
+	for (int i = 0; true; i++) {
+		if (container->rlimits[i] == NULL) {
+			len = i;
+			break;
+		}
+	}
+	ret = k2v_add_config(char_array, ret, "rlimits", container->rlimits, len);
+	// pids_max.
+	ret = k2v_add_comment(ret, "Cgroup pids limit.");
+	ret = k2v_add_config(int, ret, "pids_max", container->pids_max);
+	// Other cgroup limits, for `ruri --update`.
+	ret = k2v_add_comment(ret, "Cgroup cpu limits.");
+	ret = k2v_add_config(char, ret, "cpuset", container->cpuset);
+	ret = k2v_add_config(int, ret, "cpupercent", container->cpupercent);
+	ret = k2v_add_config(char, ret, "cpu_max", container->cpu_max);
+	ret = k2v_add_config(int, ret, "cpu_burst", container->cpu_burst);
+	ret = k2v_add_config(int, ret, "cpu_weight", container->cpu_weight);
+	ret = k2v_add_config(int, ret, "cpu_weight_nice", container->cpu_weight_nice);
+	ret = k2v_add_config(bool, ret, "cpu_idle", container->cpu_idle == 1);
+	ret = k2v_add_comment(ret, "Cgroup memory limits.");
+	ret = k2v_add_config(char, ret, "memory", container->memory);
+	ret = k2v_add_config(char, ret, "memory_high", container->memory_high);
+	ret = k2v_add_config(char, ret, "memory_low", container->memory_low);
+	ret = k2v_add_config(char, ret, "memory_min", container->memory_min);
+	ret = k2v_add_config(char, ret, "memory_swap_max", container->memory_swap_max);
+	ret = k2v_add_config(char, ret, "memory_zswap_max", container->memory_zswap_max);
+	ret = k2v_add_comment(ret, "Cgroup I/O limits.");
+	char *const *io_limits[] = { container->io_max, container->io_weight, container->io_latency };
+	const char *io_keys[] = { "io_max", "io_weight", "io_latency" };
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; true; j++) {
+			if (io_limits[i][j] == NULL) {
+				len = j;
+				break;
+			}
+		}
+		ret = k2v_add_config(char_array, ret, io_keys[i], io_limits[i], len);
+	}
+	ret = k2v_add_comment(ret, "Cgroup hugetlb limits.");
+	for (int i = 0; true; i++) {
+		if (container->hugetlb_max[i] == NULL) {
+			len = i;
+			break;
+		}
+	}
+	ret = k2v_add_config(char_array, ret, "hugetlb_max", container->hugetlb_max, len);
 	// extra_mountpoint.
 	for (int i = 0; true; i++) {
 		if (container->extra_mountpoint[i] == NULL) {
@@ -268,6 +335,46 @@ void ruri_store_info(const struct RURI_CONTAINER *_Nonnull container)
 	mount(file, file, NULL, MS_REMOUNT | MS_RDONLY | MS_BIND, NULL);
 	free(info);
 }
+// Read cgroup limits stored in .rurienv.
+static void read_cgroup_limits(struct RURI_CONTAINER *_Nonnull container, const char *_Nonnull buf)
+{
+	/*
+	 * The keys might not exist in .rurienv created by old version of ruri,
+	 * so we keep the default value in this case.
+	 */
+	if (have_key("pids_max", buf)) {
+		container->pids_max = k2v_get_key(int, "pids_max", buf);
+	}
+	container->cpuset = k2v_get_key(char, "cpuset", buf);
+	if (have_key("cpupercent", buf)) {
+		container->cpupercent = k2v_get_key(int, "cpupercent", buf);
+	}
+	container->cpu_max = k2v_get_key(char, "cpu_max", buf);
+	if (have_key("cpu_burst", buf)) {
+		container->cpu_burst = k2v_get_key(int, "cpu_burst", buf);
+	}
+	if (have_key("cpu_weight", buf)) {
+		container->cpu_weight = k2v_get_key(int, "cpu_weight", buf);
+	}
+	if (have_key("cpu_weight_nice", buf)) {
+		container->cpu_weight_nice = k2v_get_key(int, "cpu_weight_nice", buf);
+	}
+	container->cpu_idle = k2v_get_key(bool, "cpu_idle", buf) ? 1 : RURI_INIT_VALUE;
+	container->memory = k2v_get_key(char, "memory", buf);
+	container->memory_high = k2v_get_key(char, "memory_high", buf);
+	container->memory_low = k2v_get_key(char, "memory_low", buf);
+	container->memory_min = k2v_get_key(char, "memory_min", buf);
+	container->memory_swap_max = k2v_get_key(char, "memory_swap_max", buf);
+	container->memory_zswap_max = k2v_get_key(char, "memory_zswap_max", buf);
+	int len = k2v_get_key(char_array, "io_max", buf, container->io_max, RURI_MAX_IO_DEVS);
+	container->io_max[len] = NULL;
+	len = k2v_get_key(char_array, "io_weight", buf, container->io_weight, RURI_MAX_IO_DEVS);
+	container->io_weight[len] = NULL;
+	len = k2v_get_key(char_array, "io_latency", buf, container->io_latency, RURI_MAX_IO_DEVS);
+	container->io_latency[len] = NULL;
+	len = k2v_get_key(char_array, "hugetlb_max", buf, container->hugetlb_max, RURI_MAX_HUGETLB_SIZES);
+	container->hugetlb_max[len] = NULL;
+}
 // Read .rurienv file.
 struct RURI_CONTAINER *ruri_read_info(struct RURI_CONTAINER *_Nullable container, const char *_Nonnull container_dir)
 {
@@ -289,6 +396,7 @@ struct RURI_CONTAINER *ruri_read_info(struct RURI_CONTAINER *_Nullable container
 			container->extra_mountpoint[0] = NULL;
 			container->extra_ro_mountpoint[0] = NULL;
 			container->ns_pid = RURI_INIT_VALUE;
+			container->container_id = RURI_INIT_VALUE;
 		}
 		return container;
 	}
@@ -303,6 +411,7 @@ struct RURI_CONTAINER *ruri_read_info(struct RURI_CONTAINER *_Nullable container
 	char *buf = k2v_open_file(file, (size_t)size);
 	ruri_log("{base}Container config in /.rurienv:{cyan}\n%s", buf);
 	// We only need to get part of container info when container is NULL.
+	bool partial = (container == NULL);
 	if (container == NULL) {
 		// For ruri_umount_container().
 		container = (struct RURI_CONTAINER *)malloc(sizeof(struct RURI_CONTAINER));
@@ -319,6 +428,14 @@ struct RURI_CONTAINER *ruri_read_info(struct RURI_CONTAINER *_Nullable container
 		} else {
 			container->ns_pid = RURI_INIT_VALUE;
 		}
+		// For ruri_kill_cgroup().
+		if (have_key("container_id", buf)) {
+			container->container_id = k2v_get_key(int, "container_id", buf);
+		} else {
+			container->container_id = RURI_INIT_VALUE;
+		}
+		// For ruri_update_container().
+		read_cgroup_limits(container, buf);
 	}
 	// Check if ns_pid is a ruri process.
 	// If not, that means the container is not running.
@@ -389,6 +506,9 @@ struct RURI_CONTAINER *ruri_read_info(struct RURI_CONTAINER *_Nullable container
 	// Get seccomp_denied_syscall.
 	int seccomplen = k2v_get_key(char_array, "deny_syscall", buf, container->seccomp_denied_syscall, RURI_MAX_SECCOMP_DENIED_SYSCALL);
 	container->seccomp_denied_syscall[seccomplen] = NULL;
+	// Get seccomp_profile and seccomp_spec_allow.
+	container->seccomp_profile = k2v_get_key(char, "seccomp_profile", buf);
+	container->seccomp_spec_allow = k2v_get_key(bool, "seccomp_spec_allow", buf);
 	// Check if seccomp_denied_syscall changed.
 	//
 	// TODO
@@ -412,6 +532,29 @@ struct RURI_CONTAINER *ruri_read_info(struct RURI_CONTAINER *_Nullable container
 	container->no_network = k2v_get_key(bool, "no_network", buf);
 	// Get oom_score_adj.
 	container->oom_score_adj = k2v_get_key(int, "oom_score_adj", buf);
+	// Get scheduling attributes.
+	container->sched_policy = k2v_get_key(char, "sched_policy", buf);
+	const char *sched_keys[] = { "sched_priority", "sched_nice", "uclamp_min", "uclamp_max", "timer_slack" };
+	int *sched_values[] = { &container->sched_priority, &container->sched_nice, &container->uclamp_min, &container->uclamp_max, &container->timer_slack };
+	for (int i = 0; i < 5; i++) {
+		if (have_key(sched_keys[i], buf)) {
+			*sched_values[i] = k2v_get_key(int, sched_keys[i], buf);
+		}
+	}
+	container->cpu_affinity = k2v_get_key(char, "cpu_affinity", buf);
+	container->sched_core = k2v_get_key(bool, "sched_core", buf);
+	// Get thp_disable and mempolicy.
+	container->thp_disable = k2v_get_key(bool, "thp_disable", buf);
+	container->mempolicy = k2v_get_key(char, "mempolicy", buf);
+	container->ksm = k2v_get_key(bool, "ksm", buf);
+	// Get rlimits, the limits from command line override the ones in .rurienv.
+	char *rlimits[RURI_MAX_RLIMITS + 1] = { NULL };
+	int rlimit_len = k2v_get_key(char_array, "rlimits", buf, rlimits, RURI_MAX_RLIMITS);
+	rlimits[rlimit_len] = NULL;
+	for (int i = 0; container->rlimits[i] != NULL; i++) {
+		ruri_add_rlimit(rlimits, container->rlimits[i]);
+	}
+	memcpy(container->rlimits, rlimits, sizeof(rlimits));
 	// Get env.
 	int envlen = k2v_get_key(char_array, "env", buf, container->env, RURI_MAX_ENVS);
 	container->env[envlen] = NULL;
@@ -422,9 +565,27 @@ struct RURI_CONTAINER *ruri_read_info(struct RURI_CONTAINER *_Nullable container
 	container->qemu_path = NULL;
 	container->cross_arch = NULL;
 	// Unset cgroup limits because it's already set.
-	container->cpuset = NULL;
-	container->memory = NULL;
-	container->cpupercent = RURI_INIT_VALUE;
+	// But keep them for ruri_update_container().
+	if (!partial) {
+		container->pids_max = RURI_INIT_VALUE;
+		container->cpuset = NULL;
+		container->memory = NULL;
+		container->memory_high = NULL;
+		container->memory_low = NULL;
+		container->memory_min = NULL;
+		container->memory_swap_max = NULL;
+		container->memory_zswap_max = NULL;
+		container->cpupercent = RURI_INIT_VALUE;
+		container->cpu_max = NULL;
+		container->cpu_burst = RURI_INIT_VALUE;
+		container->cpu_weight = RURI_INIT_VALUE;
+		container->cpu_weight_nice = RURI_INIT_VALUE;
+		container->cpu_idle = RURI_INIT_VALUE;
+		container->io_max[0] = NULL;
+		container->io_weight[0] = NULL;
+		container->io_latency[0] = NULL;
+		container->hugetlb_max[0] = NULL;
+	}
 	// Unset timens offsets because it's already set.
 	container->timens_realtime_offset = 0;
 	container->timens_monotonic_offset = 0;
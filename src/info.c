@@ -76,9 +76,14 @@ void ruri_show_helps(void)
 	cprintf("{base}  -V, --version-code ..........................: Show version code\n");
 	cprintf("{base}  -h, --help ..................................: Show help\n");
 	cprintf("{base}  -H, --show-examples .........................: Show command line examples\n");
-	cprintf("{base}  -U, --umount [container_dir/config] .........: Unmount a container\n");
+	cprintf("{base}  -U, --umount [container_dir/config]... ......: Unmount container(s) (*16)\n");
 	cprintf("{base}  -P, --ps [container_dir/config] .............: Show process status of the container (*1)\n");
 	cprintf("{base}  -C, --correct-config [config]................: Correct a container config\n");
+	cprintf("{base}      --top [container_dir/config] ............: Show processes of the container like top(1) (*17)\n");
+	cprintf("{base}      --stop [container_dir/config] ...........: Stop the container gracefully (*18)\n");
+	cprintf("{base}      --update [container_dir/config] [-l ...] : Update cgroup limits of a running container (*19)\n");
+	cprintf("{base}      --stats [container_dir/config] ..........: Show cgroup resource usage of the container (*20)\n");
+	cprintf("{base}      --monitor [container_dir/config] ........: Watch PSI, OOM, pids and CPU throttling events (*21)\n");
 	cprintf("\n");
 	cprintf("{base}ARGS:\n");
 	cprintf("{base}  -r, --rootless ..............................: Run rootless container\n");
@@ -99,7 +104,7 @@ void ruri_show_helps(void)
 	cprintf("{base}  -M, --ro-mount [dir/dev/img/file] [target] ..: Mount dir/block-device/image/file as read-only\n");
 	cprintf("{base}  -S, --host-runtime ..........................: Bind-mount /dev/, /sys/, and /proc/ from host\n");
 	cprintf("{base}  -R, --read-only .............................: Mount / as read-only\n");
-	cprintf("{base}  -l, --limit [limit=lin] .....................: Set cpuset/memory limit (*6)\n");
+	cprintf("{base}  -l, --limit [limit=lin] .....................: Set cpuset/memory/cpu/io limit (*6)\n");
 	cprintf("{base}  -w, --no-warnings ...........................: Disable warnings\n");
 	cprintf("{base}  -f, --fork ..................................: fork() before executing the command (*7)\n");
 	cprintf("{base}  -j, --just-chroot ...........................: Just chroot, do not create the runtime dirs\n");
@@ -115,20 +120,38 @@ void ruri_show_helps(void)
 	cprintf("{base}  -b, --background ............................: Fork to background\n");
 	cprintf("{base}  -L, --logfile [file] ........................: Set log file for -b option\n");
 	cprintf("{base}  -X, --deny-syscall [syscall] ................: Deny syscall, use seccomp\n");
+	cprintf("{base}  --seccomp-profile [file] ....................: Use allowlist seccomp profile (*25)\n");
+	cprintf("{base}  --seccomp-learn [file] ......................: Record syscalls to allowlist seccomp profile\n");
+	cprintf("{base}  --seccomp-spec-allow ........................: Do not force SSB mitigation for seccomp\n");
 	cprintf("{base}  -J, --join-ns [NS_PID] ......................: Join namespace using ns_pid (*13)\n");
 	cprintf("{base}  -O, --oom-score-adj [score] .................: Set oom_score_adj for container (*14)\n");
 	cprintf("{base}  -Q, --mask-path [path] ......................: Mask a path in the container\n");
 	cprintf("{base}  -z, --enable-tty-signals ....................: Enable TTY signals in the container (*15)\n");
 	cprintf("{base}  -g, --skip-setgroups ........................: Skip setgroups() call\n");
+	cprintf("{base}      --hugetlbfs [dir] .......................: Mount hugetlbfs on dir in the container (*6)\n");
+	cprintf("{base}      --sched [key=value] .....................: Set scheduling attributes of the container (*22)\n");
+	cprintf("{base}      --rlimit [NAME=SOFT:HARD] ...............: Set resource limit of the container (*23)\n");
+	cprintf("{base}      --thp-disable ...........................: Disable transparent hugepages in the container\n");
+	cprintf("{base}      --ksm ...................................: Merge identical anonymous pages of the container with KSM\n");
+	cprintf("{base}      --mempolicy [policy:nodes] ..............: Set NUMA memory policy of the container (*24)\n");
 	cprintf("\n");
 	cprintf("{base}Note:\n");
-	cprintf("{base}(*1)  : Will not work for unshare containers without PID ns support\n");
+	cprintf("{base}(*1)  : Processes are shown as a tree, will not work for unshare containers without cgroup and PID ns support\n");
 	cprintf("{base}(*2)  : The `-a` option also requires `-q` to be set\n");
 	cprintf("{base}(*3)  : cap can be either a value or name (e.g., cap_chown == 0)\n");
 	cprintf("{base}(*4)  : Will not work if [COMMAND [ARGS]...] is like `/bin/su -`\n");
 	cprintf("{base}(*5)  : You can use `-m/-M [source] /` to mount another source as root\n");
-	cprintf("{base}(*6)  : Each `-l` option can only set one of the cpuset/memory/cpupercent limits\n");
-	cprintf("{base}        for example: `ruri -l memory=1M -l cpupercent=60 -l cpuset=1 /test`\n");
+	cprintf("{base}(*6)  : Each `-l` option can only set one of the cpuset/memory/cpupercent/pids/io/hugetlb limits\n");
+	cprintf("{base}        for example: `ruri -l memory=1M -l cpupercent=60 -l cpuset=1 -l pids=100 /test`\n");
+	cprintf("{base}        memory limits: `-l memory.high=1G -l memory.low=25%% -l memory.min=256M -l memory.swap.max=0 -l memory.zswap.max=max`,\n");
+	cprintf("{base}        `memory` is the same as `memory.max`, sizes can be in K/M/G/T, or in %% of host RAM\n");
+	cprintf("{base}        cpu limits: `-l cpu=350%% -l cpu.max=\"350000 100000\" -l cpu.max.burst=50000 -l cpu.weight=200 -l cpu.weight.nice=5 -l cpu.idle=1`,\n");
+	cprintf("{base}        `cpu` is in %% or in cores (`cpu=3.5`), cpupercent can be more than 100 for multiple cores\n");
+	cprintf("{base}        `-l cpuset=auto:4` picks 4 CPUs sharing a cache on the least loaded NUMA node, cpuset.mems follows the CPUs\n");
+	cprintf("{base}        I/O limits: `-l io.max=/dev/sda:rbps=1048576,wiops=120 -l io.weight=200 -l io.latency=/dev/sda:target=10000`\n");
+	cprintf("{base}        the device can be a block device, a file on it (like the container dir or its loop image) or MAJ:MIN\n");
+	cprintf("{base}        hugetlb limits: `-l hugetlb.2MB=1G -l hugetlb.1GB=max`, hugetlbfs is mounted on /dev/hugepages with the limit as size,\n");
+	cprintf("{base}        other hugepage sizes are mounted on /dev/hugepages-SIZE, use `--hugetlbfs [dir/none]` to change it\n");
 	cprintf("{base}(*7)  : This option is totally useless\n");
 	cprintf("{base}(*8)  : If you use a username, please make sure it's in /etc/passwd in the container\n");
 	cprintf("{base}(*9)  : This option is only for unshare containers\n");
@@ -138,6 +161,16 @@ void ruri_show_helps(void)
 	cprintf("{base}(*13) : This can only be used when the `-N` option is enabled\n");
 	cprintf("{base}(*14) : The value is in the range of -1000 to 1000, but setting a negative value might cause security issues\n");
 	cprintf("{base}(*15) : ruri will ignore SIGTTIN and SIGTTOU by default, enable this option to allow TTY signals in the container\n");
+	cprintf("{base}(*16) : Multiple containers are umounted in parallel, use `-U --all` to umount all running containers\n");
+	cprintf("{base}(*17) : Use `--top --interval MS --count N --json` to set the interval, the number of samples and output JSON\n");
+	cprintf("{base}(*18) : Send SIGTERM to all processes, and kill them after `--timeout S` seconds (default 10)\n");
+	cprintf("{base}(*19) : Rewrite cgroup control files in place, like `ruri --update /test -l memory=8G -l cpu=200%%`, limits are kept in .rurienv\n");
+	cprintf("{base}(*20) : Use `--stats --interval MS --count N --json --prometheus FILE` to set the interval, the number of samples, output JSON and write a Prometheus textfile\n");
+	cprintf("{base}(*21) : Use `--monitor --psi memory:some:150000:1000000 --log FILE --hook CMD --json` to set PSI triggers, log file and the command run for every event\n");
+	cprintf("{base}(*22) : Keys: policy=other/batch/idle/fifo:PRIO/rr:PRIO, nice=N, uclamp=MIN:MAX, affinity=CPUS, core=1, timerslack=NS, can be used multiple times\n");
+	cprintf("{base}(*23) : NAME is NOFILE, MEMLOCK, NPROC, STACK, CORE, etc., SOFT and HARD are numbers or unlimited, HARD is SOFT if omitted\n");
+	cprintf("{base}(*24) : Policy is interleave:NODES, bind:NODES, preferred:NODE, local or default, like `--mempolicy interleave:0-1`\n");
+	cprintf("{base}(*25) : Replaces `-s`, see test/seccomp/docker-default.profile\n");
 	cprintf("\n{base}Note:\n");
 	cprintf("{base}BSD style usage is partially supported now. For example, you can use `-pW /root`, but `-W/root` is not allowed.\n");
 	cprintf("{base}{clear}\n");
@@ -0,0 +1,444 @@
+// SPDX-License-Identifier: MIT
+/*
+ *
+ * This file is part of ruri, with ABSOLUTELY NO WARRANTY.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022-2024 Moe-hacker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+#include "include/ruri.h"
+/*
+ * This file provides `ruri --monitor`, to watch the resource events of container.
+ * PSI triggers are registered on ${resource}.pressure, and the fds are polled
+ * for POLLPRI, the kernel wakes us up when the stall time in the window
+ * exceeds the threshold.
+ * memory.events and pids.events generate POLLPRI when they are changed,
+ * and they are also read every interval.
+ * For cgroup v1 without memory.events, OOM is got from memory.oom_control
+ * through cgroup.event_control and eventfd.
+ * cpu.stat has no notification, so it's checked every interval.
+ */
+static const char *const memory_events_keys[] = { "low", "high", "max", "oom", "oom_kill", "oom_group_kill", NULL };
+static const char *const pids_events_keys[] = { "max", NULL };
+static const char *const *events_keys(const char *_Nonnull file)
+{
+	if (strcmp(file, "memory.events") == 0) {
+		return memory_events_keys;
+	}
+	return pids_events_keys;
+}
+static void print_json_string(FILE *_Nonnull out, const char *_Nonnull str)
+{
+	fputc('"', out);
+	for (const char *p = str; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\') {
+			fputc('\\', out);
+			fputc(*p, out);
+		} else if ((unsigned char)*p < 0x20) {
+			fprintf(out, "\\u%04x", (unsigned char)*p);
+		} else {
+			fputc(*p, out);
+		}
+	}
+	fputc('"', out);
+}
+static void run_hook(const char *_Nonnull hook, const char *_Nonnull container_dir, const char *_Nonnull file, const char *_Nonnull key, unsigned long long value, unsigned long long delta)
+{
+	/*
+	 * Run the hook in background, with the event in environment variables.
+	 * SIGCHLD is ignored, so we do not need to wait for it.
+	 */
+	pid_t pid = fork();
+	if (pid < 0) {
+		ruri_warning("{yellow}Warning: failed to fork for hook QwQ\n");
+		return;
+	}
+	if (pid > 0) {
+		return;
+	}
+	char buf[32] = { '\0' };
+	setenv("RURI_CONTAINER_DIR", container_dir, 1);
+	setenv("RURI_EVENT_FILE", file, 1);
+	setenv("RURI_EVENT_KEY", key, 1);
+	sprintf(buf, "%llu", value);
+	setenv("RURI_EVENT_VALUE", buf, 1);
+	sprintf(buf, "%llu", delta);
+	setenv("RURI_EVENT_DELTA", buf, 1);
+	signal(SIGCHLD, SIG_DFL);
+	execl("/bin/sh", "sh", "-c", hook, (char *)NULL);
+	_exit(127);
+}
+static void emit_event(const struct RURI_MONITOR *_Nonnull monitor, FILE *_Nonnull out, const char *_Nonnull container_dir, const char *_Nonnull file, const char *_Nonnull key, unsigned long long value, unsigned long long delta, double avg10)
+{
+	/*
+	 * Write the event to log, and run the hook.
+	 * avg10 is only for PSI events, it's < 0 for others.
+	 */
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	if (monitor->json) {
+		fprintf(out, "{\"time\":%ld.%03ld,\"container\":", (long)ts.tv_sec, ts.tv_nsec / 1000000);
+		print_json_string(out, container_dir);
+		fprintf(out, ",\"file\":\"%s\",\"key\":\"%s\",\"value\":%llu,\"delta\":%llu", file, key, value, delta);
+		if (avg10 >= 0) {
+			fprintf(out, ",\"avg10\":%.2f", avg10);
+		}
+		fprintf(out, "}\n");
+	} else {
+		char date[32] = { '\0' };
+		struct tm tm;
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime_r(&ts.tv_sec, &tm));
+		fprintf(out, "[%s] %s: %s %llu (+%llu)", date, file, key, value, delta);
+		if (avg10 >= 0) {
+			fprintf(out, ", avg10 %.2f", avg10);
+		}
+		fprintf(out, "\n");
+	}
+	fflush(out);
+	if (monitor->hook != NULL) {
+		run_hook(monitor->hook, container_dir, file, key, value, delta);
+	}
+}
+static ssize_t reread(int fd, char *_Nonnull buf, size_t size)
+{
+	/*
+	 * Read the file from the beginning.
+	 * Reading through the polled fd also clears the POLLPRI state.
+	 */
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		return -1;
+	}
+	ssize_t len = read(fd, buf, size - 1);
+	if (len < 0) {
+		return -1;
+	}
+	buf[len] = '\0';
+	return len;
+}
+static unsigned long long find_value(const char *_Nonnull buf, const char *_Nonnull key)
+{
+	/*
+	 * Get the value of `key value` line in buf, 0 if not found.
+	 */
+	size_t len = strlen(key);
+	for (const char *line = buf; line != NULL && *line != '\0'; line = strchr(line, '\n')) {
+		if (*line == '\n') {
+			line++;
+		}
+		if (strncmp(line, key, len) == 0 && line[len] == ' ') {
+			return strtoull(line + len + 1, NULL, 10);
+		}
+	}
+	return 0;
+}
+static bool parse_psi_trigger(const char *_Nonnull spec, char *_Nonnull file, char *_Nonnull trigger)
+{
+	/*
+	 * `memory:some:150000:1000000` -> memory.pressure, `some 150000 1000000`.
+	 * The window should be 500ms to 10s, as the kernel requires.
+	 */
+	char resource[16] = { '\0' };
+	char kind[8] = { '\0' };
+	unsigned long stall = 0;
+	unsigned long window = 0;
+	if (sscanf(spec, "%15[a-z]:%7[a-z]:%lu:%lu", resource, kind, &stall, &window) != 4) {
+		return false;
+	}
+	if (strcmp(resource, "cpu") != 0 && strcmp(resource, "memory") != 0 && strcmp(resource, "io") != 0) {
+		return false;
+	}
+	if (strcmp(kind, "some") != 0 && strcmp(kind, "full") != 0) {
+		return false;
+	}
+	if (stall == 0 || stall > window || window < 500000 || window > 10000000) {
+		return false;
+	}
+	sprintf(file, "%s.pressure", resource);
+	sprintf(trigger, "%s %lu %lu", kind, stall, window);
+	return true;
+}
+static bool add_psi_watch(struct RURI_MONITOR_WATCH *_Nonnull watch, int v2_fd, const char *_Nonnull spec)
+{
+	/*
+	 * Register PSI trigger, the trigger is removed when fd is closed.
+	 */
+	if (!parse_psi_trigger(spec, watch->file, watch->trigger)) {
+		ruri_error("{red}Error: invalid PSI trigger `%s`, should be like `memory:some:150000:1000000` QwQ\n", spec);
+	}
+	if (v2_fd < 0) {
+		return false;
+	}
+	watch->type = RURI_WATCH_PSI;
+	watch->fd = openat(v2_fd, watch->file, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (watch->fd < 0) {
+		return false;
+	}
+	// The trigger should be written with the trailing '\0'.
+	if (write(watch->fd, watch->trigger, strlen(watch->trigger) + 1) < 0) {
+		/*
+		 * Without CAP_SYS_RESOURCE, the window should be a multiple of 2s,
+		 * so we try again with a 2s window and the same stall ratio.
+		 */
+		char kind[8] = { '\0' };
+		unsigned long stall = 0;
+		unsigned long window = 0;
+		sscanf(watch->trigger, "%7s %lu %lu", kind, &stall, &window);
+		bool retried = false;
+		if (errno == EINVAL && window % 2000000 != 0) {
+			unsigned long new_window = (window / 2000000 + 1) * 2000000;
+			sprintf(watch->trigger, "%s %lu %lu", kind, stall * (new_window / 1000) / (window / 1000), new_window);
+			retried = write(watch->fd, watch->trigger, strlen(watch->trigger) + 1) >= 0;
+			if (retried) {
+				ruri_warning("{yellow}Warning: PSI window of unprivileged trigger should be a multiple of 2s, using `%s` on %s\n", watch->trigger, watch->file);
+			}
+		}
+		if (!retried) {
+			ruri_warning("{yellow}Warning: failed to register PSI trigger `%s` on %s: %s\n", watch->trigger, watch->file, strerror(errno));
+			close(watch->fd);
+			return false;
+		}
+	}
+	char buf[512] = { '\0' };
+	if (reread(watch->fd, buf, sizeof(buf)) > 0) {
+		char *line = strstr(buf, watch->trigger[0] == 's' ? "some" : "full");
+		if (line != NULL) {
+			sscanf(line + 4, " avg10=%*f %*s %*s total=%llu", &watch->counts[0]);
+		}
+	}
+	return true;
+}
+static bool add_events_watch(struct RURI_MONITOR_WATCH *_Nonnull watch, int cgroup_fd, const char *_Nonnull file)
+{
+	/*
+	 * Watch memory.events or pids.events.
+	 */
+	if (cgroup_fd < 0) {
+		return false;
+	}
+	watch->type = RURI_WATCH_EVENTS;
+	strcpy(watch->file, file);
+	watch->fd = openat(cgroup_fd, file, O_RDONLY | O_CLOEXEC);
+	if (watch->fd < 0) {
+		return false;
+	}
+	char buf[1024] = { '\0' };
+	reread(watch->fd, buf, sizeof(buf));
+	const char *const *keys = events_keys(file);
+	for (int i = 0; keys[i] != NULL; i++) {
+		watch->counts[i] = find_value(buf, keys[i]);
+	}
+	return true;
+}
+static bool add_oom_control_watch(struct RURI_MONITOR_WATCH *_Nonnull watch, int memory_fd)
+{
+	/*
+	 * cgroup v1 OOM notification:
+	 * write `<eventfd> <fd of memory.oom_control>` to cgroup.event_control.
+	 */
+	if (memory_fd < 0) {
+		return false;
+	}
+	watch->type = RURI_WATCH_OOM_CONTROL;
+	strcpy(watch->file, "memory.oom_control");
+	int oom_fd = openat(memory_fd, "memory.oom_control", O_RDONLY | O_CLOEXEC);
+	int control_fd = openat(memory_fd, "cgroup.event_control", O_WRONLY | O_CLOEXEC);
+	watch->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	bool ret = false;
+	if (oom_fd >= 0 && control_fd >= 0 && watch->fd >= 0) {
+		char buf[64] = { '\0' };
+		sprintf(buf, "%d %d", watch->fd, oom_fd);
+		ret = write(control_fd, buf, strlen(buf)) > 0;
+	}
+	if (oom_fd >= 0) {
+		close(oom_fd);
+	}
+	if (control_fd >= 0) {
+		close(control_fd);
+	}
+	if (!ret && watch->fd >= 0) {
+		close(watch->fd);
+	}
+	// oom_kill counter is only in kernel 4.13+.
+	ruri_read_cgroup_value(memory_fd, "memory.oom_control", "oom_kill", &watch->counts[0]);
+	return ret;
+}
+static void handle_watch(const struct RURI_MONITOR *_Nonnull monitor, FILE *_Nonnull out, const char *_Nonnull container_dir, struct RURI_MONITOR_WATCH *_Nonnull watch, int memory_fd)
+{
+	/*
+	 * The fd of watch is readable, emit events for the changed counters.
+	 */
+	char buf[1024] = { '\0' };
+	if (watch->type == RURI_WATCH_PSI) {
+		if (reread(watch->fd, buf, sizeof(buf)) <= 0) {
+			return;
+		}
+		char *line = strstr(buf, watch->trigger[0] == 's' ? "some" : "full");
+		double avg10 = 0;
+		unsigned long long total = 0;
+		if (line != NULL) {
+			sscanf(line + 4, " avg10=%lf %*s %*s total=%llu", &avg10, &total);
+		}
+		emit_event(monitor, out, container_dir, watch->file, watch->trigger, total, total - watch->counts[0], avg10);
+		watch->counts[0] = total;
+	} else if (watch->type == RURI_WATCH_EVENTS) {
+		if (reread(watch->fd, buf, sizeof(buf)) <= 0) {
+			return;
+		}
+		const char *const *keys = events_keys(watch->file);
+		for (int i = 0; keys[i] != NULL; i++) {
+			unsigned long long value = find_value(buf, keys[i]);
+			if (value > watch->counts[i]) {
+				emit_event(monitor, out, container_dir, watch->file, keys[i], value, value - watch->counts[i], -1);
+			}
+			watch->counts[i] = value;
+		}
+	} else if (watch->type == RURI_WATCH_OOM_CONTROL) {
+		uint64_t count = 0;
+		if (read(watch->fd, &count, sizeof(count)) != sizeof(count)) {
+			return;
+		}
+		unsigned long long oom_kill = 0;
+		ruri_read_cgroup_value(memory_fd, "memory.oom_control", "oom_kill", &oom_kill);
+		emit_event(monitor, out, container_dir, watch->file, "oom", oom_kill, count, -1);
+		watch->counts[0] = oom_kill;
+	}
+}
+static void check_cpu_throttling(const struct RURI_MONITOR *_Nonnull monitor, FILE *_Nonnull out, const char *_Nonnull container_dir, int cpu_fd, unsigned long long *_Nonnull nr_throttled)
+{
+	/*
+	 * Emit an event if the container is throttled since last check.
+	 */
+	unsigned long long value = 0;
+	if (!ruri_read_cgroup_value(cpu_fd, "cpu.stat", "nr_throttled", &value)) {
+		return;
+	}
+	if (value > *nr_throttled) {
+		emit_event(monitor, out, container_dir, "cpu.stat", "nr_throttled", value, value - *nr_throttled, -1);
+	}
+	*nr_throttled = value;
+}
+// Watch the resource events of container.
+void ruri_container_monitor(const char *_Nonnull container_dir, const struct RURI_MONITOR *_Nonnull monitor)
+{
+	/*
+	 * Run until the cgroup of container is removed.
+	 * Events in a burst are merged, so that we will not run
+	 * the hook thousands of times for memory.high.
+	 */
+	ruri_log("{base}Container directory: {cyan}%s\n", container_dir);
+	if (geteuid() != 0) {
+		ruri_warning("{yellow}Warning: Please run `ruri --monitor` with sudo.\n");
+	}
+	if (monitor->interval_ms <= 0) {
+		ruri_error("{red}Error: invalid interval QwQ\n");
+	}
+	struct RURI_CONTAINER *container = ruri_read_info(NULL, container_dir);
+	struct RURI_STATS_CGROUP cgroup;
+	ruri_open_stats_cgroup(container, &cgroup);
+	// Any fd of the cgroup, to check if it's removed.
+	int check_fd = -1;
+	int fds_to_check[] = { cgroup.v2_fd, cgroup.memory_fd, cgroup.cpu_fd, cgroup.pids_fd };
+	for (size_t i = 0; i < sizeof(fds_to_check) / sizeof(fds_to_check[0]) && check_fd < 0; i++) {
+		check_fd = fds_to_check[i];
+	}
+	if (check_fd < 0) {
+		ruri_error("{red}Error: cgroup of container not found, is the container running? QwQ\n");
+	}
+	struct RURI_MONITOR_WATCH watches[RURI_MAX_PSI_TRIGGERS + 3];
+	memset(watches, 0, sizeof(watches));
+	int count = 0;
+	// Default PSI triggers: 150ms stall in 1s for memory and cpu.
+	const char *default_psi[] = { "memory:some:150000:1000000", "cpu:some:150000:1000000", NULL };
+	const char *const *psi = monitor->psi[0] != NULL ? (const char *const *)monitor->psi : default_psi;
+	for (int i = 0; psi[i] != NULL; i++) {
+		if (add_psi_watch(&watches[count], cgroup.v2_fd, psi[i])) {
+			count++;
+		} else if (!container->no_warnings && psi == (const char *const *)monitor->psi) {
+			ruri_warning("{yellow}Warning: PSI is not available for `%s`, it needs cgroup v2 and CONFIG_PSI\n", psi[i]);
+		}
+	}
+	if (add_events_watch(&watches[count], cgroup.memory_fd, "memory.events")) {
+		count++;
+	} else if (add_oom_control_watch(&watches[count], cgroup.memory_fd)) {
+		count++;
+	}
+	if (add_events_watch(&watches[count], cgroup.pids_fd, "pids.events")) {
+		count++;
+	}
+	unsigned long long nr_throttled = 0;
+	if (cgroup.cpu_fd >= 0) {
+		ruri_read_cgroup_value(cgroup.cpu_fd, "cpu.stat", "nr_throttled", &nr_throttled);
+	}
+	FILE *out = stdout;
+	if (monitor->log_file != NULL) {
+		out = fopen(monitor->log_file, "ae");
+		if (out == NULL) {
+			ruri_error("{red}Error: failed to open %s QwQ\n", monitor->log_file);
+		}
+	}
+	// Do not leave zombies of hooks.
+	signal(SIGCHLD, SIG_IGN);
+	struct pollfd fds[RURI_MAX_PSI_TRIGGERS + 3];
+	for (int i = 0; i < count; i++) {
+		fds[i].fd = watches[i].fd;
+		// eventfd is readable on OOM, others get POLLPRI.
+		fds[i].events = watches[i].type == RURI_WATCH_OOM_CONTROL ? POLLIN : POLLPRI;
+	}
+	cfprintf(stderr, "{base}Watching {cyan}%d{base} event sources of container{clear}\n", count + (cgroup.cpu_fd >= 0 ? 1 : 0));
+	for (;;) {
+		int ret = poll(fds, (nfds_t)count, monitor->interval_ms);
+		if (ret < 0 && errno != EINTR) {
+			ruri_error("{red}Error: poll() failed QwQ\n");
+		}
+		bool removed = false;
+		for (int i = 0; i < count; i++) {
+			// POLLERR for PSI fd means the cgroup is removed.
+			// pids.events of cgroup v1 has no notification, so we read the events files anyway.
+			if (watches[i].type == RURI_WATCH_PSI && (fds[i].revents & POLLERR)) {
+				removed = true;
+			} else if (watches[i].type == RURI_WATCH_EVENTS || (fds[i].revents & (POLLPRI | POLLIN))) {
+				handle_watch(monitor, out, container_dir, &watches[i], cgroup.memory_fd);
+			}
+		}
+		if (cgroup.cpu_fd >= 0) {
+			check_cpu_throttling(monitor, out, container_dir, cgroup.cpu_fd, &nr_throttled);
+		}
+		if (removed || faccessat(check_fd, "cgroup.procs", F_OK, 0) != 0) {
+			break;
+		}
+		if (ret > 0) {
+			usleep(100000);
+		}
+	}
+	cfprintf(stderr, "{base}Cgroup of container removed{clear}\n");
+	for (int i = 0; i < count; i++) {
+		close(watches[i].fd);
+	}
+	if (out != stdout) {
+		fclose(out);
+	}
+	ruri_close_stats_cgroup(&cgroup);
+	free(container);
+	exit(EXIT_SUCCESS);
+}
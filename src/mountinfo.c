@@ -0,0 +1,343 @@
+// SPDX-License-Identifier: MIT
+/*
+ *
+ * This file is part of ruri, with ABSOLUTELY NO WARRANTY.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022-2024 Moe-hacker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+#include "include/ruri.h"
+/*
+ * This file provides a parser for /proc/<pid>/mountinfo.
+ * The mount table is read only once with a large buffer,
+ * and the records are indexed by mount point,
+ * so that we can find all mountpoints under a directory by binary search.
+ * It's used by ruri_umount_container() and the cgroup code.
+ */
+// Read the whole file into a buffer.
+static char *read_proc_file(const char *_Nonnull path, size_t *_Nonnull len)
+{
+	/*
+	 * As procfs does not support stat(),
+	 * we can not know the size of the file,
+	 * so we read it in large chunks and grow the buffer exponentially.
+	 * Warning: free() after use.
+	 */
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+	size_t bufsize = 65536;
+	size_t used = 0;
+	char *ret = malloc(bufsize + 1);
+	if (ret == NULL) {
+		close(fd);
+		return NULL;
+	}
+	ssize_t bytes_read = 0;
+	while ((bytes_read = read(fd, ret + used, bufsize - used)) > 0) {
+		used += (size_t)bytes_read;
+		if (used == bufsize) {
+			bufsize *= 2;
+			char *tmp = realloc(ret, bufsize + 1);
+			if (tmp == NULL) {
+				free(ret);
+				close(fd);
+				return NULL;
+			}
+			ret = tmp;
+		}
+	}
+	close(fd);
+	ret[used] = '\0';
+	*len = used;
+	return ret;
+}
+// Decode octal escapes like `\040` in place.
+static void decode_octal_escape(char *_Nonnull str)
+{
+	/*
+	 * The kernel escapes space, tab, newline and backslash
+	 * in mountinfo as \040, \011, \012 and \134.
+	 * The decoded string is always shorter, so we can do it in place.
+	 */
+	char *src = str;
+	char *dst = str;
+	while (*src != '\0') {
+		if (src[0] == '\\' && src[1] >= '0' && src[1] <= '3' && src[2] >= '0' && src[2] <= '7' && src[3] >= '0' && src[3] <= '7') {
+			*dst = (char)(((src[1] - '0') << 6) | ((src[2] - '0') << 3) | (src[3] - '0'));
+			src += 4;
+		} else {
+			*dst = *src;
+			src++;
+		}
+		dst++;
+	}
+	*dst = '\0';
+}
+// Cut the next space-separated field from *p.
+static char *next_field(char **_Nonnull p)
+{
+	/*
+	 * Return the field and move *p to the start of the next field.
+	 * Return NULL if there is no more field.
+	 */
+	char *start = *p;
+	if (start == NULL || *start == '\0') {
+		return NULL;
+	}
+	char *end = strchr(start, ' ');
+	if (end == NULL) {
+		*p = start + strlen(start);
+	} else {
+		*end = '\0';
+		*p = end + 1;
+	}
+	return start;
+}
+// Parse a single line of mountinfo.
+static bool parse_mountinfo_line(char *_Nonnull line, struct RURI_MOUNTINFO_ENTRY *_Nonnull entry)
+{
+	/*
+	 * mountinfo format:
+	 * mount_id parent_id major:minor root mount_point options [optional fields...] - fstype source super_options
+	 * Return false if the line is broken.
+	 */
+	char *p = line;
+	char *field = next_field(&p);
+	if (field == NULL) {
+		return false;
+	}
+	entry->mount_id = atoi(field);
+	field = next_field(&p);
+	if (field == NULL) {
+		return false;
+	}
+	entry->parent_id = atoi(field);
+	field = next_field(&p);
+	if (field == NULL) {
+		return false;
+	}
+	unsigned int major_id = 0;
+	unsigned int minor_id = 0;
+	if (sscanf(field, "%u:%u", &major_id, &minor_id) != 2) {
+		return false;
+	}
+	entry->dev = makedev(major_id, minor_id);
+	entry->root = next_field(&p);
+	entry->mount_point = next_field(&p);
+	entry->options = next_field(&p);
+	if (entry->root == NULL || entry->mount_point == NULL || entry->options == NULL) {
+		return false;
+	}
+	// Skip optional fields, they end with a single `-`.
+	while ((field = next_field(&p)) != NULL) {
+		if (strcmp(field, "-") == 0) {
+			break;
+		}
+	}
+	if (field == NULL) {
+		return false;
+	}
+	entry->fs_type = next_field(&p);
+	entry->source = next_field(&p);
+	entry->super_options = next_field(&p);
+	if (entry->fs_type == NULL || entry->source == NULL) {
+		return false;
+	}
+	if (entry->super_options == NULL) {
+		entry->super_options = "";
+	}
+	decode_octal_escape(entry->root);
+	decode_octal_escape(entry->mount_point);
+	decode_octal_escape(entry->source);
+	return true;
+}
+// For qsort_r(3).
+static int compare_mount_point(const void *_Nonnull a, const void *_Nonnull b, void *_Nonnull arg)
+{
+	/*
+	 * Sort by mount point, and keep the mount order for the same mount point,
+	 * so that the last one is the top of the mount stack.
+	 */
+	const struct RURI_MOUNTINFO_ENTRY *entries = arg;
+	size_t ia = *(const size_t *)a;
+	size_t ib = *(const size_t *)b;
+	int ret = strcmp(entries[ia].mount_point, entries[ib].mount_point);
+	if (ret != 0) {
+		return ret;
+	}
+	return (ia > ib) - (ia < ib);
+}
+// Read and parse /proc/<pid>/mountinfo.
+struct RURI_MOUNTINFO *ruri_read_mountinfo(pid_t pid)
+{
+	/*
+	 * Read /proc/<pid>/mountinfo, or /proc/self/mountinfo if pid <= 0.
+	 * Return NULL if failed.
+	 * Warning: ruri_free_mountinfo() after use.
+	 */
+	char path[PATH_MAX] = { '\0' };
+	if (pid > 0) {
+		sprintf(path, "/proc/%d/mountinfo", pid);
+	} else {
+		sprintf(path, "/proc/self/mountinfo");
+	}
+	size_t len = 0;
+	char *buf = read_proc_file(path, &len);
+	if (buf == NULL) {
+		return NULL;
+	}
+	// Count lines first, so that we only need one malloc() for entries.
+	size_t lines = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (buf[i] == '\n') {
+			lines++;
+		}
+	}
+	struct RURI_MOUNTINFO *info = malloc(sizeof(struct RURI_MOUNTINFO));
+	if (info == NULL) {
+		free(buf);
+		return NULL;
+	}
+	info->buf = buf;
+	info->count = 0;
+	info->entries = malloc(sizeof(struct RURI_MOUNTINFO_ENTRY) * (lines + 1));
+	info->sorted = malloc(sizeof(size_t) * (lines + 1));
+	if (info->entries == NULL || info->sorted == NULL) {
+		ruri_free_mountinfo(info);
+		return NULL;
+	}
+	char *line = buf;
+	while (line != NULL && *line != '\0') {
+		char *end = strchr(line, '\n');
+		if (end != NULL) {
+			*end = '\0';
+		}
+		if (parse_mountinfo_line(line, &info->entries[info->count])) {
+			info->sorted[info->count] = info->count;
+			info->count++;
+		} else {
+			ruri_log("{base}Broken line in %s, ignored\n", path);
+		}
+		line = (end == NULL) ? NULL : end + 1;
+	}
+	qsort_r(info->sorted, info->count, sizeof(size_t), compare_mount_point, info->entries);
+	ruri_log("{base}Read %zu mount records from %s\n", info->count, path);
+	return info;
+}
+void ruri_free_mountinfo(struct RURI_MOUNTINFO *_Nullable info)
+{
+	if (info == NULL) {
+		return;
+	}
+	free(info->entries);
+	free(info->sorted);
+	free(info->buf);
+	free(info);
+}
+// Get the first position in info->sorted with mount_point >= key.
+static size_t lower_bound(const struct RURI_MOUNTINFO *_Nonnull info, const char *_Nonnull key)
+{
+	size_t low = 0;
+	size_t high = info->count;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (strcmp(info->entries[info->sorted[mid]].mount_point, key) < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+// Find the first mount with fs_type.
+struct RURI_MOUNTINFO_ENTRY *ruri_mountinfo_find_fstype(const struct RURI_MOUNTINFO *_Nonnull info, const char *_Nonnull fs_type)
+{
+	/*
+	 * Only mounts of the root of the filesystem are matched,
+	 * bind mounts of its subdirectories are skipped.
+	 */
+	for (size_t i = 0; i < info->count; i++) {
+		if (strcmp(info->entries[i].fs_type, fs_type) == 0 && strcmp(info->entries[i].root, "/") == 0) {
+			return &info->entries[i];
+		}
+	}
+	return NULL;
+}
+// For qsort(3), newest mount first.
+static int compare_entry_desc(const void *_Nonnull a, const void *_Nonnull b)
+{
+	const struct RURI_MOUNTINFO_ENTRY *ea = *(struct RURI_MOUNTINFO_ENTRY *const *)a;
+	const struct RURI_MOUNTINFO_ENTRY *eb = *(struct RURI_MOUNTINFO_ENTRY *const *)b;
+	return (ea < eb) - (ea > eb);
+}
+// Get all mounts on dir and under dir.
+struct RURI_MOUNTINFO_ENTRY **ruri_mountinfo_under(const struct RURI_MOUNTINFO *_Nonnull info, const char *_Nonnull dir, size_t *_Nonnull count)
+{
+	/*
+	 * Return a NULL-terminated list of records whose mount point is dir,
+	 * or starts with `dir/`.
+	 * `/foobar` will not match `/foo`.
+	 * The list is in reverse mount order, so we can umount them one by one.
+	 * Warning: free() the list after use, but not the records.
+	 */
+	size_t dirlen = strlen(dir);
+	// Remove the trailing '/' of dir.
+	while (dirlen > 1 && dir[dirlen - 1] == '/') {
+		dirlen--;
+	}
+	char *prefix = malloc(dirlen + 2);
+	memcpy(prefix, dir, dirlen);
+	prefix[dirlen] = '\0';
+	struct RURI_MOUNTINFO_ENTRY **ret = malloc(sizeof(struct RURI_MOUNTINFO_ENTRY *) * (info->count + 1));
+	*count = 0;
+	// Mounts on dir itself.
+	for (size_t i = lower_bound(info, prefix); i < info->count; i++) {
+		if (strcmp(info->entries[info->sorted[i]].mount_point, prefix) != 0) {
+			break;
+		}
+		ret[(*count)++] = &info->entries[info->sorted[i]];
+	}
+	// Mounts under dir, all of them are continuous in the sorted index.
+	// For `/`, the prefix is `/` itself and matches every record,
+	// including the ones on `/` found above, so drop them to avoid duplicates.
+	if (strcmp(prefix, "/") == 0) {
+		*count = 0;
+	} else {
+		prefix[dirlen] = '/';
+		prefix[dirlen + 1] = '\0';
+		dirlen++;
+	}
+	for (size_t i = lower_bound(info, prefix); i < info->count; i++) {
+		if (strncmp(info->entries[info->sorted[i]].mount_point, prefix, dirlen) != 0) {
+			break;
+		}
+		ret[(*count)++] = &info->entries[info->sorted[i]];
+	}
+	free(prefix);
+	qsort(ret, *count, sizeof(struct RURI_MOUNTINFO_ENTRY *), compare_entry_desc);
+	ret[*count] = NULL;
+	return ret;
+}
@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: MIT
+/*
+ *
+ * This file is part of ruri, with ABSOLUTELY NO WARRANTY.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022-2024 Moe-hacker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+#include "include/ruri.h"
+/*
+ * This file provides a process tracker based on the kernel proc connector.
+ * We subscribe to PROC_EVENT_FORK/EXEC/EXIT by NETLINK_CONNECTOR,
+ * (this is local, no network is needed), and keep a live table of pids
+ * belong to the container, so that forks during killing and sampling
+ * can be caught without rescanning /proc.
+ * It needs CAP_NET_ADMIN and CONFIG_PROC_EVENTS,
+ * if not available, the caller should fallback to polling /proc.
+ */
+// Find pid in the sorted table, return the position to insert if not found.
+static size_t tracker_search(const struct RURI_PROC_TRACKER *_Nonnull tracker, pid_t pid, bool *_Nonnull found)
+{
+	size_t low = 0;
+	size_t high = tracker->count;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (tracker->pids[mid] < pid) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	*found = (low < tracker->count && tracker->pids[low] == pid);
+	return low;
+}
+bool ruri_proc_tracker_has(const struct RURI_PROC_TRACKER *_Nonnull tracker, pid_t pid)
+{
+	bool found = false;
+	tracker_search(tracker, pid, &found);
+	return found;
+}
+void ruri_proc_tracker_add(struct RURI_PROC_TRACKER *_Nonnull tracker, pid_t pid)
+{
+	bool found = false;
+	size_t pos = tracker_search(tracker, pid, &found);
+	if (found) {
+		return;
+	}
+	if (tracker->count == tracker->size) {
+		tracker->size *= 2;
+		tracker->pids = realloc(tracker->pids, sizeof(pid_t) * tracker->size);
+	}
+	memmove(&tracker->pids[pos + 1], &tracker->pids[pos], sizeof(pid_t) * (tracker->count - pos));
+	tracker->pids[pos] = pid;
+	tracker->count++;
+}
+static void tracker_del(struct RURI_PROC_TRACKER *_Nonnull tracker, pid_t pid)
+{
+	bool found = false;
+	size_t pos = tracker_search(tracker, pid, &found);
+	if (!found) {
+		return;
+	}
+	memmove(&tracker->pids[pos], &tracker->pids[pos + 1], sizeof(pid_t) * (tracker->count - pos - 1));
+	tracker->count--;
+}
+static int send_mcast_op(int sock, enum proc_cn_mcast_op op)
+{
+	/*
+	 * Tell the proc connector to start or stop sending events.
+	 */
+	char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+	memset(buf, 0, sizeof(buf));
+	struct nlmsghdr *nl_hdr = (struct nlmsghdr *)buf;
+	struct cn_msg *cn_hdr = (struct cn_msg *)NLMSG_DATA(nl_hdr);
+	nl_hdr->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+	nl_hdr->nlmsg_type = NLMSG_DONE;
+	nl_hdr->nlmsg_pid = (__u32)getpid();
+	cn_hdr->id.idx = CN_IDX_PROC;
+	cn_hdr->id.val = CN_VAL_PROC;
+	cn_hdr->len = sizeof(enum proc_cn_mcast_op);
+	memcpy(cn_hdr->data, &op, sizeof(op));
+	if (send(sock, buf, nl_hdr->nlmsg_len, 0) < 0) {
+		return -1;
+	}
+	return 0;
+}
+// Subscribe to the proc connector.
+struct RURI_PROC_TRACKER *ruri_proc_tracker_new(void)
+{
+	/*
+	 * Return NULL if proc connector is not available.
+	 * Subscribe before enumerating the pids of container,
+	 * so that no fork will be missed.
+	 * Warning: ruri_proc_tracker_free() after use.
+	 */
+	int sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_CONNECTOR);
+	if (sock < 0) {
+		ruri_log("{base}NETLINK_CONNECTOR is not available\n");
+		return NULL;
+	}
+	struct sockaddr_nl addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = CN_IDX_PROC;
+	addr.nl_pid = 0;
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || send_mcast_op(sock, PROC_CN_MCAST_LISTEN) < 0) {
+		ruri_log("{base}Failed to subscribe to proc connector\n");
+		close(sock);
+		return NULL;
+	}
+	// Make the receive buffer larger, so that a fork bomb will not overrun it soon.
+	int rcvbuf = 1024 * 1024;
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	struct RURI_PROC_TRACKER *tracker = malloc(sizeof(struct RURI_PROC_TRACKER));
+	tracker->sock = sock;
+	tracker->size = 64;
+	tracker->count = 0;
+	tracker->pids = malloc(sizeof(pid_t) * tracker->size);
+	ruri_log("{base}Subscribed to proc connector\n");
+	return tracker;
+}
+void ruri_proc_tracker_free(struct RURI_PROC_TRACKER *_Nullable tracker)
+{
+	if (tracker == NULL) {
+		return;
+	}
+	send_mcast_op(tracker->sock, PROC_CN_MCAST_IGNORE);
+	close(tracker->sock);
+	free(tracker->pids);
+	free(tracker);
+}
+static int handle_event(struct RURI_PROC_TRACKER *_Nonnull tracker, const struct proc_event *_Nonnull ev)
+{
+	/*
+	 * Update the table, return 1 if the table is changed.
+	 */
+	switch (ev->what) {
+	case PROC_EVENT_FORK:
+		// Ignore new threads, we only track processes.
+		if (ev->event_data.fork.child_pid != ev->event_data.fork.child_tgid) {
+			return 0;
+		}
+		if (ruri_proc_tracker_has(tracker, ev->event_data.fork.parent_tgid)) {
+			ruri_log("{base}Fork: %d -> %d\n", ev->event_data.fork.parent_tgid, ev->event_data.fork.child_tgid);
+			ruri_proc_tracker_add(tracker, ev->event_data.fork.child_tgid);
+			return 1;
+		}
+		return 0;
+	case PROC_EVENT_EXEC:
+		// The pid does not change after exec(3), but the name and stat do.
+		return ruri_proc_tracker_has(tracker, ev->event_data.exec.process_tgid) ? 1 : 0;
+	case PROC_EVENT_EXIT:
+		if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid) {
+			return 0;
+		}
+		if (ruri_proc_tracker_has(tracker, ev->event_data.exit.process_tgid)) {
+			ruri_log("{base}Exit: %d\n", ev->event_data.exit.process_tgid);
+			tracker_del(tracker, ev->event_data.exit.process_tgid);
+			return 1;
+		}
+		return 0;
+	default:
+		return 0;
+	}
+}
+// Receive events and update the table.
+int ruri_proc_tracker_poll(struct RURI_PROC_TRACKER *_Nonnull tracker, int timeout_ms)
+{
+	/*
+	 * Wait at most timeout_ms for events, and handle all queued events.
+	 * Return the number of events that changed the table,
+	 * or -1 if events are lost (the socket buffer overrun),
+	 * then the caller should enumerate the pids again.
+	 */
+	struct pollfd pfd = { .fd = tracker->sock, .events = POLLIN };
+	if (poll(&pfd, 1, timeout_ms) <= 0) {
+		return 0;
+	}
+	int ret = 0;
+	char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+	while (true) {
+		ssize_t len = recv(tracker->sock, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == ENOBUFS) {
+				ruri_log("{base}Proc connector overrun\n");
+				return -1;
+			}
+			break;
+		}
+		for (struct nlmsghdr *nl_hdr = (struct nlmsghdr *)buf; NLMSG_OK(nl_hdr, (size_t)len); nl_hdr = NLMSG_NEXT(nl_hdr, len)) {
+			if (nl_hdr->nlmsg_type == NLMSG_ERROR || nl_hdr->nlmsg_type == NLMSG_NOOP) {
+				continue;
+			}
+			const struct cn_msg *cn_hdr = NLMSG_DATA(nl_hdr);
+			if (cn_hdr->id.idx != CN_IDX_PROC || cn_hdr->id.val != CN_VAL_PROC) {
+				continue;
+			}
+			ret += handle_event(tracker, (const struct proc_event *)cn_hdr->data);
+		}
+	}
+	return ret;
+}
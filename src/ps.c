@@ -30,257 +30,343 @@
 #include "include/ruri.h"
 /*
  * This file provides functions to show or kill all processes in the container.
+ * The processes are got from the cgroup of the container first,
+ * then the process tree of ns_pid, and scanning /proc is the last choice.
  * Note:
- * For unshare container without pid ns,
+ * For unshare container without pid ns and cgroup,
  * we can not recognize the pids in container.
  * And for that with pid ns, just kill pid 1 of the ns,
  * and all processes will be destroyed.
  */
-static char *getpid_name(pid_t pid)
+// Read /proc/pid/stat.
+bool ruri_read_proc_stat(pid_t pid, struct RURI_PROC_STAT *_Nonnull st)
 {
 	/*
-	 * Get the name of the process by pid.
-	 * Warning: free() the return value after using it.
+	 * Read /proc/pid/stat only once, and parse the fields we need.
+	 * Return false if the process does not exist.
 	 */
 	char path[PATH_MAX];
-	sprintf(path, "%s%d%s", "/proc/", pid, "/stat");
-	char buf[8192];
-	char name_buf[PATH_MAX];
+	sprintf(path, "/proc/%d/stat", pid);
 	int fd = open(path, O_RDONLY | O_CLOEXEC);
-	read(fd, buf, sizeof(buf));
 	if (fd < 0) {
-		return strdup(" ");
+		return false;
 	}
-	int j = 0;
-	for (unsigned long i = 0; i < sizeof(buf); i++) {
-		if (j == 1) {
-			for (unsigned long k = 0; buf[k + i + 1] != ')'; k++) {
-				name_buf[k] = buf[k + i + 1];
-				name_buf[k + 1] = '\0';
-			}
-			break;
-		}
-		if (buf[i] == ' ') {
-			j++;
-		}
+	char buf[1024];
+	ssize_t len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0) {
+		return false;
+	}
+	buf[len] = '\0';
+	// The name of process might contain ' ' and ')',
+	// so we use the last ')' as the end of name.
+	char *name_start = strchr(buf, '(');
+	char *name_end = strrchr(buf, ')');
+	if (name_start == NULL || name_end == NULL || name_end < name_start) {
+		return false;
+	}
+	memset(st, 0, sizeof(struct RURI_PROC_STAT));
+	st->pid = pid;
+	size_t name_len = (size_t)(name_end - name_start - 1);
+	if (name_len >= sizeof(st->comm)) {
+		name_len = sizeof(st->comm) - 1;
 	}
-	char *name = strdup(name_buf);
-	return name;
+	memcpy(st->comm, name_start + 1, name_len);
+	st->comm[name_len] = '\0';
+	// Fields after name: state ppid pgrp session tty_nr tpgid flags minflt cminflt majflt cmajflt
+	// utime stime cutime cstime priority nice num_threads itrealvalue starttime vsize rss.
+	int ret = sscanf(name_end + 2, "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %ld %*d %llu %*u %ld", &st->state, &st->ppid, &st->utime, &st->stime, &st->num_threads, &st->starttime, &st->rss);
+	return ret >= 2;
 }
-static char *getpid_stat(pid_t pid)
+// For qsort(3) and bsearch(3).
+static int compare_pid(const void *_Nonnull a, const void *_Nonnull b)
+{
+	pid_t pa = *(const pid_t *)a;
+	pid_t pb = *(const pid_t *)b;
+	return (pa > pb) - (pa < pb);
+}
+static pid_t *get_pid_tree(pid_t ns_pid, size_t *_Nonnull count)
 {
 	/*
-	 * Get the status of the process by pid.
-	 * Warning: free() the return value after using it.
+	 * Get ns_pid and all its descendants,
+	 * by walking /proc/pid/task/tid/children.
+	 * Return NULL if /proc/ns_pid/task/ns_pid/children is not readable,
+	 * that means CONFIG_PROC_CHILDREN is not enabled or ns_pid is dead.
+	 * Warning: free() after use.
 	 */
 	char path[PATH_MAX];
-	sprintf(path, "%s%d%s", "/proc/", pid, "/stat");
-	char buf[8192];
-	char stat_buf[PATH_MAX];
-	int fd = open(path, O_RDONLY | O_CLOEXEC);
-	if (fd < 0) {
-		return strdup(" ");
+	sprintf(path, "/proc/%d/task/%d/children", ns_pid, ns_pid);
+	if (access(path, R_OK) != 0) {
+		return NULL;
 	}
-	read(fd, buf, sizeof(buf));
-	int j = 0;
-	for (unsigned long i = 0; i < sizeof(buf); i++) {
-		if (j == 2) {
-			for (unsigned long k = 0; buf[k + i] != ' '; k++) {
-				stat_buf[k] = buf[k + i];
-				stat_buf[k + 1] = '\0';
-			}
-			break;
+	size_t size = 64;
+	pid_t *ret = malloc(sizeof(pid_t) * size);
+	ret[0] = ns_pid;
+	*count = 1;
+	// BFS, ret[] is also the queue.
+	for (size_t i = 0; i < *count; i++) {
+		sprintf(path, "/proc/%d/task", ret[i]);
+		DIR *task_dir = opendir(path);
+		if (task_dir == NULL) {
+			continue;
 		}
-		if (buf[i] == ' ') {
-			j++;
+		struct dirent *file = NULL;
+		while ((file = readdir(task_dir)) != NULL) {
+			if (atoi(file->d_name) <= 0) {
+				continue;
+			}
+			sprintf(path, "/proc/%d/task/%s/children", ret[i], file->d_name);
+			int fd = open(path, O_RDONLY | O_CLOEXEC);
+			if (fd < 0) {
+				continue;
+			}
+			char buf[4096];
+			ssize_t len = 0;
+			// A pid might be split by two read(2), so we keep the remainder.
+			size_t remain = 0;
+			while ((len = read(fd, buf + remain, sizeof(buf) - remain - 1)) > 0) {
+				buf[remain + (size_t)len] = '\0';
+				char *p = buf;
+				char *end = NULL;
+				while (true) {
+					long pid = strtol(p, &end, 10);
+					if (end == p || *end == '\0') {
+						break;
+					}
+					if (*count == size) {
+						size *= 2;
+						ret = realloc(ret, sizeof(pid_t) * size);
+					}
+					ret[*count] = (pid_t)pid;
+					(*count)++;
+					p = end;
+					while (*p == ' ') {
+						p++;
+					}
+				}
+				remain = strlen(p);
+				memmove(buf, p, remain);
+			}
+			close(fd);
 		}
+		closedir(task_dir);
 	}
-	char *pid_status = strdup(stat_buf);
-	return pid_status;
+	return ret;
 }
-static void test_and_print_pid(pid_t pid, char *_Nonnull container_dir, bool in_pid_ns)
+static pid_t *scan_proc(const char *_Nonnull container_dir, size_t *_Nonnull count)
 {
 	/*
-	 * If /proc/pid/root is container_dir, print the pid.
+	 * Scan /proc, get the pids that /proc/pid/root is container_dir.
+	 * This is the fallback of ruri_get_container_pids().
+	 * Warning: free() after use.
 	 */
+	size_t size = 64;
+	pid_t *ret = malloc(sizeof(pid_t) * size);
+	*count = 0;
+	DIR *proc_dir = opendir("/proc");
+	if (proc_dir == NULL) {
+		return ret;
+	}
+	struct dirent *file = NULL;
 	char path[PATH_MAX];
-	sprintf(path, "%s%d%s", "/proc/", pid, "/root");
 	char buf[PATH_MAX];
-	realpath(path, buf);
-	ruri_log("{base}Pid: {cyan}%d\n", pid);
-	ruri_log("{base}Root: {cyan}%s\n", buf);
-	if (strcmp(buf, container_dir) == 0) {
-		char *name = getpid_name(pid);
-		char *pid_status = getpid_stat(pid);
-		if (name != NULL && pid_status != NULL) {
-			if (in_pid_ns) {
-				printf("--> %d %s %s\n", pid, name, pid_status);
-			} else {
-				printf("%d %s %s\n", pid, name, pid_status);
-			}
+	while ((file = readdir(proc_dir)) != NULL) {
+		if (file->d_type != DT_DIR || atoi(file->d_name) <= 0) {
+			continue;
 		}
-		free(name);
-		free(pid_status);
+		pid_t pid = atoi(file->d_name);
+		ruri_log("{base}Checking pid: {cyan}%d\n", pid);
+		sprintf(path, "/proc/%d/root", pid);
+		buf[0] = '\0';
+		if (realpath(path, buf) == NULL || strcmp(buf, container_dir) != 0) {
+			continue;
+		}
+		if (*count == size) {
+			size *= 2;
+			ret = realloc(ret, sizeof(pid_t) * size);
+		}
+		ret[*count] = pid;
+		(*count)++;
 	}
+	closedir(proc_dir);
+	return ret;
 }
-static void container_ps__(char *_Nonnull container_dir, bool in_pid_ns)
+// Get the pids of container.
+pid_t *ruri_get_container_pids(const char *_Nonnull container_dir, const struct RURI_CONTAINER *_Nonnull container, size_t *_Nonnull count)
 {
 	/*
-	 * Show the processes in the container.
-	 * This is the core function of ruri_container_ps().
+	 * Get the host pids of all processes in container.
+	 * container is the struct returned by ruri_read_info(NULL, container_dir).
+	 * We try:
+	 * 1. cgroup.procs of the cgroup of container.
+	 * 2. The process tree of ns_pid.
+	 * 3. Scanning /proc for processes whose root is container_dir.
+	 * The return value is sorted.
+	 * Warning: free() after use.
 	 */
-	DIR *proc_dir = opendir("/proc");
-	struct dirent *file = NULL;
-	int len = 0;
-	while ((file = readdir(proc_dir)) != NULL) {
-		if (file->d_type == DT_DIR) {
-			len++;
-		}
-	}
-	seekdir(proc_dir, 0);
-	int pids[len + 11];
-	// For passing clang-tidy.
-	memset(pids, 0, sizeof(pids));
-	int i = 0;
-	while ((file = readdir(proc_dir)) != NULL) {
-		if (file->d_type == DT_DIR) {
-			if (atoi(file->d_name) > 0) {
-				pids[i] = atoi(file->d_name);
-				pids[i + 1] = RURI_INIT_VALUE;
-				i++;
+	pid_t *ret = NULL;
+	*count = 0;
+	struct RURI_MOUNTINFO *info = ruri_read_mountinfo(0);
+	if (info != NULL) {
+		const char *controllers[] = { NULL, "memory", "cpu", "cpuset" };
+		for (size_t i = 0; i < sizeof(controllers) / sizeof(controllers[0]) && ret == NULL; i++) {
+			int cgroup_fd = ruri_open_cgroup(container, info, controllers[i]);
+			if (cgroup_fd < 0) {
+				continue;
 			}
+			ret = ruri_read_cgroup_procs(cgroup_fd, count);
+			close(cgroup_fd);
+			ruri_log("{base}Got %zu pids from cgroup %s\n", *count, controllers[i] == NULL ? "v2" : controllers[i]);
 		}
+		ruri_free_mountinfo(info);
 	}
-	for (int j = 0; j < len; j++) {
-		if (pids[j] != RURI_INIT_VALUE) {
-			ruri_log("{base}Checking pid: {cyan}%d\n", pids[j]);
-			test_and_print_pid(pids[j], container_dir, in_pid_ns);
-		} else {
-			break;
-		}
+	if (ret == NULL && container->ns_pid > 0) {
+		ret = get_pid_tree(container->ns_pid, count);
+		ruri_log("{base}Got %zu pids from the process tree of ns_pid\n", *count);
 	}
-	closedir(proc_dir);
+	if (ret == NULL) {
+		ret = scan_proc(container_dir, count);
+		ruri_log("{base}Got %zu pids by scanning /proc\n", *count);
+	}
+	qsort(ret, *count, sizeof(pid_t), compare_pid);
+	return ret;
 }
-static int join_ns(pid_t ns_pid)
+static void print_pid_tree(const struct RURI_PROC_STAT *_Nonnull stats, size_t count, pid_t ppid, int depth)
 {
 	/*
-	 * Try to join the pid and mount namespace of the container.
-	 * If failed, return -1.
+	 * Print processes whose parent is ppid, and their children.
+	 * stats[] is sorted by pid.
 	 */
-	if (geteuid() != 0) {
-		ruri_error("{red}Error: Please run `ruri -P` with sudo.\n");
-	}
-	char path[PATH_MAX];
-	sprintf(path, "%s%d%s", "/proc/", ns_pid, "/ns/pid");
-	int fd = open(path, O_RDONLY | O_CLOEXEC);
-	if (fd < 0) {
-		return -1;
-	}
-	setns(fd, 0);
-	close(fd);
-	ruri_log("{base}Joined pid namespace\n");
-	sprintf(path, "%s%d%s", "/proc/", ns_pid, "/ns/mnt");
-	fd = open(path, O_RDONLY | O_CLOEXEC);
-	if (fd < 0) {
-		return -1;
+	for (size_t i = 0; i < count; i++) {
+		if (stats[i].ppid != ppid || stats[i].pid == ppid) {
+			continue;
+		}
+		printf("%d ", stats[i].pid);
+		for (int j = 1; j < depth; j++) {
+			printf("    ");
+		}
+		if (depth > 0) {
+			printf("`-- ");
+		}
+		printf("%s %c\n", stats[i].comm, stats[i].state);
+		// The depth of process tree is limited by pid_max, but let's be careful.
+		if (depth < 64) {
+			print_pid_tree(stats, count, stats[i].pid, depth + 1);
+		}
 	}
-	setns(fd, 0);
-	close(fd);
-	chdir("/");
-	ruri_log("{base}Joined mount namespace\n");
-	return 0;
 }
 void ruri_container_ps(char *_Nonnull container_dir)
 {
 	/*
-	 * Show the processes in the container.
-	 * We check the root of each process, if it is the container directory, print the pid.
-	 * if this is an unshare container, join the pid and mount namespace, so root is "/" now.
-	 * if pid namespace is not supported, fallback to the behavior with common container.
+	 * Show the processes in the container as a process tree.
+	 * The output format is `pid name state`,
+	 * and child processes are indented after its parent.
 	 */
 	ruri_log("{base}Container directory: {cyan}%s\n", container_dir);
 	if (geteuid() != 0) {
 		ruri_warning("{yellow}Warning: Please run `ruri -P` with sudo.\n");
 	}
 	struct RURI_CONTAINER *container = ruri_read_info(NULL, container_dir);
-	bool in_pid_ns = false;
-	if (container->ns_pid > 0) {
-		// We need to get the info of ns_pid before joining the namespace.
-		char *name = getpid_name(container->ns_pid);
-		char *pid_status = getpid_stat(container->ns_pid);
-		if (join_ns(container->ns_pid) == 0) {
-			printf("%d %s %s\n", container->ns_pid, name, pid_status);
-			in_pid_ns = true;
-			// If we successfully joined the namespace,
-			// The root of the process is now "/".
-			container_dir = "/";
+	size_t count = 0;
+	pid_t *pids = ruri_get_container_pids(container_dir, container, &count);
+	// Read /proc/pid/stat only once for each pid.
+	struct RURI_PROC_STAT *stats = malloc(sizeof(struct RURI_PROC_STAT) * (count + 1));
+	size_t alive = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (ruri_read_proc_stat(pids[i], &stats[alive])) {
+			alive++;
 		}
-		free(name);
-		free(pid_status);
 	}
-	container_ps__(container_dir, in_pid_ns);
+	// The roots of process tree are the processes whose parent is not in container.
+	for (size_t i = 0; i < alive; i++) {
+		pid_t ppid = stats[i].ppid;
+		if (bsearch(&ppid, pids, count, sizeof(pid_t), compare_pid) == NULL) {
+			printf("%d %s %c\n", stats[i].pid, stats[i].comm, stats[i].state);
+			print_pid_tree(stats, alive, stats[i].pid, 1);
+		}
+	}
+	free(stats);
+	free(pids);
 	free(container);
 	exit(EXIT_SUCCESS);
 }
-static bool is_container_process(pid_t pid, const char *_Nonnull container_dir)
+// For qsort(3) and bsearch(3).
+static int compare_string(const void *_Nonnull a, const void *_Nonnull b)
 {
-	/*
-	 * Check if the process is in the container.
-	 */
-	char path[PATH_MAX];
-	sprintf(path, "%s%d%s", "/proc/", pid, "/root");
-	char buf[PATH_MAX];
-	buf[0] = '\0';
-	realpath(path, buf);
-	if (strcmp(buf, "/") == 0) {
-		return false;
-	}
-	if (strcmp(buf, container_dir) == 0) {
-		return true;
-	}
-	return false;
+	return strcmp(*(const char *const *)a, *(const char *const *)b);
 }
-void ruri_kill_container(const char *_Nonnull container_dir)
+void ruri_kill_containers(const char *const *_Nonnull container_dirs, int count)
 {
 	/*
 	 *
 	 * Check all the processes in /proc,
-	 * If the process is in the container, kill it.
+	 * If the process is in one of the containers, kill it.
 	 * We check for /proc/pid/root to determine if the process is in the container.
-	 * This function is called by ruri_umount_container().
+	 * /proc is scanned only once for all containers.
+	 * This function is called by ruri_umount_container() and ruri_umount_containers().
 	 */
+	if (count <= 0) {
+		return;
+	}
+	// Sort the container list, so we can use bsearch(3).
+	const char **dirs = malloc(sizeof(char *) * (size_t)count);
+	memcpy(dirs, container_dirs, sizeof(char *) * (size_t)count);
+	qsort(dirs, (size_t)count, sizeof(char *), compare_string);
+	// Subscribe to proc connector before scanning,
+	// so that we can kill the processes forked while we are killing.
+	struct RURI_PROC_TRACKER *tracker = ruri_proc_tracker_new();
 	DIR *proc_dir = opendir("/proc");
+	if (proc_dir == NULL) {
+		ruri_proc_tracker_free(tracker);
+		free(dirs);
+		return;
+	}
 	struct dirent *file = NULL;
-	int len = 0;
+	char path[PATH_MAX];
+	char buf[PATH_MAX];
 	while ((file = readdir(proc_dir)) != NULL) {
-		if (file->d_type == DT_DIR) {
-			len++;
+		if (file->d_type != DT_DIR || atoi(file->d_name) <= 0) {
+			continue;
 		}
-	}
-	seekdir(proc_dir, 0);
-	int pids[len + 11];
-	// For passing clang-tidy.
-	memset(pids, 0, sizeof(pids));
-	int i = 0;
-	while ((file = readdir(proc_dir)) != NULL) {
-		if (file->d_type == DT_DIR) {
-			if (atoi(file->d_name) > 0) {
-				pids[i] = atoi(file->d_name);
-				pids[i + 1] = RURI_INIT_VALUE;
-				i++;
+		pid_t pid = atoi(file->d_name);
+		ruri_log("{base}Checking pid: {cyan}%d\n", pid);
+		sprintf(path, "%s%d%s", "/proc/", pid, "/root");
+		buf[0] = '\0';
+		if (realpath(path, buf) == NULL || strcmp(buf, "/") == 0) {
+			continue;
+		}
+		const char *key = buf;
+		if (bsearch(&key, dirs, (size_t)count, sizeof(char *), compare_string) != NULL) {
+			ruri_log("{base}Killing pid: {cyan}%d\n", pid);
+			kill(pid, SIGKILL);
+			if (tracker != NULL) {
+				ruri_proc_tracker_add(tracker, pid);
 			}
 		}
 	}
-	for (int j = 0; j < len; j++) {
-		if (pids[j] != RURI_INIT_VALUE) {
-			ruri_log("{base}Checking pid: {cyan}%d\n", pids[j]);
-			if (is_container_process(pids[j], container_dir)) {
-				ruri_log("{base}Killing pid: {cyan}%d\n", pids[j]);
-				kill(pids[j], SIGKILL);
-			}
-		} else {
+	closedir(proc_dir);
+	free(dirs);
+	// Kill the children forked by the processes we killed,
+	// until all of them exited, or there's no event for a while,
+	// (zombies will not send exit event again).
+	int idle = 0;
+	for (int i = 0; tracker != NULL && tracker->count > 0 && i < 100 && idle < 5; i++) {
+		int changed = ruri_proc_tracker_poll(tracker, 10);
+		if (changed < 0) {
 			break;
 		}
+		idle = (changed == 0) ? idle + 1 : 0;
+		for (size_t j = 0; j < tracker->count; j++) {
+			kill(tracker->pids[j], SIGKILL);
+		}
 	}
-	closedir(proc_dir);
+	ruri_proc_tracker_free(tracker);
+}
+void ruri_kill_container(const char *_Nonnull container_dir)
+{
+	/*
+	 * Kill all the processes in the container.
+	 * See ruri_kill_containers().
+	 */
+	ruri_kill_containers(&container_dir, 1);
 }
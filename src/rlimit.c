@@ -0,0 +1,191 @@
+// SPDX-License-Identifier: MIT
+/*
+ *
+ * This file is part of ruri, with ABSOLUTELY NO WARRANTY.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022-2024 Moe-hacker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+#include "include/ruri.h"
+/*
+ * This file sets the resource limits of the container process,
+ * they are inherited by all processes in container.
+ * Without it, container inherits the limits of the shell running ruri,
+ * like RLIMIT_NOFILE=1024.
+ * The limits are stored as `NAME=SOFT:HARD`, like `NOFILE=65536:65536`,
+ * SOFT and HARD are numbers or `unlimited`.
+ */
+static const struct {
+	const char *name;
+	int resource;
+} rlimit_names[] = {
+	{ "AS", RLIMIT_AS },
+	{ "CORE", RLIMIT_CORE },
+	{ "CPU", RLIMIT_CPU },
+	{ "DATA", RLIMIT_DATA },
+	{ "FSIZE", RLIMIT_FSIZE },
+	{ "LOCKS", RLIMIT_LOCKS },
+	{ "MEMLOCK", RLIMIT_MEMLOCK },
+	{ "MSGQUEUE", RLIMIT_MSGQUEUE },
+	{ "NICE", RLIMIT_NICE },
+	{ "NOFILE", RLIMIT_NOFILE },
+	{ "NPROC", RLIMIT_NPROC },
+	{ "RSS", RLIMIT_RSS },
+	{ "RTPRIO", RLIMIT_RTPRIO },
+	{ "RTTIME", RLIMIT_RTTIME },
+	{ "SIGPENDING", RLIMIT_SIGPENDING },
+	{ "STACK", RLIMIT_STACK },
+};
+static int get_rlimit_resource(const char *_Nonnull name, size_t len)
+{
+	/*
+	 * Return the RLIMIT_* value of name, or -1 if unknown.
+	 * Names are case insensitive, and `RLIMIT_` prefix is allowed.
+	 */
+	if (len > 7 && strncasecmp(name, "RLIMIT_", 7) == 0) {
+		name += 7;
+		len -= 7;
+	}
+	for (size_t i = 0; i < sizeof(rlimit_names) / sizeof(rlimit_names[0]); i++) {
+		if (strlen(rlimit_names[i].name) == len && strncasecmp(name, rlimit_names[i].name, len) == 0) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+static bool parse_rlimit_value(const char *_Nonnull str, size_t len, rlim_t *_Nonnull value)
+{
+	/*
+	 * `unlimited`, `infinity` and `-1` are RLIM_INFINITY.
+	 */
+	if ((len == 9 && strncmp(str, "unlimited", 9) == 0) || (len == 8 && strncmp(str, "infinity", 8) == 0) || (len == 2 && strncmp(str, "-1", 2) == 0)) {
+		*value = RLIM_INFINITY;
+		return true;
+	}
+	if (len == 0 || len > 20 || strspn(str, "0123456789") < len) {
+		return false;
+	}
+	char buf[32] = { '\0' };
+	memcpy(buf, str, len);
+	errno = 0;
+	*value = (rlim_t)strtoull(buf, NULL, 10);
+	return errno == 0;
+}
+static void format_rlimit_value(char *_Nonnull buf, rlim_t value)
+{
+	if (value == RLIM_INFINITY) {
+		strcpy(buf, "unlimited");
+	} else {
+		sprintf(buf, "%llu", (unsigned long long)value);
+	}
+}
+// Parse and normalize rlimit.
+char *ruri_parse_rlimit(const char *_Nonnull limit)
+{
+	/*
+	 * `nofile=1024:65536` -> `NOFILE=1024:65536`,
+	 * `memlock=unlimited` -> `MEMLOCK=unlimited:unlimited`.
+	 * Return NULL if limit is invalid, or soft limit is more than hard limit.
+	 */
+	const char *value = strchr(limit, '=');
+	if (value == NULL) {
+		return NULL;
+	}
+	int index = get_rlimit_resource(limit, (size_t)(value - limit));
+	if (index < 0) {
+		return NULL;
+	}
+	value++;
+	const char *hard = strchr(value, ':');
+	rlim_t soft_limit = 0;
+	rlim_t hard_limit = 0;
+	if (!parse_rlimit_value(value, hard == NULL ? strlen(value) : (size_t)(hard - value), &soft_limit)) {
+		return NULL;
+	}
+	if (hard == NULL) {
+		hard_limit = soft_limit;
+	} else if (!parse_rlimit_value(hard + 1, strlen(hard + 1), &hard_limit)) {
+		return NULL;
+	}
+	// RLIM_INFINITY is the largest value.
+	if (soft_limit > hard_limit) {
+		return NULL;
+	}
+	char soft_buf[32] = { '\0' };
+	char hard_buf[32] = { '\0' };
+	format_rlimit_value(soft_buf, soft_limit);
+	format_rlimit_value(hard_buf, hard_limit);
+	char *ret = malloc(strlen(rlimit_names[index].name) + strlen(soft_buf) + strlen(hard_buf) + 3);
+	sprintf(ret, "%s=%s:%s", rlimit_names[index].name, soft_buf, hard_buf);
+	return ret;
+}
+// Add rlimit to the list, the limit of the same resource is replaced.
+bool ruri_add_rlimit(char *_Nonnull list[], const char *_Nonnull limit)
+{
+	/*
+	 * Return false if limit is invalid or the list is full.
+	 */
+	char *parsed = ruri_parse_rlimit(limit);
+	if (parsed == NULL) {
+		return false;
+	}
+	size_t name_len = strcspn(parsed, "=") + 1;
+	int i = 0;
+	for (; list[i] != NULL; i++) {
+		if (strncmp(list[i], parsed, name_len) == 0) {
+			list[i] = parsed;
+			return true;
+		}
+	}
+	if (i >= RURI_MAX_RLIMITS) {
+		free(parsed);
+		return false;
+	}
+	list[i] = parsed;
+	list[i + 1] = NULL;
+	return true;
+}
+// Set rlimits of container.
+void ruri_set_rlimits(const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Called before the capabilities are dropped,
+	 * because raising hard limits needs CAP_SYS_RESOURCE.
+	 * NOFILE can not be more than /proc/sys/fs/nr_open.
+	 */
+	for (int i = 0; container->rlimits[i] != NULL; i++) {
+		const char *value = strchr(container->rlimits[i], '=');
+		const char *hard = value == NULL ? NULL : strchr(value, ':');
+		int index = value == NULL ? -1 : get_rlimit_resource(container->rlimits[i], (size_t)(value - container->rlimits[i]));
+		struct rlimit rlim;
+		if (index < 0 || hard == NULL || !parse_rlimit_value(value + 1, (size_t)(hard - value - 1), &rlim.rlim_cur) || !parse_rlimit_value(hard + 1, strlen(hard + 1), &rlim.rlim_max)) {
+			ruri_warning("{yellow}Warning: invalid rlimit %s{clear}\n", container->rlimits[i]);
+			continue;
+		}
+		ruri_log("{base}Set RLIMIT_%s to %s\n", rlimit_names[index].name, value + 1);
+		if (setrlimit(rlimit_names[index].resource, &rlim) != 0 && !container->no_warnings) {
+			ruri_warning("{yellow}Warning: failed to set RLIMIT_%s to %s: %s{clear}\n", rlimit_names[index].name, value + 1, strerror(errno));
+		}
+	}
+}
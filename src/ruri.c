@@ -95,6 +95,10 @@ static void check_container(const struct RURI_CONTAINER *_Nonnull container)
 	if ((container->cross_arch == NULL) != (container->qemu_path == NULL)) {
 		ruri_error("{red}Error: --arch and --qemu-path should be set at the same time QwQ\n");
 	}
+	// `--seccomp-spec-allow` is only a flag of the seccomp filter.
+	if (container->seccomp_spec_allow && !container->enable_default_seccomp && container->seccomp_denied_syscall[0] == NULL && container->seccomp_profile == NULL && !container->no_warnings) {
+		ruri_warning("{yellow}Warning: --seccomp-spec-allow has no effect without -s, -X or --seccomp-profile\n");
+	}
 	for (int i = 0; container->extra_mountpoint[i] != NULL; i++) {
 		if (strlen(container->extra_mountpoint[i]) > PATH_MAX) {
 			ruri_error("{red}Error: mountpoint path is too long QwQ\n");
@@ -106,17 +110,43 @@ static void check_container(const struct RURI_CONTAINER *_Nonnull container)
 		}
 	}
 }
+static void check_cpu_burst(const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * The kernel refuses cpu.max.burst larger than the quota,
+	 * so check it here instead of failing when setting the limit.
+	 * `-l` options can be in any order, so it's checked after each of them.
+	 */
+	if (container->cpu_burst < 0) {
+		return;
+	}
+	long long quota = -1;
+	if (container->cpu_max != NULL) {
+		// `max` has no quota, so there's nothing to check.
+		if (sscanf(container->cpu_max, "%lld", &quota) != 1) {
+			return;
+		}
+	} else if (container->cpupercent > 0) {
+		// The period is 100000 for cpu=, see set_cpu_limit().
+		quota = (long long)container->cpupercent * 1000;
+	} else {
+		return;
+	}
+	if (container->cpu_burst > quota) {
+		ruri_error("{red}Error: cpu.max.burst %d should not be more than the cpu quota %lld QwQ\n", container->cpu_burst, quota);
+	}
+}
 static void parse_cgroup_settings(const char *_Nonnull str, struct RURI_CONTAINER *_Nonnull container)
 {
 	/*
 	 * Parse and set cgroup limit.
-	 * The format should be like `cpuset=1` or `memory=1M`.
-	 * We will not check if the config is valid.
+	 * The format should be like `cpuset=1`, `memory=1M`, `cpu=350%` or `io.max=/dev/sda:rbps=1048576`.
+	 * We will not check if the config is valid, except the device of I/O limits.
 	 */
-	char buf[16] = { '\0' };
+	char buf[32] = { '\0' };
 	char *limit = NULL;
 	// Get limit type.
-	for (size_t i = 0; i < 16; i++) {
+	for (size_t i = 0; i < sizeof(buf) - 1; i++) {
 		// Avoid overflow.
 		if (i >= strlen(str)) {
 			break;
@@ -132,18 +162,146 @@ static void parse_cgroup_settings(const char *_Nonnull str, struct RURI_CONTAINE
 		ruri_error("{red}Error: cgroup limit should be like `cpuset=1` or `memory=1M`\n");
 	}
 	if (strcmp("cpuset", buf) == 0) {
+		cpu_set_t set;
+		if (strncmp(limit, "auto:", 5) == 0 ? atoi(limit + 5) < 1 : !ruri_parse_cpu_list(limit, &set)) {
+			ruri_error("{red}Error: cpuset should be like `0-3,5` or `auto:4`\n");
+		}
 		container->cpuset = limit;
-	} else if (strcmp("memory", buf) == 0) {
-		container->memory = limit;
+	} else if (strcmp("memory", buf) == 0 || strncmp("memory.", buf, 7) == 0) {
+		unsigned long long bytes = 0;
+		if (!ruri_parse_memory_size(limit, &bytes)) {
+			ruri_error("{red}Error: invalid memory size %s, should be like `512M`, `2G`, `50%%` or `max`\n", limit);
+		}
+		if (strcmp("memory", buf) == 0 || strcmp("memory.max", buf) == 0) {
+			container->memory = limit;
+		} else if (strcmp("memory.high", buf) == 0) {
+			container->memory_high = limit;
+		} else if (strcmp("memory.low", buf) == 0) {
+			container->memory_low = limit;
+		} else if (strcmp("memory.min", buf) == 0) {
+			container->memory_min = limit;
+		} else if (strcmp("memory.swap.max", buf) == 0) {
+			container->memory_swap_max = limit;
+		} else if (strcmp("memory.zswap.max", buf) == 0) {
+			container->memory_zswap_max = limit;
+		} else {
+			ruri_error("{red}Unknown cgroup option %s\n", str);
+		}
 	} else if (strcmp("cpupercent", buf) == 0) {
 		container->cpupercent = atoi(limit);
 		free(limit);
-		if (container->cpupercent < 1 || container->cpupercent > 100) {
-			ruri_error("{red}Error: cpupercent should be in range 1-100\n");
+		// 100 means one core, so it can be more than 100.
+		if (container->cpupercent < 1) {
+			ruri_error("{red}Error: cpupercent should be a positive number\n");
+		}
+	} else if (strcmp("cpu", buf) == 0) {
+		// `350%` or `3.5`, both means 3.5 cores.
+		char *end = NULL;
+		double cpu = strtod(limit, &end);
+		// `!(cpu > 0)` is also true for NaN.
+		if (end == limit || (*end != '\0' && strcmp(end, "%") != 0) || !(cpu > 0)) {
+			ruri_error("{red}Error: cpu limit should be like `350%%` or `3.5`\n");
+		}
+		double percent = *end == '%' ? cpu : cpu * 100;
+		free(limit);
+		// Check the range before converting to int, it can not use more than all CPUs.
+		long nprocs = sysconf(_SC_NPROCESSORS_CONF);
+		if (nprocs < 1) {
+			nprocs = 1;
+		}
+		if (percent < 1) {
+			ruri_error("{red}Error: cpu limit is too small QwQ\n");
+		}
+		if (percent > (double)nprocs * 100) {
+			ruri_error("{red}Error: cpu limit should not be more than %ld%%, the number of CPUs QwQ\n", nprocs * 100);
+		}
+		container->cpupercent = (int)percent;
+	} else if (strcmp("cpu.max", buf) == 0) {
+		container->cpu_max = ruri_parse_cpu_max(limit);
+		if (container->cpu_max == NULL) {
+			ruri_error("{red}Error: cpu.max should be like `350000 100000` or `max`, quota >= 1000 and period in range 1000-1000000\n");
 		}
+		free(limit);
+	} else if (strcmp("cpu.max.burst", buf) == 0) {
+		char *end = NULL;
+		errno = 0;
+		long burst = strtol(limit, &end, 10);
+		if (end == limit || *end != '\0' || errno == ERANGE || burst < 0 || burst > INT_MAX) {
+			ruri_error("{red}Error: cpu.max.burst should be a non-negative number in microseconds\n");
+		}
+		free(limit);
+		container->cpu_burst = (int)burst;
+	} else if (strcmp("cpu.weight", buf) == 0) {
+		container->cpu_weight = atoi(limit);
+		free(limit);
+		if (container->cpu_weight < 1 || container->cpu_weight > 10000) {
+			ruri_error("{red}Error: cpu.weight should be in range 1-10000\n");
+		}
+	} else if (strcmp("cpu.weight.nice", buf) == 0) {
+		container->cpu_weight_nice = atoi(limit);
+		free(limit);
+		if (container->cpu_weight_nice < -20 || container->cpu_weight_nice > 19) {
+			ruri_error("{red}Error: cpu.weight.nice should be in range -20-19\n");
+		}
+	} else if (strcmp("cpu.idle", buf) == 0) {
+		if (strcmp(limit, "1") == 0 || strcmp(limit, "true") == 0) {
+			container->cpu_idle = 1;
+		} else if (strcmp(limit, "0") == 0 || strcmp(limit, "false") == 0) {
+			container->cpu_idle = 0;
+		} else {
+			ruri_error("{red}Error: cpu.idle should be 0, 1, true or false\n");
+		}
+		free(limit);
+	} else if (strcmp("pids", buf) == 0) {
+		container->pids_max = atoi(limit);
+		free(limit);
+		if (container->pids_max < 1) {
+			ruri_error("{red}Error: pids should be a positive number\n");
+		}
+	} else if (strncmp("hugetlb.", buf, 8) == 0) {
+		// `hugetlb.2MB=1G` -> `2MB=1G`, `hugetlb.2MB.max=1G` is also accepted.
+		char *size = strdup(buf + 8);
+		if (strlen(size) > 4 && strcmp(size + strlen(size) - 4, ".max") == 0) {
+			size[strlen(size) - 4] = '\0';
+		}
+		char *raw = malloc(strlen(size) + strlen(limit) + 2);
+		sprintf(raw, "%s=%s", size, limit);
+		int i = 0;
+		while (container->hugetlb_max[i] != NULL) {
+			i++;
+		}
+		if (i >= RURI_MAX_HUGETLB_SIZES) {
+			ruri_error("{red}Error: too many hugetlb limits QwQ\n");
+		}
+		container->hugetlb_max[i] = ruri_parse_hugetlb_limit(raw);
+		if (container->hugetlb_max[i] == NULL) {
+			ruri_error("{red}Error: hugetlb limit should be like `hugetlb.2MB=1G` or `hugetlb.1GB=max`\n");
+		}
+		container->hugetlb_max[i + 1] = NULL;
+		free(size);
+		free(raw);
+		free(limit);
+	} else if (strcmp("io.max", buf) == 0 || strcmp("io.weight", buf) == 0 || strcmp("io.latency", buf) == 0) {
+		char **list = container->io_max;
+		if (strcmp("io.weight", buf) == 0) {
+			list = container->io_weight;
+		} else if (strcmp("io.latency", buf) == 0) {
+			list = container->io_latency;
+		}
+		int i = 0;
+		while (list[i] != NULL) {
+			i++;
+		}
+		if (i >= RURI_MAX_IO_DEVS) {
+			ruri_error("{red}Error: too many %s limits QwQ\n", buf);
+		}
+		list[i] = ruri_parse_io_limit(limit, list == container->io_weight);
+		list[i + 1] = NULL;
+		free(limit);
 	} else {
 		ruri_error("{red}Unknown cgroup option %s\n", str);
 	}
+	check_cpu_burst(container);
 }
 
 static bool is_container_dir(char *dir)
@@ -222,6 +380,33 @@ static void parse_args(int argc, char **_Nonnull argv, struct RURI_CONTAINER *_N
 			// Clear envs.
 			ruri_clear_env(argv);
 			index += 1;
+			if (argv[index] == NULL) {
+				ruri_error("{red}Error: missing container directory QwQ\n");
+			}
+			// Umount all running containers.
+			if (strcmp(argv[index], "--all") == 0) {
+				exit(ruri_umount_all_containers() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+			}
+			// Umount multiple containers in parallel.
+			if (argv[index + 1] != NULL) {
+				char **container_dirs = malloc(sizeof(char *) * (size_t)(argc - index + 1));
+				int count = 0;
+				for (; index < argc; index++) {
+					struct stat st;
+					if (stat(argv[index], &st) == 0 && S_ISREG(st.st_mode)) {
+						ruri_read_config(container, argv[index]);
+						container_dirs[count] = container->container_dir;
+					} else {
+						container_dirs[count] = realpath(argv[index], NULL);
+						// Will be reported as failed.
+						if (container_dirs[count] == NULL) {
+							container_dirs[count] = argv[index];
+						}
+					}
+					count++;
+				}
+				exit(ruri_umount_containers(container_dirs, count) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+			}
 			struct stat st;
 			if (stat(argv[index], &st) != 0) {
 				ruri_error("{red}Container directory or config does not exist QwQ\n");
@@ -262,6 +447,184 @@ static void parse_args(int argc, char **_Nonnull argv, struct RURI_CONTAINER *_N
 			}
 			exit(114);
 		}
+		// Show processes of a container like top(1).
+		if (strcmp(argv[index], "--top") == 0) {
+			// Clear envs.
+			ruri_clear_env(argv);
+			int interval_ms = 1000;
+			int iterations = 0;
+			bool json = false;
+			for (index += 1; argv[index] != NULL && argv[index][0] == '-'; index++) {
+				if (strcmp(argv[index], "--json") == 0) {
+					json = true;
+				} else if (strcmp(argv[index], "--interval") == 0 && argv[index + 1] != NULL) {
+					index++;
+					interval_ms = atoi(argv[index]);
+				} else if (strcmp(argv[index], "--count") == 0 && argv[index + 1] != NULL) {
+					index++;
+					iterations = atoi(argv[index]);
+				} else {
+					ruri_error("{red}Error: unknown option `%s` for --top QwQ\n", argv[index]);
+				}
+			}
+			struct stat st;
+			if (argv[index] == NULL || stat(argv[index], &st) != 0) {
+				ruri_error("{red}Container directory or config does not exist QwQ\n");
+			}
+			if (S_ISDIR(st.st_mode)) {
+				char *container_dir = realpath(argv[index], NULL);
+				ruri_container_top(container_dir, interval_ms, iterations, json);
+			} else if (S_ISREG(st.st_mode)) {
+				ruri_read_config(container, argv[index]);
+				ruri_container_top(container->container_dir, interval_ms, iterations, json);
+			} else {
+				ruri_error("{red}Error: unknown file type QwQ\n");
+			}
+			exit(114);
+		}
+		// Show resource usage of container.
+		if (strcmp(argv[index], "--stats") == 0) {
+			// Clear envs.
+			ruri_clear_env(argv);
+			int interval_ms = 1000;
+			int iterations = 0;
+			bool json = false;
+			char *prometheus_file = NULL;
+			for (index += 1; argv[index] != NULL && argv[index][0] == '-'; index++) {
+				if (strcmp(argv[index], "--json") == 0) {
+					json = true;
+				} else if (strcmp(argv[index], "--interval") == 0 && argv[index + 1] != NULL) {
+					index++;
+					interval_ms = atoi(argv[index]);
+				} else if (strcmp(argv[index], "--count") == 0 && argv[index + 1] != NULL) {
+					index++;
+					iterations = atoi(argv[index]);
+				} else if (strcmp(argv[index], "--prometheus") == 0 && argv[index + 1] != NULL) {
+					index++;
+					prometheus_file = argv[index];
+				} else {
+					ruri_error("{red}Error: unknown option `%s` for --stats QwQ\n", argv[index]);
+				}
+			}
+			struct stat st;
+			if (argv[index] == NULL || stat(argv[index], &st) != 0) {
+				ruri_error("{red}Container directory or config does not exist QwQ\n");
+			}
+			if (S_ISDIR(st.st_mode)) {
+				char *container_dir = realpath(argv[index], NULL);
+				ruri_container_stats(container_dir, interval_ms, iterations, json, prometheus_file);
+			} else if (S_ISREG(st.st_mode)) {
+				ruri_read_config(container, argv[index]);
+				ruri_container_stats(container->container_dir, interval_ms, iterations, json, prometheus_file);
+			} else {
+				ruri_error("{red}Error: unknown file type QwQ\n");
+			}
+			exit(114);
+		}
+		// Watch resource events of container.
+		if (strcmp(argv[index], "--monitor") == 0) {
+			// Clear envs.
+			ruri_clear_env(argv);
+			struct RURI_MONITOR monitor = { .psi = { NULL }, .interval_ms = 1000, .json = false, .log_file = NULL, .hook = NULL };
+			int psi_count = 0;
+			for (index += 1; argv[index] != NULL && argv[index][0] == '-'; index++) {
+				if (strcmp(argv[index], "--json") == 0) {
+					monitor.json = true;
+				} else if (strcmp(argv[index], "--interval") == 0 && argv[index + 1] != NULL) {
+					index++;
+					monitor.interval_ms = atoi(argv[index]);
+				} else if (strcmp(argv[index], "--psi") == 0 && argv[index + 1] != NULL) {
+					index++;
+					if (psi_count >= RURI_MAX_PSI_TRIGGERS) {
+						ruri_error("{red}Error: too many PSI triggers QwQ\n");
+					}
+					monitor.psi[psi_count] = argv[index];
+					psi_count++;
+				} else if (strcmp(argv[index], "--log") == 0 && argv[index + 1] != NULL) {
+					index++;
+					monitor.log_file = argv[index];
+				} else if (strcmp(argv[index], "--hook") == 0 && argv[index + 1] != NULL) {
+					index++;
+					monitor.hook = argv[index];
+				} else {
+					ruri_error("{red}Error: unknown option `%s` for --monitor QwQ\n", argv[index]);
+				}
+			}
+			struct stat st;
+			if (argv[index] == NULL || stat(argv[index], &st) != 0) {
+				ruri_error("{red}Container directory or config does not exist QwQ\n");
+			}
+			if (S_ISDIR(st.st_mode)) {
+				char *container_dir = realpath(argv[index], NULL);
+				ruri_container_monitor(container_dir, &monitor);
+			} else if (S_ISREG(st.st_mode)) {
+				ruri_read_config(container, argv[index]);
+				ruri_container_monitor(container->container_dir, &monitor);
+			} else {
+				ruri_error("{red}Error: unknown file type QwQ\n");
+			}
+			exit(114);
+		}
+		// Stop a container gracefully.
+		if (strcmp(argv[index], "--stop") == 0) {
+			// Clear envs.
+			ruri_clear_env(argv);
+			int timeout_s = 10;
+			for (index += 1; argv[index] != NULL && argv[index][0] == '-'; index++) {
+				if (strcmp(argv[index], "--timeout") == 0 && argv[index + 1] != NULL) {
+					index++;
+					timeout_s = atoi(argv[index]);
+				} else {
+					ruri_error("{red}Error: unknown option `%s` for --stop QwQ\n", argv[index]);
+				}
+			}
+			struct stat st;
+			if (argv[index] == NULL || stat(argv[index], &st) != 0) {
+				ruri_error("{red}Container directory or config does not exist QwQ\n");
+			}
+			if (S_ISDIR(st.st_mode)) {
+				char *container_dir = realpath(argv[index], NULL);
+				ruri_stop_container(container_dir, timeout_s);
+			} else if (S_ISREG(st.st_mode)) {
+				ruri_read_config(container, argv[index]);
+				ruri_stop_container(container->container_dir, timeout_s);
+			} else {
+				ruri_error("{red}Error: unknown file type QwQ\n");
+			}
+			exit(114);
+		}
+		// Update cgroup limits of a running container.
+		if (strcmp(argv[index], "--update") == 0) {
+			// Clear envs.
+			ruri_clear_env(argv);
+			char *target = NULL;
+			for (index += 1; argv[index] != NULL; index++) {
+				if ((strcmp(argv[index], "-l") == 0 || strcmp(argv[index], "--limit") == 0) && argv[index + 1] != NULL) {
+					index++;
+					parse_cgroup_settings(argv[index], container);
+				} else if (argv[index][0] != '-' && target == NULL) {
+					target = argv[index];
+				} else {
+					ruri_error("{red}Error: unknown option `%s` for --update QwQ\n", argv[index]);
+				}
+			}
+			struct stat st;
+			if (target == NULL || stat(target, &st) != 0) {
+				ruri_error("{red}Container directory or config does not exist QwQ\n");
+			}
+			if (S_ISDIR(st.st_mode)) {
+				char *container_dir = realpath(target, NULL);
+				ruri_update_container(container_dir, container);
+			} else if (S_ISREG(st.st_mode)) {
+				struct RURI_CONTAINER *config = malloc(sizeof(struct RURI_CONTAINER));
+				ruri_init_config(config);
+				ruri_read_config(config, target);
+				ruri_update_container(config->container_dir, container);
+			} else {
+				ruri_error("{red}Error: unknown file type QwQ\n");
+			}
+			exit(114);
+		}
 		// Correct a container config.
 		if (strcmp(argv[index], "-C") == 0 || strcmp(argv[index], "--correct-config") == 0) {
 			index += 1;
@@ -601,6 +964,42 @@ static void parse_args(int argc, char **_Nonnull argv, struct RURI_CONTAINER *_N
 			}
 #else
 			ruri_error("{red}Error: libseccomp is disabled, please recompile ruri with libseccomp support QwQ\n");
+#endif
+		}
+		// Allowlist seccomp profile.
+		else if (strcmp(argv[index], "--seccomp-profile") == 0) {
+#ifndef DISABLE_LIBSECCOMP
+			index++;
+			if (argv[index] == NULL) {
+				ruri_error("{red}Error: please specify the seccomp profile QwQ\n");
+			}
+			// The profile is read before chroot(2), and .rurienv needs the full path.
+			container->seccomp_profile = realpath(argv[index], NULL);
+			if (container->seccomp_profile == NULL) {
+				ruri_error("{red}Error: seccomp profile %s does not exist QwQ\n", argv[index]);
+			}
+#else
+			ruri_error("{red}Error: libseccomp is disabled, please recompile ruri with libseccomp support QwQ\n");
+#endif
+		}
+		// Record syscalls to an allowlist seccomp profile.
+		else if (strcmp(argv[index], "--seccomp-learn") == 0) {
+#ifndef DISABLE_LIBSECCOMP
+			index++;
+			if (argv[index] == NULL) {
+				ruri_error("{red}Error: please specify the seccomp profile to write QwQ\n");
+			}
+			container->seccomp_learn = strdup(argv[index]);
+#else
+			ruri_error("{red}Error: libseccomp is disabled, please recompile ruri with libseccomp support QwQ\n");
+#endif
+		}
+		// Allow speculative store bypass for seccomp.
+		else if (strcmp(argv[index], "--seccomp-spec-allow") == 0) {
+#ifndef DISABLE_LIBSECCOMP
+			container->seccomp_spec_allow = true;
+#else
+			ruri_error("{red}Error: libseccomp is disabled, please recompile ruri with libseccomp support QwQ\n");
 #endif
 		}
 		// Time ns offset.
@@ -651,6 +1050,47 @@ static void parse_args(int argc, char **_Nonnull argv, struct RURI_CONTAINER *_N
 		} else if (strcmp(argv[index], "-z") == 0 || strcmp(argv[index], "--enable-tty-signals") == 0) {
 			container->enable_tty_signals = true;
 		}
+		// Mountpoint of hugetlbfs.
+		else if (strcmp(argv[index], "--hugetlbfs") == 0) {
+			index++;
+			if (argv[index] == NULL || (argv[index][0] != '/' && strcmp(argv[index], "none") != 0)) {
+				ruri_error("{red}Error: hugetlbfs mountpoint should be an absolute path or `none` QwQ\n");
+			}
+			container->hugetlbfs = strdup(argv[index]);
+		}
+		// Scheduling attributes.
+		else if (strcmp(argv[index], "--sched") == 0) {
+			index++;
+			if (argv[index] == NULL) {
+				ruri_error("{red}Error: missing scheduling option QwQ\n");
+			}
+			ruri_parse_sched_setting(argv[index], container);
+		}
+		// Disable transparent hugepages.
+		else if (strcmp(argv[index], "--thp-disable") == 0) {
+			container->thp_disable = true;
+		}
+		// Enable KSM.
+		else if (strcmp(argv[index], "--ksm") == 0) {
+			container->ksm = true;
+		}
+		// NUMA memory policy.
+		else if (strcmp(argv[index], "--mempolicy") == 0) {
+			index++;
+			int mode = 0;
+			cpu_set_t nodes;
+			if (argv[index] == NULL || !ruri_parse_mempolicy(argv[index], &mode, &nodes)) {
+				ruri_error("{red}Error: memory policy should be like `interleave:0-1`, `bind:0`, `preferred:1` or `local` QwQ\n");
+			}
+			container->mempolicy = strdup(argv[index]);
+		}
+		// Resource limits.
+		else if (strcmp(argv[index], "--rlimit") == 0) {
+			index++;
+			if (argv[index] == NULL || !ruri_add_rlimit(container->rlimits, argv[index])) {
+				ruri_error("{red}Error: rlimit should be like `NOFILE=1024:65536` or `MEMLOCK=unlimited` QwQ\n");
+			}
+		}
 		// Extra capabilities to drop.
 		else if (strcmp(argv[index], "-d") == 0 || strcmp(argv[index], "--drop") == 0) {
 #ifndef DISABLE_LIBCAP
@@ -1247,7 +1687,10 @@ static void parse_args(int argc, char **_Nonnull argv, struct RURI_CONTAINER *_N
 	if (fork_exec && !container->enable_unshare) {
 		pid_t pid = fork();
 		if (pid > 0) {
-			waitpid(pid, NULL, 0);
+			int stat = 0;
+			struct rusage usage;
+			wait4(pid, &stat, 0, &usage);
+			ruri_show_exit_summary(container, stat, &usage);
 			exit(EXIT_SUCCESS);
 		}
 	}
@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: MIT
+/*
+ *
+ * This file is part of ruri, with ABSOLUTELY NO WARRANTY.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022-2024 Moe-hacker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+#include "include/ruri.h"
+/*
+ * This file sets the scheduling attributes of the container process
+ * before exec(3), they are inherited by all processes in container:
+ * scheduling policy, nice and utilization clamp by sched_setattr(2),
+ * CPU affinity, core scheduling cookie and timer slack.
+ * CPU affinity works without cpuset cgroup, like on Android kernels.
+ */
+#ifndef SCHED_FLAG_UTIL_CLAMP_MIN
+#define SCHED_FLAG_UTIL_CLAMP_MIN 0x20
+#define SCHED_FLAG_UTIL_CLAMP_MAX 0x40
+#endif
+#ifndef PR_SCHED_CORE
+#define PR_SCHED_CORE 62
+#define PR_SCHED_CORE_CREATE 1
+#endif
+#ifndef PR_SCHED_CORE_SCOPE_THREAD_GROUP
+#define PR_SCHED_CORE_SCOPE_THREAD_GROUP 1
+#endif
+// For sched_setattr(2), glibc does not provide it.
+struct RURI_SCHED_ATTR {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+	uint32_t sched_util_min;
+	uint32_t sched_util_max;
+};
+// Get the policy from name.
+int ruri_parse_sched_policy(const char *_Nonnull name)
+{
+	/*
+	 * Return the SCHED_* value, or -1 if the name is unknown.
+	 */
+	const char *names[] = { "other", "batch", "idle", "fifo", "rr" };
+	const int policies[] = { SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO, SCHED_RR };
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (strcmp(name, names[i]) == 0) {
+			return policies[i];
+		}
+	}
+	return -1;
+}
+// Parse `--sched` option.
+void ruri_parse_sched_setting(const char *_Nonnull str, struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * The format should be like `policy=fifo:10`, `nice=5`, `uclamp=0:512`,
+	 * `affinity=0-3`, `core=1` or `timerslack=50000`.
+	 */
+	const char *value = strchr(str, '=');
+	if (value == NULL) {
+		ruri_error("{red}Error: scheduling option should be like `policy=batch` or `nice=5`\n");
+	}
+	size_t key_len = (size_t)(value - str);
+	value++;
+	if (strncmp(str, "policy", key_len) == 0 && key_len == 6) {
+		char name[16] = { '\0' };
+		int priority = 0;
+		int n = sscanf(value, "%15[a-z]:%d", name, &priority);
+		int policy = ruri_parse_sched_policy(name);
+		if (n < 1 || policy < 0) {
+			ruri_error("{red}Error: scheduling policy should be one of other/batch/idle/fifo/rr\n");
+		}
+		if ((policy == SCHED_FIFO || policy == SCHED_RR) && (n != 2 || priority < 1 || priority > 99)) {
+			ruri_error("{red}Error: fifo and rr need a priority in range 1-99, like `policy=fifo:10`\n");
+		}
+		if (policy != SCHED_FIFO && policy != SCHED_RR && n == 2) {
+			ruri_error("{red}Error: priority is only for fifo and rr\n");
+		}
+		container->sched_policy = strdup(name);
+		container->sched_priority = (n == 2) ? priority : RURI_INIT_VALUE;
+	} else if (strncmp(str, "nice", key_len) == 0 && key_len == 4) {
+		container->sched_nice = atoi(value);
+		if (container->sched_nice < -20 || container->sched_nice > 19) {
+			ruri_error("{red}Error: nice should be in range -20-19\n");
+		}
+	} else if (strncmp(str, "uclamp", key_len) == 0 && key_len == 6) {
+		if (sscanf(value, "%d:%d", &container->uclamp_min, &container->uclamp_max) != 2 || container->uclamp_min < 0 || container->uclamp_max > 1024 || container->uclamp_min > container->uclamp_max) {
+			ruri_error("{red}Error: uclamp should be like `0:512`, in range 0-1024\n");
+		}
+	} else if (strncmp(str, "affinity", key_len) == 0 && key_len == 8) {
+		cpu_set_t set;
+		if (!ruri_parse_cpu_list(value, &set)) {
+			ruri_error("{red}Error: CPU affinity should be like `0-3,5`\n");
+		}
+		container->cpu_affinity = strdup(value);
+	} else if (strncmp(str, "core", key_len) == 0 && key_len == 4) {
+		container->sched_core = (strcmp(value, "1") == 0 || strcmp(value, "true") == 0);
+	} else if (strncmp(str, "timerslack", key_len) == 0 && key_len == 10) {
+		container->timer_slack = atoi(value);
+		if (container->timer_slack < 1) {
+			ruri_error("{red}Error: timerslack should be a positive number in nanoseconds\n");
+		}
+	} else {
+		ruri_error("{red}Unknown scheduling option %s\n", str);
+	}
+}
+static void set_sched_attr(const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Set policy, nice and uclamp in one sched_setattr(2) call.
+	 * Unset values are kept as the current ones.
+	 * For fifo and rr, RLIMIT_RTPRIO is also set to the priority,
+	 * so that processes in container can still use it after the
+	 * capabilities are dropped, but can not raise it.
+	 */
+	int policy = container->sched_policy == NULL ? -1 : ruri_parse_sched_policy(container->sched_policy);
+	bool has_uclamp = container->uclamp_min >= 0 && container->uclamp_max >= 0;
+	bool has_nice = container->sched_nice >= -20 && container->sched_nice <= 19;
+	if (policy < 0 && !has_uclamp && !has_nice) {
+		if (container->sched_policy != NULL && !container->no_warnings) {
+			ruri_warning("{yellow}Warning: unknown scheduling policy %s{clear}\n", container->sched_policy);
+		}
+		return;
+	}
+	struct RURI_SCHED_ATTR attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = (uint32_t)(policy < 0 ? sched_getscheduler(0) : policy);
+	if (attr.sched_policy == SCHED_FIFO || attr.sched_policy == SCHED_RR) {
+		struct sched_param param;
+		sched_getparam(0, &param);
+		attr.sched_priority = (uint32_t)(policy < 0 ? param.sched_priority : container->sched_priority);
+		struct rlimit rlim = { .rlim_cur = attr.sched_priority, .rlim_max = attr.sched_priority };
+		if (setrlimit(RLIMIT_RTPRIO, &rlim) != 0 && !container->no_warnings) {
+			ruri_warning("{yellow}Warning: failed to set RLIMIT_RTPRIO: %s{clear}\n", strerror(errno));
+		}
+	}
+	errno = 0;
+	int nice = getpriority(PRIO_PROCESS, 0);
+	attr.sched_nice = has_nice ? container->sched_nice : (errno == 0 ? nice : 0);
+	if (has_uclamp) {
+		attr.sched_flags |= SCHED_FLAG_UTIL_CLAMP_MIN | SCHED_FLAG_UTIL_CLAMP_MAX;
+		attr.sched_util_min = (uint32_t)container->uclamp_min;
+		attr.sched_util_max = (uint32_t)container->uclamp_max;
+	}
+	ruri_log("{base}sched_setattr: policy %u priority %u nice %d uclamp %d:%d\n", attr.sched_policy, attr.sched_priority, attr.sched_nice, container->uclamp_min, container->uclamp_max);
+	if (syscall(SYS_sched_setattr, 0, &attr, 0) == 0) {
+		return;
+	}
+	// sched_setattr(2) is in Linux 3.14, and uclamp needs CONFIG_UCLAMP_TASK.
+	int err = errno;
+	if (has_uclamp && !container->no_warnings) {
+		ruri_warning("{yellow}Warning: failed to set uclamp: %s{clear}\n", strerror(err));
+	}
+	struct sched_param param = { .sched_priority = (int)attr.sched_priority };
+	if (sched_setscheduler(0, (int)attr.sched_policy, &param) != 0 && !container->no_warnings) {
+		ruri_warning("{yellow}Warning: failed to set scheduling policy: %s{clear}\n", strerror(errno));
+	}
+	if (has_nice && setpriority(PRIO_PROCESS, 0, container->sched_nice) != 0 && !container->no_warnings) {
+		ruri_warning("{yellow}Warning: failed to set nice: %s{clear}\n", strerror(errno));
+	}
+}
+// Set scheduling attributes of container.
+void ruri_set_sched(const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Called after ruri_set_limit(), so that the affinity is in the cpuset,
+	 * and before the capabilities are dropped, because
+	 * realtime policy and negative nice need CAP_SYS_NICE.
+	 * Failures are only warnings, ruri might be rootless.
+	 */
+	set_sched_attr(container);
+	if (container->cpu_affinity != NULL) {
+		cpu_set_t set;
+		if (!ruri_parse_cpu_list(container->cpu_affinity, &set)) {
+			if (!container->no_warnings) {
+				ruri_warning("{yellow}Warning: invalid CPU affinity %s{clear}\n", container->cpu_affinity);
+			}
+		} else if (sched_setaffinity(0, sizeof(set), &set) != 0 && !container->no_warnings) {
+			ruri_warning("{yellow}Warning: failed to set CPU affinity to %s: %s{clear}\n", container->cpu_affinity, strerror(errno));
+		}
+	}
+	// Processes with different cookies never run on SMT siblings at the same time.
+	// The cookie is inherited by children, and needs CONFIG_SCHED_CORE (Linux 5.14).
+	if (container->sched_core) {
+		if (prctl(PR_SCHED_CORE, PR_SCHED_CORE_CREATE, 0, PR_SCHED_CORE_SCOPE_THREAD_GROUP, 0) != 0 && !container->no_warnings) {
+			if (errno == EINVAL) {
+				ruri_warning("{yellow}Warning: core scheduling is not supported by kernel{clear}\n");
+			} else {
+				ruri_warning("{yellow}Warning: failed to create core scheduling cookie: %s{clear}\n", strerror(errno));
+			}
+		}
+	}
+	if (container->timer_slack > 0) {
+		if (prctl(PR_SET_TIMERSLACK, (unsigned long)container->timer_slack, 0, 0, 0) != 0 && !container->no_warnings) {
+			ruri_warning("{yellow}Warning: failed to set timer slack: %s{clear}\n", strerror(errno));
+		}
+	}
+}
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: MIT
+/*
+ *
+ * This file is part of ruri, with ABSOLUTELY NO WARRANTY.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022-2024 Moe-hacker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+#include "include/ruri.h"
+/*
+ * This file provides `ruri --seccomp-learn`, to record the syscalls used by container,
+ * and write them as an allowlist profile for `--seccomp-profile`.
+ * Every syscall of container is sent to a supervisor process by a
+ * SECCOMP_RET_USER_NOTIF filter, and continued after it's recorded.
+ */
+#if !defined(DISABLE_LIBSECCOMP) && defined(SECCOMP_IOCTL_NOTIF_RECV)
+// The profile to write, opened before chroot(2).
+static int learn_fd = -1;
+// Recorded profile lines, like `read` or `clone arg0&0x7e020000==0x0`.
+static char **learned = NULL;
+static size_t learned_count = 0;
+// Namespace flags of clone(2), the same mask as test/seccomp/docker-default.profile.
+#define LEARN_CLONE_MASK 0x7e020000ULL
+static int compare_line(const void *_Nonnull a, const void *_Nonnull b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+static void write_profile(void)
+{
+	/*
+	 * Rewrite the whole profile every time a new line is recorded,
+	 * so the profile is complete as soon as the container exits.
+	 */
+	qsort(learned, learned_count, sizeof(char *), compare_line);
+	const char *header = "# Generated by `ruri --seccomp-learn`.\n# Use it with `ruri --seccomp-profile`.\ndefault EPERM\n";
+	size_t size = strlen(header) + 1;
+	for (size_t i = 0; i < learned_count; i++) {
+		size += strlen(learned[i]) + 1;
+	}
+	char *buf = malloc(size);
+	strcpy(buf, header);
+	char *p = buf + strlen(header);
+	for (size_t i = 0; i < learned_count; i++) {
+		p += sprintf(p, "%s\n", learned[i]);
+	}
+	if (ftruncate(learn_fd, 0) != 0 || pwrite(learn_fd, buf, (size_t)(p - buf), 0) != p - buf) {
+		ruri_warning("{yellow}Warning: failed to write seccomp profile: %s{clear}\n", strerror(errno));
+	}
+	free(buf);
+}
+static void learn_syscall(const struct seccomp_data *_Nonnull data)
+{
+	/*
+	 * Record the syscall, with the key argument of clone(2), socket(2) and personality(2).
+	 */
+	char *name = seccomp_syscall_resolve_num_arch(data->arch, data->nr);
+	if (name == NULL) {
+		return;
+	}
+	char line[128] = { '\0' };
+	if (strcmp(name, "clone") == 0) {
+		sprintf(line, "clone arg0&0x%llx==0x%llx", LEARN_CLONE_MASK, (unsigned long long)data->args[0] & LEARN_CLONE_MASK);
+	} else if (strcmp(name, "socket") == 0 || strcmp(name, "personality") == 0) {
+		snprintf(line, sizeof(line), "%s arg0==0x%llx", name, (unsigned long long)data->args[0]);
+	} else {
+		snprintf(line, sizeof(line), "%s", name);
+	}
+	free(name);
+	for (size_t i = 0; i < learned_count; i++) {
+		if (strcmp(learned[i], line) == 0) {
+			return;
+		}
+	}
+	learned = realloc(learned, sizeof(char *) * (learned_count + 1));
+	learned[learned_count] = strdup(line);
+	learned_count++;
+	write_profile();
+}
+static int get_listener(pid_t pid, int target_fd, int report_fd)
+{
+	/*
+	 * Get the listener from the container process with pidfd_getfd(2).
+	 * target_fd is /dev/null before the filter is loaded,
+	 * we first check that we can get it and report to the container process by report_fd,
+	 * because pidfd_getfd(2) might be denied by Yama or LSM,
+	 * and then wait until it becomes a listener.
+	 */
+	int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+	int fd = pidfd < 0 ? -1 : (int)syscall(SYS_pidfd_getfd, pidfd, target_fd, 0);
+	if (fd < 0) {
+		close(report_fd);
+		return -1;
+	}
+	close(fd);
+	if (write(report_fd, "1", 1) != 1) {
+		close(report_fd);
+		close(pidfd);
+		return -1;
+	}
+	close(report_fd);
+	for (;;) {
+		int fd = (int)syscall(SYS_pidfd_getfd, pidfd, target_fd, 0);
+		if (fd < 0 && errno != EBADF) {
+			// The container process exited, or pidfd_getfd(2) is not supported.
+			close(pidfd);
+			return -1;
+		}
+		if (fd >= 0) {
+			// SECCOMP_IOCTL_NOTIF_ID_VALID gives ENOENT for an unknown id only on a listener.
+			uint64_t id = 0;
+			if (ioctl(fd, SECCOMP_IOCTL_NOTIF_ID_VALID, &id) != 0 && errno == ENOENT) {
+				close(pidfd);
+				return fd;
+			}
+			close(fd);
+		}
+		usleep(1000);
+	}
+}
+static void supervise(pid_t pid, int target_fd, int report_fd)
+{
+	/*
+	 * Record every notified syscall and let it continue,
+	 * until all processes using the filter exit.
+	 */
+	int listener = get_listener(pid, target_fd, report_fd);
+	if (listener < 0) {
+		ruri_warning("{yellow}Warning: failed to get seccomp listener, linux 5.6 is needed{clear}\n");
+		_exit(EXIT_FAILURE);
+	}
+	struct seccomp_notif_sizes sizes = { 0 };
+	syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes);
+	size_t req_size = sizes.seccomp_notif > sizeof(struct seccomp_notif) ? sizes.seccomp_notif : sizeof(struct seccomp_notif);
+	size_t resp_size = sizes.seccomp_notif_resp > sizeof(struct seccomp_notif_resp) ? sizes.seccomp_notif_resp : sizeof(struct seccomp_notif_resp);
+	struct seccomp_notif *req = malloc(req_size);
+	struct seccomp_notif_resp *resp = malloc(resp_size);
+	struct pollfd pfd = { .fd = listener, .events = POLLIN, .revents = 0 };
+	for (;;) {
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if (!(pfd.revents & POLLIN)) {
+			// POLLHUP, no process is using the filter.
+			break;
+		}
+		memset(req, 0, req_size);
+		// ENOENT if the process is killed before we receive it.
+		if (ioctl(listener, SECCOMP_IOCTL_NOTIF_RECV, req) != 0) {
+			continue;
+		}
+		learn_syscall(&req->data);
+		memset(resp, 0, resp_size);
+		resp->id = req->id;
+		resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+		ioctl(listener, SECCOMP_IOCTL_NOTIF_SEND, resp);
+	}
+	_exit(EXIT_SUCCESS);
+}
+#endif
+// Open the profile to write, before chroot(2).
+void ruri_prepare_seccomp_learn(const struct RURI_CONTAINER *_Nonnull container)
+{
+#if !defined(DISABLE_LIBSECCOMP) && defined(SECCOMP_IOCTL_NOTIF_RECV)
+	/*
+	 * The profile is on the host, so we open it before chroot(2).
+	 * Other seccomp options are ignored, because they hide syscalls from us.
+	 */
+	if (container->enable_default_seccomp || container->seccomp_denied_syscall[0] != NULL || container->seccomp_profile != NULL) {
+		ruri_warning("{yellow}Warning: other seccomp options are ignored with --seccomp-learn{clear}\n");
+	}
+	learn_fd = open(container->seccomp_learn, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (learn_fd < 0) {
+		ruri_error("{red}Error: failed to open %s QwQ\n", container->seccomp_learn);
+	}
+	ruri_log("{base}Recording syscalls to %s\n", container->seccomp_learn);
+#else
+	(void)container;
+	ruri_error("{red}Error: --seccomp-learn is not supported by this build of ruri QwQ\n");
+#endif
+}
+// Load the filter sending every syscall to the supervisor.
+void ruri_setup_seccomp_learn(const struct RURI_CONTAINER *_Nonnull container)
+{
+#if !defined(DISABLE_LIBSECCOMP) && defined(SECCOMP_IOCTL_NOTIF_RECV)
+	/*
+	 * The listener is only returned to the process loading the filter,
+	 * and we can not send it to the supervisor after that, because every syscall waits for the supervisor.
+	 * So we reserve the lowest free fd, the listener will get the same fd,
+	 * and the supervisor gets it with pidfd_getfd(2).
+	 */
+	if (learn_fd < 0) {
+		return;
+	}
+	int reserved = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	// Opened after reserved, so closing it does not free a lower fd.
+	int report[2] = { -1, -1 };
+	if (reserved < 0 || pipe2(report, O_CLOEXEC) != 0) {
+		ruri_error("{red}Error: failed to set up --seccomp-learn QwQ\n");
+	}
+	pid_t pid = getpid();
+	pid_t child = fork();
+	if (child == 0) {
+		close(report[0]);
+		// Fork again, so the supervisor is not a child of the container process.
+		if (fork() == 0) {
+			supervise(pid, reserved, report[1]);
+		}
+		_exit(EXIT_SUCCESS);
+	}
+	close(report[1]);
+	waitpid(child, NULL, 0);
+	// Wait for the supervisor, or the container will wait for it forever after the filter is loaded.
+	char ok = '\0';
+	ssize_t len = 0;
+	do {
+		len = read(report[0], &ok, 1);
+	} while (len < 0 && errno == EINTR);
+	close(report[0]);
+	if (len != 1) {
+		ruri_error("{red}Error: the supervisor can not get fd of container by pidfd_getfd(2), --seccomp-learn needs linux 5.6 and ptrace permission QwQ\n");
+	}
+	close(reserved);
+	struct sock_filter filter[] = { BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_USER_NOTIF) };
+	struct sock_fprog prog = { .len = 1, .filter = filter };
+	int listener = (int)syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+	if (listener < 0) {
+		ruri_error("{red}Error: failed to load seccomp filter for learning QwQ\n");
+	}
+	// Only the supervisor needs them.
+	close(listener);
+	close(learn_fd);
+#endif
+	(void)container;
+}
@@ -32,39 +32,213 @@
  * This file provides the built-in seccomp filter rules for ruri.
  * Thanks docker for denied syscall list.
  */
+#ifndef DISABLE_LIBSECCOMP
+// The filter built by ruri_prepare_seccomp() and loaded by ruri_setup_seccomp().
+static struct sock_fprog seccomp_filter = { 0, NULL };
+// Content of the allowlist profile, read before chroot(2).
+static char *seccomp_profile = NULL;
+// Header of the cached filter, followed by len struct sock_filter.
+struct SECCOMP_CACHE_HEADER {
+	char magic[8];
+	uint64_t key;
+	uint32_t len;
+};
+// Errno prefixes, sorted by strcmp(3) for bsearch(3).
+struct SECCOMP_ERRNO {
+	const char *name;
+	unsigned int value;
+};
+static const struct SECCOMP_ERRNO errno_map[] = { { "E2BIG", E2BIG }, { "EACCES", EACCES }, { "EADDRINUSE", EADDRINUSE }, { "EADDRNOTAVAIL", EADDRNOTAVAIL }, { "EAFNOSUPPORT", EAFNOSUPPORT }, { "EAGAIN", EAGAIN }, { "EALREADY", EALREADY }, { "EBADE", EBADE }, { "EBADF", EBADF }, { "EBADFD", EBADFD }, { "EBADMSG", EBADMSG }, { "EBADR", EBADR }, { "EBADRQC", EBADRQC }, { "EBADSLT", EBADSLT }, { "EBUSY", EBUSY }, { "ECANCELED", ECANCELED }, { "ECHILD", ECHILD }, { "ECHRNG", ECHRNG }, { "ECOMM", ECOMM }, { "ECONNABORTED", ECONNABORTED }, { "ECONNREFUSED", ECONNREFUSED }, { "ECONNRESET", ECONNRESET }, { "EDEADLK", EDEADLK }, { "EDEADLOCK", EDEADLOCK }, { "EDESTADDRREQ", EDESTADDRREQ }, { "EDOM", EDOM }, { "EDQUOT", EDQUOT }, { "EEXIST", EEXIST }, { "EFAULT", EFAULT }, { "EFBIG", EFBIG }, { "EHOSTDOWN", EHOSTDOWN }, { "EHOSTUNREACH", EHOSTUNREACH }, { "EHWPOISON", EHWPOISON }, { "EIDRM", EIDRM }, { "EILSEQ", EILSEQ }, { "EINPROGRESS", EINPROGRESS }, { "EINTR", EINTR }, { "EINVAL", EINVAL }, { "EIO", EIO }, { "EISCONN", EISCONN }, { "EISDIR", EISDIR }, { "EISNAM", EISNAM }, { "EKEYEXPIRED", EKEYEXPIRED }, { "EKEYREJECTED", EKEYREJECTED }, { "EKEYREVOKED", EKEYREVOKED }, { "EL2HLT", EL2HLT }, { "EL2NSYNC", EL2NSYNC }, { "EL3HLT", EL3HLT }, { "EL3RST", EL3RST }, { "ELIBACC", ELIBACC }, { "ELIBBAD", ELIBBAD }, { "ELIBEXEC", ELIBEXEC }, { "ELIBMAX", ELIBMAX }, { "ELIBSCN", ELIBSCN }, { "ELNRNG", ELNRNG }, { "ELOOP", ELOOP }, { "EMEDIUMTYPE", EMEDIUMTYPE }, { "EMFILE", EMFILE }, { "EMLINK", EMLINK }, { "EMSGSIZE", EMSGSIZE }, { "EMULTIHOP", EMULTIHOP }, { "ENAMETOOLONG", ENAMETOOLONG }, { "ENETDOWN", ENETDOWN }, { "ENETRESET", ENETRESET }, { "ENETUNREACH", ENETUNREACH }, { "ENFILE", ENFILE }, { "ENOANO", ENOANO }, { "ENOBUFS", ENOBUFS }, { "ENODATA", ENODATA }, { "ENODEV", ENODEV }, { "ENOENT", ENOENT }, { "ENOEXEC", ENOEXEC }, { "ENOKEY", ENOKEY }, { "ENOLCK", ENOLCK }, { "ENOLINK", ENOLINK }, { "ENOMEDIUM", ENOMEDIUM }, { "ENOMEM", ENOMEM }, { "ENOMSG", ENOMSG }, { "ENONET", ENONET }, { "ENOPKG", ENOPKG }, { "ENOPROTOOPT", ENOPROTOOPT }, { "ENOSPC", ENOSPC }, { "ENOSR", ENOSR }, { "ENOSTR", ENOSTR }, { "ENOSYS", ENOSYS }, { "ENOTBLK", ENOTBLK }, { "ENOTCONN", ENOTCONN }, { "ENOTDIR", ENOTDIR }, { "ENOTEMPTY", ENOTEMPTY }, { "ENOTRECOVERABLE", ENOTRECOVERABLE }, { "ENOTSOCK", ENOTSOCK }, { "ENOTSUP", ENOTSUP }, { "ENOTTY", ENOTTY }, { "ENOTUNIQ", ENOTUNIQ }, { "ENXIO", ENXIO }, { "EOPNOTSUPP", EOPNOTSUPP }, { "EOVERFLOW", EOVERFLOW }, { "EOWNERDEAD", EOWNERDEAD }, { "EPERM", EPERM }, { "EPFNOSUPPORT", EPFNOSUPPORT }, { "EPIPE", EPIPE }, { "EPROTO", EPROTO }, { "EPROTONOSUPPORT", EPROTONOSUPPORT }, { "EPROTOTYPE", EPROTOTYPE }, { "ERANGE", ERANGE }, { "EREMCHG", EREMCHG }, { "EREMOTE", EREMOTE }, { "EREMOTEIO", EREMOTEIO }, { "ERESTART", ERESTART }, { "ERFKILL", ERFKILL }, { "EROFS", EROFS }, { "ERRNO", 0 }, { "ESHUTDOWN", ESHUTDOWN }, { "ESOCKTNOSUPPORT", ESOCKTNOSUPPORT }, { "ESPIPE", ESPIPE }, { "ESRCH", ESRCH }, { "ESTALE", ESTALE }, { "ESTRPIPE", ESTRPIPE }, { "ETIME", ETIME }, { "ETIMEDOUT", ETIMEDOUT }, { "ETOOMANYREFS", ETOOMANYREFS }, { "ETXTBSY", ETXTBSY }, { "EUCLEAN", EUCLEAN }, { "EUNATCH", EUNATCH }, { "EUSERS", EUSERS }, { "EWOULDBLOCK", EWOULDBLOCK }, { "EXDEV", EXDEV }, { "EXFULL", EXFULL } };
+static int compare_errno(const void *_Nonnull key, const void *_Nonnull entry)
+{
+	return strcmp((const char *)key, ((const struct SECCOMP_ERRNO *)entry)->name);
+}
+static const struct SECCOMP_ERRNO *find_errno(const char *_Nonnull name)
+{
+	return bsearch(name, errno_map, sizeof(errno_map) / sizeof(errno_map[0]), sizeof(errno_map[0]), compare_errno);
+}
 // Reslove prefix for errno.
 static int ruri_resolve_seccomp_errno(const char *_Nonnull syscall, scmp_filter_ctx *_Nonnull ctx)
 {
-	const char *syscall_name = syscall;
-	uint32_t action = SCMP_ACT_KILL;
-	// Support errno prefixes like EACCES:chroot, EPERM:unshare, etc.
-	struct {
-		const char *name;
-		unsigned int value;
-	} errno_map[] = { { "ERRNO:", 0 }, { "E2BIG:", E2BIG }, { "EACCES:", EACCES }, { "EADDRINUSE:", EADDRINUSE }, { "EADDRNOTAVAIL:", EADDRNOTAVAIL }, { "EAFNOSUPPORT:", EAFNOSUPPORT }, { "EAGAIN:", EAGAIN }, { "EALREADY:", EALREADY }, { "EBADE:", EBADE }, { "EBADF:", EBADF }, { "EBADFD:", EBADFD }, { "EBADMSG:", EBADMSG }, { "EBADR:", EBADR }, { "EBADRQC:", EBADRQC }, { "EBADSLT:", EBADSLT }, { "EBUSY:", EBUSY }, { "ECANCELED:", ECANCELED }, { "ECHILD:", ECHILD }, { "ECHRNG:", ECHRNG }, { "ECOMM:", ECOMM }, { "ECONNABORTED:", ECONNABORTED }, { "ECONNREFUSED:", ECONNREFUSED }, { "ECONNRESET:", ECONNRESET }, { "EDEADLK:", EDEADLK }, { "EDEADLOCK:", EDEADLOCK }, { "EDESTADDRREQ:", EDESTADDRREQ }, { "EDOM:", EDOM }, { "EDQUOT:", EDQUOT }, { "EEXIST:", EEXIST }, { "EFAULT:", EFAULT }, { "EFBIG:", EFBIG }, { "EHOSTDOWN:", EHOSTDOWN }, { "EHOSTUNREACH:", EHOSTUNREACH }, { "EHWPOISON:", EHWPOISON }, { "EIDRM:", EIDRM }, { "EILSEQ:", EILSEQ }, { "EINPROGRESS:", EINPROGRESS }, { "EINTR:", EINTR }, { "EINVAL:", EINVAL }, { "EIO:", EIO }, { "EISCONN:", EISCONN }, { "EISDIR:", EISDIR }, { "EISNAM:", EISNAM }, { "EKEYEXPIRED:", EKEYEXPIRED }, { "EKEYREJECTED:", EKEYREJECTED }, { "EKEYREVOKED:", EKEYREVOKED }, { "EL2HLT:", EL2HLT }, { "EL2NSYNC:", EL2NSYNC }, { "EL3HLT:", EL3HLT }, { "EL3RST:", EL3RST }, { "ELIBACC:", ELIBACC }, { "ELIBBAD:", ELIBBAD }, { "ELIBMAX:", ELIBMAX }, { "ELIBSCN:", ELIBSCN }, { "ELIBEXEC:", ELIBEXEC }, { "ELNRNG:", ELNRNG }, { "ELOOP:", ELOOP }, { "EMEDIUMTYPE:", EMEDIUMTYPE }, { "EMFILE:", EMFILE }, { "EMLINK:", EMLINK }, { "EMSGSIZE:", EMSGSIZE }, { "EMULTIHOP:", EMULTIHOP }, { "ENAMETOOLONG:", ENAMETOOLONG }, { "ENETDOWN:", ENETDOWN }, { "ENETRESET:", ENETRESET }, { "ENETUNREACH:", ENETUNREACH }, { "ENFILE:", ENFILE }, { "ENOANO:", ENOANO }, { "ENOBUFS:", ENOBUFS }, { "ENODATA:", ENODATA }, { "ENODEV:", ENODEV }, { "ENOENT:", ENOENT }, { "ENOEXEC:", ENOEXEC }, { "ENOKEY:", ENOKEY }, { "ENOLCK:", ENOLCK }, { "ENOLINK:", ENOLINK }, { "ENOMEDIUM:", ENOMEDIUM }, { "ENOMEM:", ENOMEM }, { "ENOMSG:", ENOMSG }, { "ENONET:", ENONET }, { "ENOPKG:", ENOPKG }, { "ENOPROTOOPT:", ENOPROTOOPT }, { "ENOSPC:", ENOSPC }, { "ENOSR:", ENOSR }, { "ENOSTR:", ENOSTR }, { "ENOSYS:", ENOSYS }, { "ENOTBLK:", ENOTBLK }, { "ENOTCONN:", ENOTCONN }, { "ENOTDIR:", ENOTDIR }, { "ENOTEMPTY:", ENOTEMPTY }, { "ENOTRECOVERABLE:", ENOTRECOVERABLE }, { "ENOTSOCK:", ENOTSOCK }, { "ENOTSUP:", ENOTSUP }, { "ENOTTY:", ENOTTY }, { "ENOTUNIQ:", ENOTUNIQ }, { "ENXIO:", ENXIO }, { "EOPNOTSUPP:", EOPNOTSUPP }, { "EOVERFLOW:", EOVERFLOW }, { "EOWNERDEAD:", EOWNERDEAD }, { "EPERM:", EPERM }, { "EPFNOSUPPORT:", EPFNOSUPPORT }, { "EPIPE:", EPIPE }, { "EPROTO:", EPROTO }, { "EPROTONOSUPPORT:", EPROTONOSUPPORT }, { "EPROTOTYPE:", EPROTOTYPE }, { "ERANGE:", ERANGE }, { "EREMCHG:", EREMCHG }, { "EREMOTE:", EREMOTE }, { "EREMOTEIO:", EREMOTEIO }, { "ERESTART:", ERESTART }, { "ERFKILL:", ERFKILL }, { "EROFS:", EROFS }, { "ESHUTDOWN:", ESHUTDOWN }, { "ESPIPE:", ESPIPE }, { "ESOCKTNOSUPPORT:", ESOCKTNOSUPPORT }, { "ESRCH:", ESRCH }, { "ESTALE:", ESTALE }, { "ESTRPIPE:", ESTRPIPE }, { "ETIME:", ETIME }, { "ETIMEDOUT:", ETIMEDOUT }, { "ETOOMANYREFS:", ETOOMANYREFS }, { "ETXTBSY:", ETXTBSY }, { "EUCLEAN:", EUCLEAN }, { "EUNATCH:", EUNATCH }, { "EUSERS:", EUSERS }, { "EWOULDBLOCK:", EWOULDBLOCK }, { "EXDEV:", EXDEV }, { "EXFULL:", EXFULL } };
-	for (size_t i = 0; i < sizeof(errno_map) / sizeof(errno_map[0]); i++) {
-		if (strncmp(syscall_name, errno_map[i].name, strlen(errno_map[i].name)) == 0) {
-			action = SCMP_ACT_ERRNO(errno_map[i].value);
-			syscall_name += strlen(errno_map[i].name);
-			int syscall_nr = seccomp_syscall_resolve_name(syscall_name);
-			if (syscall_nr == __NR_SCMP_ERROR) {
-				ruri_error("Failed to resolve syscall: %s\n", syscall_name);
+	/*
+	 * Support errno prefixes like EACCES:chroot, EPERM:unshare, etc.
+	 * The prefix is looked up by binary search instead of comparing with every errno.
+	 */
+	const char *colon = strchr(syscall, ':');
+	if (colon == NULL || colon - syscall >= 32) {
+		return -1;
+	}
+	char prefix[32] = { '\0' };
+	memcpy(prefix, syscall, (size_t)(colon - syscall));
+	const struct SECCOMP_ERRNO *entry = find_errno(prefix);
+	if (entry == NULL) {
+		return -1;
+	}
+	const char *syscall_name = colon + 1;
+	int syscall_nr = seccomp_syscall_resolve_name(syscall_name);
+	if (syscall_nr == __NR_SCMP_ERROR) {
+		ruri_error("Failed to resolve syscall: %s\n", syscall_name);
+	}
+	return seccomp_rule_add(*ctx, SCMP_ACT_ERRNO(entry->value), syscall_nr, 0);
+}
+static uint32_t profile_default_action(const char *_Nonnull profile)
+{
+	/*
+	 * The action for syscalls not in the profile, set by `default EPERM`,
+	 * `default ENOSYS`, `default kill`, `default trap` or `default log`.
+	 * `default allow` makes it a denylist, every line should have an errno prefix.
+	 * Default is EPERM, like docker.
+	 */
+	const char *line = profile;
+	while (line != NULL && *line != '\0') {
+		char action[32] = { '\0' };
+		if (sscanf(line, " default %31s", action) == 1) {
+			if (strcmp(action, "kill") == 0) {
+				return SCMP_ACT_KILL;
+			}
+			if (strcmp(action, "trap") == 0) {
+				return SCMP_ACT_TRAP;
 			}
-			return seccomp_rule_add(*ctx, action, syscall_nr, 0);
+			if (strcmp(action, "log") == 0) {
+				return SCMP_ACT_LOG;
+			}
+			if (strcmp(action, "allow") == 0) {
+				return SCMP_ACT_ALLOW;
+			}
+			const struct SECCOMP_ERRNO *entry = find_errno(action);
+			if (entry == NULL) {
+				ruri_error("{red}Error: unknown default action `%s` in seccomp profile QwQ\n", action);
+			}
+			return SCMP_ACT_ERRNO(entry->value);
 		}
+		line = strchr(line, '\n');
+		line = line == NULL ? NULL : line + 1;
 	}
-	return -1;
+	return SCMP_ACT_ERRNO(EPERM);
 }
-// Setup seccomp filter rule, with libseccomp.
-void ruri_setup_seccomp(const struct RURI_CONTAINER *_Nonnull container)
+static bool parse_profile_condition(const char *_Nonnull str, struct scmp_arg_cmp *_Nonnull cmp)
+{
+	/*
+	 * Parse condition like `arg0==1`, `arg1!=0`, `arg2<=3` or `arg0&0x7e020000==0`.
+	 */
+	char *end = NULL;
+	if (strncmp(str, "arg", 3) != 0 || str[3] < '0' || str[3] > '5') {
+		return false;
+	}
+	memset(cmp, 0, sizeof(struct scmp_arg_cmp));
+	cmp->arg = (unsigned int)(str[3] - '0');
+	const char *p = str + 4;
+	if (*p == '&') {
+		cmp->op = SCMP_CMP_MASKED_EQ;
+		cmp->datum_a = strtoull(p + 1, &end, 0);
+		if (end == p + 1 || strncmp(end, "==", 2) != 0) {
+			return false;
+		}
+		p = end + 2;
+		cmp->datum_b = strtoull(p, &end, 0);
+		return end != p && *end == '\0';
+	}
+	const struct {
+		const char *op;
+		enum scmp_compare cmp;
+	} ops[] = { { "==", SCMP_CMP_EQ }, { "!=", SCMP_CMP_NE }, { "<=", SCMP_CMP_LE }, { ">=", SCMP_CMP_GE }, { "<", SCMP_CMP_LT }, { ">", SCMP_CMP_GT } };
+	for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+		if (strncmp(p, ops[i].op, strlen(ops[i].op)) == 0) {
+			cmp->op = ops[i].cmp;
+			p += strlen(ops[i].op);
+			cmp->datum_a = strtoull(p, &end, 0);
+			return end != p && *end == '\0';
+		}
+	}
+	return false;
+}
+static bool is_denied_syscall(const struct RURI_CONTAINER *_Nonnull container, int syscall_nr)
+{
+	/*
+	 * Check if the syscall is in the deny list, with or without errno prefix.
+	 */
+	for (int i = 0; container->seccomp_denied_syscall[i] != NULL; i++) {
+		const char *name = strchr(container->seccomp_denied_syscall[i], ':');
+		name = name == NULL ? container->seccomp_denied_syscall[i] : name + 1;
+		if (seccomp_syscall_resolve_name(name) == syscall_nr) {
+			return true;
+		}
+	}
+	return false;
+}
+static void add_profile_rules(scmp_filter_ctx ctx, const struct RURI_CONTAINER *_Nonnull container, const char *_Nonnull profile)
+{
+	/*
+	 * The profile is an allowlist, one syscall per line, like:
+	 *
+	 *   # Comment.
+	 *   default EPERM
+	 *   read
+	 *   clone arg0&0x7e020000==0
+	 *   ENOSYS:clone3
+	 *
+	 * An errno prefix returns the errno instead of allowing the syscall, like `-X`.
+	 * A syscall can have up to 6 conditions, and can be listed multiple times.
+	 * Syscalls not known on this arch are skipped, so a profile works on all arches.
+	 * Syscalls in the deny list are not allowed.
+	 */
+	char *buf = strdup(profile);
+	char *saveptr = NULL;
+	int lineno = 0;
+	for (char *line = strtok_r(buf, "\n", &saveptr); line != NULL; line = strtok_r(NULL, "\n", &saveptr)) {
+		lineno++;
+		char *comment = strchr(line, '#');
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+		char *token_saveptr = NULL;
+		char *name = strtok_r(line, " \t\r", &token_saveptr);
+		if (name == NULL || strcmp(name, "default") == 0) {
+			continue;
+		}
+		struct scmp_arg_cmp cmp[6];
+		unsigned int count = 0;
+		for (char *token = strtok_r(NULL, " \t\r", &token_saveptr); token != NULL; token = strtok_r(NULL, " \t\r", &token_saveptr)) {
+			if (count >= 6 || !parse_profile_condition(token, &cmp[count])) {
+				ruri_error("{red}Error: invalid condition `%s` in seccomp profile line %d QwQ\n", token, lineno);
+			}
+			count++;
+		}
+		uint32_t action = SCMP_ACT_ALLOW;
+		char *colon = strchr(name, ':');
+		if (colon != NULL) {
+			*colon = '\0';
+			const struct SECCOMP_ERRNO *entry = find_errno(name);
+			if (entry == NULL) {
+				ruri_error("{red}Error: unknown errno `%s` in seccomp profile line %d QwQ\n", name, lineno);
+			}
+			action = SCMP_ACT_ERRNO(entry->value);
+			name = colon + 1;
+		}
+		int syscall_nr = seccomp_syscall_resolve_name(name);
+		if (syscall_nr == __NR_SCMP_ERROR) {
+			ruri_log("{base}Syscall %s in seccomp profile is not known, skipped\n", name);
+			continue;
+		}
+		if (is_denied_syscall(container, syscall_nr)) {
+			continue;
+		}
+		if (seccomp_rule_add_array(ctx, action, syscall_nr, count, cmp) != 0) {
+			ruri_error("{red}Error: failed to add rule for `%s` in seccomp profile line %d QwQ\n", name, lineno);
+		}
+	}
+	free(buf);
+}
+// Build seccomp filter rule, with libseccomp.
+static scmp_filter_ctx build_seccomp_filter(const struct RURI_CONTAINER *_Nonnull container)
 {
-#ifndef DISABLE_LIBSECCOMP
 	/*
 	 * Based on docker's default seccomp profile.
 	 * This is a blacklist profile.
 	 * NOTE: This profile is not fully tested.
+	 * If an allowlist profile is given, it replaces the built-in profile.
 	 */
-	scmp_filter_ctx ctx = seccomp_init(SCMP_ACT_ALLOW);
+	scmp_filter_ctx ctx = seccomp_init(seccomp_profile == NULL ? SCMP_ACT_ALLOW : profile_default_action(seccomp_profile));
 	// Deny user-defined syscalls.
 	for (int i = 0; container->seccomp_denied_syscall[i] != NULL; i++) {
 		int syscall_nr = seccomp_syscall_resolve_name(container->seccomp_denied_syscall[i]);
@@ -72,11 +246,16 @@ void ruri_setup_seccomp(const struct RURI_CONTAINER *_Nonnull container)
 			if (ruri_resolve_seccomp_errno(container->seccomp_denied_syscall[i], &ctx) != 0) {
 				ruri_error("Failed to resolve syscall: %s\n", container->seccomp_denied_syscall[i]);
 			}
+		} else {
+			seccomp_rule_add(ctx, SCMP_ACT_KILL, syscall_nr, 0);
 		}
-		seccomp_rule_add(ctx, SCMP_ACT_KILL, syscall_nr, 0);
+	}
+	// Allowlist profile, it replaces the built-in profile.
+	if (seccomp_profile != NULL) {
+		add_profile_rules(ctx, container, seccomp_profile);
 	}
 	// Default rules.
-	if (container->enable_default_seccomp) {
+	if (container->enable_default_seccomp && seccomp_profile == NULL) {
 #ifndef DISABLE_LIBCAP
 		if (ruri_is_in_caplist(container->drop_caplist, CAP_SYS_PACCT)) {
 			seccomp_rule_add(ctx, SCMP_ACT_KILL, SCMP_SYS(acct), 0);
@@ -220,8 +399,220 @@ void ruri_setup_seccomp(const struct RURI_CONTAINER *_Nonnull container)
 #endif
 	// Disable no_new_privs bit by default.
 	seccomp_attr_set(ctx, SCMP_FLTATR_CTL_NNP, 0);
-	// Load seccomp rules.
-	seccomp_load(ctx);
+#if SCMP_VER_MAJOR > 2 || (SCMP_VER_MAJOR == 2 && SCMP_VER_MINOR >= 5)
+	// Sort the syscalls into a binary tree instead of comparing them one by one.
+	// It's ignored if libseccomp at runtime is older than 2.5.
+	seccomp_attr_set(ctx, SCMP_FLTATR_CTL_OPTIMIZE, 2);
+	// Do not force the speculative store bypass mitigation.
+	if (container->seccomp_spec_allow) {
+		seccomp_attr_set(ctx, SCMP_FLTATR_CTL_SSB, 1);
+	}
+#endif
+	return ctx;
+}
+static uint64_t seccomp_cache_key(const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * FNV-1a hash of everything the filter depends on:
+	 * ruri version, libseccomp version, arch, profile, denied syscalls and dropped capabilities.
+	 */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	char buf[256] = { '\0' };
+	const struct scmp_version *version = seccomp_version();
+	uint64_t caps = 0;
+#ifndef DISABLE_LIBCAP
+	for (int i = 0; i < 64; i++) {
+		if (ruri_is_in_caplist(container->drop_caplist, i)) {
+			caps |= 1ULL << i;
+		}
+	}
+#endif
+	sprintf(buf, "%s %s %u.%u.%u %u %d %llx", RURI_VERSION, RURI_COMMIT_ID, version->major, version->minor, version->micro, seccomp_arch_native(), container->enable_default_seccomp, (unsigned long long)caps);
+	for (const char *p = buf; *p != '\0'; p++) {
+		hash = (hash ^ (unsigned char)*p) * 0x100000001b3ULL;
+	}
+	for (const char *p = seccomp_profile == NULL ? "" : seccomp_profile; *p != '\0'; p++) {
+		hash = (hash ^ (unsigned char)*p) * 0x100000001b3ULL;
+	}
+	for (int i = 0; container->seccomp_denied_syscall[i] != NULL; i++) {
+		// Hash the '\0' too, so that ["ab", "c"] and ["a", "bc"] are different.
+		for (const char *p = container->seccomp_denied_syscall[i]; true; p++) {
+			hash = (hash ^ (unsigned char)*p) * 0x100000001b3ULL;
+			if (*p == '\0') {
+				break;
+			}
+		}
+	}
+	return hash;
+}
+static bool read_seccomp_cache(int fd, uint64_t key)
+{
+	/*
+	 * Read the cached filter into seccomp_filter.
+	 * The cache is only trusted if it's a regular file owned by us
+	 * and not writable by others.
+	 */
+	struct stat st;
+	struct SECCOMP_CACHE_HEADER header;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 0022) != 0) {
+		return false;
+	}
+	if (read(fd, &header, sizeof(header)) != sizeof(header) || memcmp(header.magic, "RURIBPF1", 8) != 0 || header.key != key) {
+		return false;
+	}
+	if (header.len == 0 || header.len > BPF_MAXINSNS || (size_t)st.st_size != sizeof(header) + header.len * sizeof(struct sock_filter)) {
+		return false;
+	}
+	struct sock_filter *filter = malloc(header.len * sizeof(struct sock_filter));
+	if (read(fd, filter, header.len * sizeof(struct sock_filter)) != (ssize_t)(header.len * sizeof(struct sock_filter))) {
+		free(filter);
+		return false;
+	}
+	seccomp_filter.len = (unsigned short)header.len;
+	seccomp_filter.filter = filter;
+	return true;
+}
+static bool export_seccomp_filter(scmp_filter_ctx ctx)
+{
+	/*
+	 * Export the BPF program of ctx into seccomp_filter.
+	 */
+	int fd = (int)syscall(SYS_memfd_create, "ruri-seccomp", 1U /* MFD_CLOEXEC */);
+	if (fd < 0 || seccomp_export_bpf(ctx, fd) != 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return false;
+	}
+	off_t size = lseek(fd, 0, SEEK_END);
+	if (size <= 0 || size % (off_t)sizeof(struct sock_filter) != 0 || size / (off_t)sizeof(struct sock_filter) > BPF_MAXINSNS) {
+		close(fd);
+		return false;
+	}
+	struct sock_filter *filter = malloc((size_t)size);
+	if (pread(fd, filter, (size_t)size, 0) != size) {
+		free(filter);
+		close(fd);
+		return false;
+	}
+	close(fd);
+	seccomp_filter.len = (unsigned short)(size / (off_t)sizeof(struct sock_filter));
+	seccomp_filter.filter = filter;
+	return true;
+}
+static char *read_seccomp_profile(const char *_Nonnull path)
+{
+	/*
+	 * Read the whole profile, it's small.
+	 */
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		ruri_error("{red}Error: failed to open seccomp profile %s QwQ\n", path);
+	}
+	size_t size = 0;
+	size_t alloc = 4096;
+	char *buf = malloc(alloc);
+	ssize_t len = 0;
+	while ((len = read(fd, buf + size, alloc - size - 1)) > 0) {
+		size += (size_t)len;
+		if (size + 1 >= alloc) {
+			alloc *= 2;
+			buf = realloc(buf, alloc);
+		}
+	}
+	close(fd);
+	buf[size] = '\0';
+	return buf;
+}
+static void write_seccomp_cache(const char *_Nonnull path, uint64_t key)
+{
+	/*
+	 * Write to ${path}.${pid} and rename it, so that the cache is never read half-written.
+	 */
+	char tmp[PATH_MAX + 16] = { '\0' };
+	sprintf(tmp, "%s.%d", path, getpid());
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		return;
+	}
+	struct SECCOMP_CACHE_HEADER header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "RURIBPF1", 8);
+	header.key = key;
+	header.len = seccomp_filter.len;
+	size_t size = seccomp_filter.len * sizeof(struct sock_filter);
+	bool ok = write(fd, &header, sizeof(header)) == sizeof(header) && write(fd, seccomp_filter.filter, size) == (ssize_t)size;
+	close(fd);
+	if (!ok || rename(tmp, path) != 0) {
+		unlink(tmp);
+	}
+}
+#endif
+// Build seccomp filter, or load it from cache.
+void ruri_prepare_seccomp(const struct RURI_CONTAINER *_Nonnull container)
+{
+#ifndef DISABLE_LIBSECCOMP
+	/*
+	 * It's called before chroot(2), because the cache is on the host.
+	 * The filter is cached in RURI_SECCOMP_CACHE_DIR/${key}.bpf,
+	 * so later starts and joins do not need to build it with libseccomp again.
+	 * If the cache is not available, the filter is still built and loaded.
+	 */
+	if (seccomp_filter.filter != NULL) {
+		return;
+	}
+	if (container->seccomp_profile != NULL && seccomp_profile == NULL) {
+		seccomp_profile = read_seccomp_profile(container->seccomp_profile);
+	}
+	uint64_t key = seccomp_cache_key(container);
+	char path[PATH_MAX] = { '\0' };
+	sprintf(path, "%s/%016llx.bpf", RURI_SECCOMP_CACHE_DIR, (unsigned long long)key);
+	int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+	if (fd >= 0) {
+		bool ok = read_seccomp_cache(fd, key);
+		close(fd);
+		if (ok) {
+			ruri_log("{base}Seccomp filter loaded from cache %s\n", path);
+			return;
+		}
+	}
+	scmp_filter_ctx ctx = build_seccomp_filter(container);
+	if (!export_seccomp_filter(ctx)) {
+		// Leave it to seccomp_load(3) in ruri_setup_seccomp().
+		seccomp_release(ctx);
+		return;
+	}
+	seccomp_release(ctx);
+	ruri_mkdirs(RURI_SECCOMP_CACHE_DIR, S_IRWXU);
+	write_seccomp_cache(path, key);
+	ruri_log("{base}Seccomp filter built, %d instructions\n", seccomp_filter.len);
+#endif
+}
+// Setup seccomp filter rule.
+void ruri_setup_seccomp(const struct RURI_CONTAINER *_Nonnull container)
+{
+#ifndef DISABLE_LIBSECCOMP
+	/*
+	 * Load the filter from ruri_prepare_seccomp() with seccomp(2),
+	 * without creating a libseccomp context.
+	 * If it's not prepared, build and load it with libseccomp.
+	 */
+	if (seccomp_filter.filter == NULL) {
+		scmp_filter_ctx ctx = build_seccomp_filter(container);
+		seccomp_load(ctx);
+		seccomp_release(ctx);
+		ruri_log("{base}Seccomp filter loaded\n");
+		return;
+	}
+	// SECCOMP_FILTER_FLAG_SPEC_ALLOW is in linux 4.17.
+	unsigned long flags = container->seccomp_spec_allow ? SECCOMP_FILTER_FLAG_SPEC_ALLOW : 0;
+	if (syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags, &seccomp_filter) != 0 && (flags == 0 || syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, 0, &seccomp_filter) != 0)) {
+		// seccomp(2) is in linux 3.17.
+		if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &seccomp_filter, 0, 0) != 0) {
+			ruri_warning("{yellow}Warning: failed to load seccomp filter: %s{clear}\n", strerror(errno));
+			return;
+		}
+	}
 	ruri_log("{base}Seccomp filter loaded\n");
 #endif
 }
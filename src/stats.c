@@ -0,0 +1,596 @@
+// SPDX-License-Identifier: MIT
+/*
+ *
+ * This file is part of ruri, with ABSOLUTELY NO WARRANTY.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022-2024 Moe-hacker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+#include "include/ruri.h"
+/*
+ * This file provides `ruri --stats`, to show the resource usage of container
+ * from its cgroup, and the summary shown when the container exits.
+ * Memory, CPU, I/O and pids stats are read from cgroup v2 if the controller
+ * is available there, or from the cgroup v1 hierarchy.
+ * Pressure stall information (PSI) is only available in cgroup v2.
+ */
+static const char *const psi_resource[RURI_PSI_COUNT] = { "cpu", "cpu", "memory", "memory", "io", "io" };
+static const char *const psi_kind[RURI_PSI_COUNT] = { "some", "full", "some", "full", "some", "full" };
+static int open_stats_fd(const struct RURI_CONTAINER *_Nonnull container, const struct RURI_MOUNTINFO *_Nonnull info, int v2_fd, const char *_Nonnull v2_file, const char *_Nonnull v1_controller)
+{
+	/*
+	 * Use the cgroup v2 directory if v2_file exists,
+	 * or open the directory in cgroup v1 hierarchy.
+	 * Return -1 if not found.
+	 */
+	if (v2_fd >= 0 && faccessat(v2_fd, v2_file, F_OK, 0) == 0) {
+		return dup(v2_fd);
+	}
+	return ruri_open_cgroup(container, info, v1_controller);
+}
+// Open the cgroup of container for every controller.
+void ruri_open_stats_cgroup(const struct RURI_CONTAINER *_Nonnull container, struct RURI_STATS_CGROUP *_Nonnull cgroup)
+{
+	/*
+	 * The fds are -1 for controllers not available.
+	 * Close them with ruri_close_stats_cgroup().
+	 */
+	cgroup->v2_fd = -1;
+	cgroup->memory_fd = -1;
+	cgroup->cpu_fd = -1;
+	cgroup->cpuacct_fd = -1;
+	cgroup->io_fd = -1;
+	cgroup->pids_fd = -1;
+	struct RURI_MOUNTINFO *info = ruri_read_mountinfo(0);
+	if (info == NULL) {
+		return;
+	}
+	cgroup->v2_fd = ruri_open_cgroup(container, info, NULL);
+	cgroup->memory_fd = open_stats_fd(container, info, cgroup->v2_fd, "memory.current", "memory");
+	// cpu.stat always exists in cgroup v2, but only has usage_usec without cpu controller.
+	cgroup->cpu_fd = open_stats_fd(container, info, cgroup->v2_fd, "cpu.max", "cpu");
+	cgroup->cpuacct_fd = open_stats_fd(container, info, cgroup->v2_fd, "cpu.stat", "cpuacct");
+	cgroup->io_fd = open_stats_fd(container, info, cgroup->v2_fd, "io.stat", "blkio");
+	cgroup->pids_fd = open_stats_fd(container, info, cgroup->v2_fd, "pids.current", "pids");
+	ruri_free_mountinfo(info);
+}
+// Close the fds opened by ruri_open_stats_cgroup().
+void ruri_close_stats_cgroup(struct RURI_STATS_CGROUP *_Nonnull cgroup)
+{
+	int *fds[] = { &cgroup->v2_fd, &cgroup->memory_fd, &cgroup->cpu_fd, &cgroup->cpuacct_fd, &cgroup->io_fd, &cgroup->pids_fd };
+	for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+		if (*fds[i] >= 0) {
+			close(*fds[i]);
+			*fds[i] = -1;
+		}
+	}
+}
+static ssize_t read_stats_file(int cgroup_fd, const char *_Nonnull file, char *_Nonnull buf, size_t size)
+{
+	/*
+	 * Read a control file that might be larger than one page, like io.stat.
+	 */
+	int fd = openat(cgroup_fd, file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	size_t len = 0;
+	ssize_t n = 0;
+	while (len < size - 1 && (n = read(fd, buf + len, size - 1 - len)) > 0) {
+		len += (size_t)n;
+	}
+	close(fd);
+	buf[len] = '\0';
+	return (ssize_t)len;
+}
+static void read_io_stats(int io_fd, struct RURI_CGROUP_STATS *_Nonnull stats)
+{
+	/*
+	 * cgroup v2 io.stat: `MAJ:MIN rbytes=N wbytes=N rios=N wios=N ...`
+	 * cgroup v1 blkio.throttle.io_service_bytes and blkio.throttle.io_serviced: `MAJ:MIN Read N`
+	 * The values of all devices are added up.
+	 */
+	char *buf = malloc(65536);
+	if (read_stats_file(io_fd, "io.stat", buf, 65536) >= 0) {
+		stats->has_io = true;
+		char *saveptr = NULL;
+		for (char *token = strtok_r(buf, " \n", &saveptr); token != NULL; token = strtok_r(NULL, " \n", &saveptr)) {
+			unsigned long long value = 0;
+			if (sscanf(token, "rbytes=%llu", &value) == 1) {
+				stats->read_bytes += value;
+			} else if (sscanf(token, "wbytes=%llu", &value) == 1) {
+				stats->write_bytes += value;
+			} else if (sscanf(token, "rios=%llu", &value) == 1) {
+				stats->read_ios += value;
+			} else if (sscanf(token, "wios=%llu", &value) == 1) {
+				stats->write_ios += value;
+			}
+		}
+		free(buf);
+		return;
+	}
+	const char *files[] = { "blkio.throttle.io_service_bytes", "blkio.throttle.io_serviced" };
+	unsigned long long *reads[] = { &stats->read_bytes, &stats->read_ios };
+	unsigned long long *writes[] = { &stats->write_bytes, &stats->write_ios };
+	for (int i = 0; i < 2; i++) {
+		if (read_stats_file(io_fd, files[i], buf, 65536) < 0) {
+			continue;
+		}
+		stats->has_io = true;
+		char *saveptr = NULL;
+		for (char *line = strtok_r(buf, "\n", &saveptr); line != NULL; line = strtok_r(NULL, "\n", &saveptr)) {
+			char op[16] = { '\0' };
+			unsigned long long value = 0;
+			// The `Total` line has no device.
+			if (sscanf(line, "%*u:%*u %15s %llu", op, &value) != 2) {
+				continue;
+			}
+			if (strcmp(op, "Read") == 0) {
+				*reads[i] += value;
+			} else if (strcmp(op, "Write") == 0) {
+				*writes[i] += value;
+			}
+		}
+	}
+	free(buf);
+}
+static void read_psi_stats(int v2_fd, struct RURI_CGROUP_STATS *_Nonnull stats)
+{
+	/*
+	 * Format of ${resource}.pressure:
+	 * some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+	 * full avg10=0.00 avg60=0.00 avg300=0.00 total=0
+	 */
+	for (int i = 0; i < RURI_PSI_COUNT; i += 2) {
+		char file[32] = { '\0' };
+		char buf[512] = { '\0' };
+		sprintf(file, "%s.pressure", psi_resource[i]);
+		if (read_stats_file(v2_fd, file, buf, sizeof(buf)) <= 0) {
+			continue;
+		}
+		stats->has_psi = true;
+		for (int j = i; j < i + 2; j++) {
+			char *line = strstr(buf, psi_kind[j]);
+			if (line != NULL) {
+				sscanf(line + 4, " avg10=%lf %*s %*s total=%llu", &stats->psi_avg10[j], &stats->psi_total[j]);
+			}
+		}
+	}
+}
+static void read_proc_cpu_stats(const char *_Nonnull container_dir, const struct RURI_CONTAINER *_Nonnull container, struct RURI_CGROUP_STATS *_Nonnull stats)
+{
+	/*
+	 * Without cpuacct, add up the CPU time of processes in container.
+	 * The CPU time of exited processes is lost in this case.
+	 */
+	size_t count = 0;
+	pid_t *pids = ruri_get_container_pids(container_dir, container, &count);
+	long ticks = sysconf(_SC_CLK_TCK);
+	for (size_t i = 0; i < count; i++) {
+		struct RURI_PROC_STAT st;
+		if (ruri_read_proc_stat(pids[i], &st)) {
+			stats->cpu_user += st.utime * 1000000 / (unsigned long long)ticks;
+			stats->cpu_system += st.stime * 1000000 / (unsigned long long)ticks;
+		}
+	}
+	free(pids);
+	stats->cpu_usage = stats->cpu_user + stats->cpu_system;
+	stats->has_cpu = true;
+}
+static void read_ksm_stats(const char *_Nonnull container_dir, const struct RURI_CONTAINER *_Nonnull container, struct RURI_CGROUP_STATS *_Nonnull stats)
+{
+	/*
+	 * Add up /proc/<pid>/ksm_stat of processes in container,
+	 * it's available since linux 6.1.
+	 */
+	size_t count = 0;
+	pid_t *pids = ruri_get_container_pids(container_dir, container, &count);
+	for (size_t i = 0; i < count; i++) {
+		char path[64] = { '\0' };
+		sprintf(path, "/proc/%d/ksm_stat", pids[i]);
+		FILE *fp = fopen(path, "re");
+		if (fp == NULL) {
+			continue;
+		}
+		stats->has_ksm = true;
+		char key[64] = { '\0' };
+		long long value = 0;
+		while (fscanf(fp, "%63s %lld", key, &value) == 2) {
+			if (strcmp(key, "ksm_merging_pages") == 0) {
+				stats->ksm_merging_pages += (unsigned long long)value;
+			} else if (strcmp(key, "ksm_rmap_items") == 0) {
+				stats->ksm_rmap_items += (unsigned long long)value;
+			} else if (strcmp(key, "ksm_process_profit") == 0) {
+				stats->ksm_profit += value;
+			}
+		}
+		fclose(fp);
+	}
+	free(pids);
+}
+static void read_cgroup_stats(const struct RURI_STATS_CGROUP *_Nonnull cgroup, struct RURI_CGROUP_STATS *_Nonnull stats)
+{
+	/*
+	 * Read the stats of container from cgroup.
+	 * The fields not available are left to 0.
+	 */
+	memset(stats, 0, sizeof(struct RURI_CGROUP_STATS));
+	// Memory.
+	int fd = cgroup->memory_fd;
+	if (fd >= 0 && ruri_read_cgroup_value(fd, "memory.current", NULL, &stats->memory_current)) {
+		stats->has_memory = true;
+		ruri_read_cgroup_value(fd, "memory.peak", NULL, &stats->memory_peak);
+		ruri_read_cgroup_value(fd, "memory.stat", "anon", &stats->memory_anon);
+		ruri_read_cgroup_value(fd, "memory.stat", "file", &stats->memory_file);
+	} else if (fd >= 0 && ruri_read_cgroup_value(fd, "memory.usage_in_bytes", NULL, &stats->memory_current)) {
+		stats->has_memory = true;
+		ruri_read_cgroup_value(fd, "memory.max_usage_in_bytes", NULL, &stats->memory_peak);
+		ruri_read_cgroup_value(fd, "memory.stat", "rss", &stats->memory_anon);
+		ruri_read_cgroup_value(fd, "memory.stat", "cache", &stats->memory_file);
+	}
+	if (stats->has_memory) {
+		ruri_read_cgroup_value(fd, "memory.stat", "pgfault", &stats->pgfault);
+		ruri_read_cgroup_value(fd, "memory.stat", "pgmajfault", &stats->pgmajfault);
+	}
+	// CPU.
+	fd = cgroup->cpuacct_fd;
+	if (fd >= 0 && ruri_read_cgroup_value(fd, "cpu.stat", "usage_usec", &stats->cpu_usage)) {
+		stats->has_cpu = true;
+		ruri_read_cgroup_value(fd, "cpu.stat", "user_usec", &stats->cpu_user);
+		ruri_read_cgroup_value(fd, "cpu.stat", "system_usec", &stats->cpu_system);
+	} else if (fd >= 0 && ruri_read_cgroup_value(fd, "cpuacct.usage", NULL, &stats->cpu_usage)) {
+		// cpuacct.usage is in nanoseconds, and cpuacct.stat is in clock ticks.
+		stats->has_cpu = true;
+		stats->cpu_usage /= 1000;
+		unsigned long long ticks = (unsigned long long)sysconf(_SC_CLK_TCK);
+		if (ruri_read_cgroup_value(fd, "cpuacct.stat", "user", &stats->cpu_user)) {
+			stats->cpu_user = stats->cpu_user * 1000000 / ticks;
+		}
+		if (ruri_read_cgroup_value(fd, "cpuacct.stat", "system", &stats->cpu_system)) {
+			stats->cpu_system = stats->cpu_system * 1000000 / ticks;
+		}
+	}
+	fd = cgroup->cpu_fd;
+	if (fd >= 0) {
+		ruri_read_cgroup_value(fd, "cpu.stat", "nr_throttled", &stats->nr_throttled);
+		if (ruri_read_cgroup_value(fd, "cpu.stat", "throttled_time", &stats->throttled_usec)) {
+			stats->throttled_usec /= 1000;
+		} else {
+			ruri_read_cgroup_value(fd, "cpu.stat", "throttled_usec", &stats->throttled_usec);
+		}
+	}
+	// I/O.
+	if (cgroup->io_fd >= 0) {
+		read_io_stats(cgroup->io_fd, stats);
+	}
+	// Pids.
+	fd = cgroup->pids_fd;
+	if (fd >= 0 && ruri_read_cgroup_value(fd, "pids.current", NULL, &stats->pids_current)) {
+		stats->has_pids = true;
+		stats->pids_max = ULLONG_MAX;
+		ruri_read_cgroup_value(fd, "pids.max", NULL, &stats->pids_max);
+	}
+	// PSI.
+	if (cgroup->v2_fd >= 0) {
+		read_psi_stats(cgroup->v2_fd, stats);
+	}
+}
+static char *format_bytes(double bytes, char *_Nonnull buf)
+{
+	/*
+	 * Format bytes like `12.3MiB`, buf should be at least 32 bytes.
+	 */
+	const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+	int i = 0;
+	while (bytes >= 1024 && i < 4) {
+		bytes /= 1024;
+		i++;
+	}
+	if (i == 0) {
+		sprintf(buf, "%.0f%s", bytes, units[i]);
+	} else {
+		sprintf(buf, "%.1f%s", bytes, units[i]);
+	}
+	return buf;
+}
+static double rate(unsigned long long now, unsigned long long prev, double seconds)
+{
+	if (seconds <= 0 || now < prev) {
+		return 0;
+	}
+	return (double)(now - prev) / seconds;
+}
+static void show_stats(const struct RURI_CGROUP_STATS *_Nonnull now, const struct RURI_CGROUP_STATS *_Nullable prev, double seconds)
+{
+	/*
+	 * Show the stats, the rates are got from prev.
+	 * For the first sample, prev is NULL, and the rates are 0.
+	 */
+	const struct RURI_CGROUP_STATS *last = (prev == NULL) ? now : prev;
+	char buf[4][32];
+	if (isatty(STDOUT_FILENO)) {
+		printf("\033[H\033[2J");
+	}
+	if (now->has_memory) {
+		printf("Memory: current %s, ", format_bytes((double)now->memory_current, buf[0]));
+		if (now->memory_peak > 0) {
+			printf("peak %s, ", format_bytes((double)now->memory_peak, buf[1]));
+		}
+		printf("anon %s, file %s, %.0f faults/s, %.0f major faults/s\n", format_bytes((double)now->memory_anon, buf[2]), format_bytes((double)now->memory_file, buf[3]), rate(now->pgfault, last->pgfault, seconds), rate(now->pgmajfault, last->pgmajfault, seconds));
+	} else {
+		printf("Memory: n/a\n");
+	}
+	if (now->has_cpu) {
+		// usec per second is 1e6, so divide by 1e4 to get percent.
+		printf("CPU: %.1f%% (user %.1f%%, system %.1f%%), total %.2fs, throttled %llu times (%.1fms/s)\n", rate(now->cpu_usage, last->cpu_usage, seconds) / 1e4, rate(now->cpu_user, last->cpu_user, seconds) / 1e4, rate(now->cpu_system, last->cpu_system, seconds) / 1e4, (double)now->cpu_usage / 1e6, now->nr_throttled, rate(now->throttled_usec, last->throttled_usec, seconds) / 1e3);
+	} else {
+		printf("CPU: n/a\n");
+	}
+	if (now->has_io) {
+		printf("I/O: read %s/s (%.0f IOPS), write %s/s (%.0f IOPS), total read %s, write %s\n", format_bytes(rate(now->read_bytes, last->read_bytes, seconds), buf[0]), rate(now->read_ios, last->read_ios, seconds), format_bytes(rate(now->write_bytes, last->write_bytes, seconds), buf[1]), rate(now->write_ios, last->write_ios, seconds), format_bytes((double)now->read_bytes, buf[2]), format_bytes((double)now->write_bytes, buf[3]));
+	} else {
+		printf("I/O: n/a\n");
+	}
+	if (now->has_pids && now->pids_max == ULLONG_MAX) {
+		printf("Pids: %llu/max\n", now->pids_current);
+	} else if (now->has_pids) {
+		printf("Pids: %llu/%llu\n", now->pids_current, now->pids_max);
+	} else {
+		printf("Pids: n/a\n");
+	}
+	if (now->has_ksm) {
+		printf("KSM: %llu merging pages (%s), %llu rmap items, profit %s%s\n", now->ksm_merging_pages, format_bytes((double)now->ksm_merging_pages * (double)sysconf(_SC_PAGESIZE), buf[0]), now->ksm_rmap_items, now->ksm_profit < 0 ? "-" : "", format_bytes((double)llabs(now->ksm_profit), buf[1]));
+	}
+	if (now->has_psi) {
+		printf("Pressure (avg10): cpu some %.2f full %.2f, memory some %.2f full %.2f, io some %.2f full %.2f\n", now->psi_avg10[0], now->psi_avg10[1], now->psi_avg10[2], now->psi_avg10[3], now->psi_avg10[4], now->psi_avg10[5]);
+	} else {
+		printf("Pressure: n/a\n");
+	}
+	fflush(stdout);
+}
+static void show_stats_json(const struct RURI_CGROUP_STATS *_Nonnull now, const struct RURI_CGROUP_STATS *_Nullable prev, double seconds)
+{
+	/*
+	 * Show the stats as a line of JSON, unavailable groups are null.
+	 */
+	const struct RURI_CGROUP_STATS *last = (prev == NULL) ? now : prev;
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	printf("{\"time\":%ld.%03ld,\"interval_ms\":%ld,\"memory\":", (long)ts.tv_sec, ts.tv_nsec / 1000000, (long)(seconds * 1000));
+	if (now->has_memory) {
+		printf("{\"current\":%llu,\"peak\":", now->memory_current);
+		if (now->memory_peak > 0) {
+			printf("%llu", now->memory_peak);
+		} else {
+			printf("null");
+		}
+		printf(",\"anon\":%llu,\"file\":%llu,\"pgfault\":%llu,\"pgmajfault\":%llu,\"pgfault_per_sec\":%.0f,\"pgmajfault_per_sec\":%.0f}", now->memory_anon, now->memory_file, now->pgfault, now->pgmajfault, rate(now->pgfault, last->pgfault, seconds), rate(now->pgmajfault, last->pgmajfault, seconds));
+	} else {
+		printf("null");
+	}
+	printf(",\"cpu\":");
+	if (now->has_cpu) {
+		printf("{\"usage_usec\":%llu,\"user_usec\":%llu,\"system_usec\":%llu,\"percent\":%.2f,\"user_percent\":%.2f,\"system_percent\":%.2f,\"nr_throttled\":%llu,\"throttled_usec\":%llu}", now->cpu_usage, now->cpu_user, now->cpu_system, rate(now->cpu_usage, last->cpu_usage, seconds) / 1e4, rate(now->cpu_user, last->cpu_user, seconds) / 1e4, rate(now->cpu_system, last->cpu_system, seconds) / 1e4, now->nr_throttled, now->throttled_usec);
+	} else {
+		printf("null");
+	}
+	printf(",\"io\":");
+	if (now->has_io) {
+		printf("{\"read_bytes\":%llu,\"write_bytes\":%llu,\"read_ios\":%llu,\"write_ios\":%llu,\"read_bytes_per_sec\":%.0f,\"write_bytes_per_sec\":%.0f,\"read_iops\":%.0f,\"write_iops\":%.0f}", now->read_bytes, now->write_bytes, now->read_ios, now->write_ios, rate(now->read_bytes, last->read_bytes, seconds), rate(now->write_bytes, last->write_bytes, seconds), rate(now->read_ios, last->read_ios, seconds), rate(now->write_ios, last->write_ios, seconds));
+	} else {
+		printf("null");
+	}
+	printf(",\"pids\":");
+	if (now->has_pids) {
+		printf("{\"current\":%llu,\"max\":", now->pids_current);
+		if (now->pids_max == ULLONG_MAX) {
+			printf("null}");
+		} else {
+			printf("%llu}", now->pids_max);
+		}
+	} else {
+		printf("null");
+	}
+	printf(",\"ksm\":");
+	if (now->has_ksm) {
+		printf("{\"merging_pages\":%llu,\"rmap_items\":%llu,\"profit\":%lld}", now->ksm_merging_pages, now->ksm_rmap_items, now->ksm_profit);
+	} else {
+		printf("null");
+	}
+	printf(",\"pressure\":");
+	if (now->has_psi) {
+		printf("{");
+		for (int i = 0; i < RURI_PSI_COUNT; i += 2) {
+			printf("%s\"%s\":{\"some\":{\"avg10\":%.2f,\"total_usec\":%llu},\"full\":{\"avg10\":%.2f,\"total_usec\":%llu}}", i == 0 ? "" : ",", psi_resource[i], now->psi_avg10[i], now->psi_total[i], now->psi_avg10[i + 1], now->psi_total[i + 1]);
+		}
+		printf("}");
+	} else {
+		printf("null");
+	}
+	printf("}\n");
+	fflush(stdout);
+}
+static void write_prometheus_file(const char *_Nonnull path, const char *_Nonnull container_dir, const struct RURI_CGROUP_STATS *_Nonnull stats)
+{
+	/*
+	 * Write the stats in Prometheus text format, for the textfile collector of node_exporter.
+	 * The file is written to ${path}.tmp and renamed, so it's never read half-written.
+	 */
+	char tmp[PATH_MAX] = { '\0' };
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	FILE *fp = fopen(tmp, "we");
+	if (fp == NULL) {
+		ruri_warning("{yellow}Warning: failed to open %s{clear}\n", tmp);
+		return;
+	}
+	// Escape the label value.
+	char label[PATH_MAX * 2] = { '\0' };
+	size_t len = 0;
+	for (const char *p = container_dir; *p != '\0' && len < sizeof(label) - 2; p++) {
+		if (*p == '\\' || *p == '"') {
+			label[len++] = '\\';
+		}
+		label[len++] = *p;
+	}
+	label[len] = '\0';
+	struct {
+		bool available;
+		const char *name;
+		const char *type;
+		const char *help;
+		double value;
+	} metrics[] = {
+		{ stats->has_memory, "ruri_memory_current_bytes", "gauge", "Memory usage of container.", (double)stats->memory_current },
+		{ stats->has_memory && stats->memory_peak > 0, "ruri_memory_peak_bytes", "gauge", "Peak memory usage of container.", (double)stats->memory_peak },
+		{ stats->has_memory, "ruri_memory_anon_bytes", "gauge", "Anonymous memory of container.", (double)stats->memory_anon },
+		{ stats->has_memory, "ruri_memory_file_bytes", "gauge", "Page cache of container.", (double)stats->memory_file },
+		{ stats->has_memory, "ruri_memory_pgfault_total", "counter", "Page faults in container.", (double)stats->pgfault },
+		{ stats->has_memory, "ruri_memory_pgmajfault_total", "counter", "Major page faults in container.", (double)stats->pgmajfault },
+		{ stats->has_cpu, "ruri_cpu_usage_seconds_total", "counter", "CPU time used by container.", (double)stats->cpu_usage / 1e6 },
+		{ stats->has_cpu, "ruri_cpu_user_seconds_total", "counter", "User CPU time used by container.", (double)stats->cpu_user / 1e6 },
+		{ stats->has_cpu, "ruri_cpu_system_seconds_total", "counter", "System CPU time used by container.", (double)stats->cpu_system / 1e6 },
+		{ stats->has_cpu, "ruri_cpu_throttled_periods_total", "counter", "Periods that container was throttled.", (double)stats->nr_throttled },
+		{ stats->has_cpu, "ruri_cpu_throttled_seconds_total", "counter", "Time that container was throttled.", (double)stats->throttled_usec / 1e6 },
+		{ stats->has_io, "ruri_io_read_bytes_total", "counter", "Bytes read by container.", (double)stats->read_bytes },
+		{ stats->has_io, "ruri_io_write_bytes_total", "counter", "Bytes written by container.", (double)stats->write_bytes },
+		{ stats->has_io, "ruri_io_read_ios_total", "counter", "Read I/Os of container.", (double)stats->read_ios },
+		{ stats->has_io, "ruri_io_write_ios_total", "counter", "Write I/Os of container.", (double)stats->write_ios },
+		{ stats->has_pids, "ruri_pids_current", "gauge", "Number of processes in container.", (double)stats->pids_current },
+		{ stats->has_pids && stats->pids_max != ULLONG_MAX, "ruri_pids_max", "gauge", "Max number of processes in container.", (double)stats->pids_max },
+		{ stats->has_ksm, "ruri_ksm_merging_pages", "gauge", "Pages of container merged by KSM.", (double)stats->ksm_merging_pages },
+		{ stats->has_ksm, "ruri_ksm_rmap_items", "gauge", "KSM rmap items of container.", (double)stats->ksm_rmap_items },
+		{ stats->has_ksm, "ruri_ksm_profit_bytes", "gauge", "Memory saved by KSM in container.", (double)stats->ksm_profit },
+	};
+	for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]); i++) {
+		if (!metrics[i].available) {
+			continue;
+		}
+		fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", metrics[i].name, metrics[i].help, metrics[i].name, metrics[i].type);
+		fprintf(fp, "%s{container=\"%s\"} %.15g\n", metrics[i].name, label, metrics[i].value);
+	}
+	if (stats->has_psi) {
+		fprintf(fp, "# HELP ruri_pressure_stalled_seconds_total Time that tasks in container were stalled.\n# TYPE ruri_pressure_stalled_seconds_total counter\n");
+		for (int i = 0; i < RURI_PSI_COUNT; i++) {
+			fprintf(fp, "ruri_pressure_stalled_seconds_total{container=\"%s\",resource=\"%s\",kind=\"%s\"} %.6f\n", label, psi_resource[i], psi_kind[i], (double)stats->psi_total[i] / 1e6);
+		}
+	}
+	fclose(fp);
+	if (rename(tmp, path) != 0) {
+		ruri_warning("{yellow}Warning: failed to write %s{clear}\n", path);
+	}
+}
+// Show resource usage of container.
+void ruri_container_stats(const char *_Nonnull container_dir, int interval_ms, int iterations, bool json, const char *_Nullable prometheus_file)
+{
+	/*
+	 * Sample the cgroup stats of container every interval_ms,
+	 * and show the values with the rates since the last sample.
+	 * If iterations > 0, exit after showing iterations samples,
+	 * or it will run until the cgroup of container is gone.
+	 */
+	ruri_log("{base}Container directory: {cyan}%s\n", container_dir);
+	if (geteuid() != 0) {
+		ruri_warning("{yellow}Warning: Please run `ruri --stats` with sudo.\n");
+	}
+	if (interval_ms <= 0) {
+		ruri_error("{red}Error: invalid interval QwQ\n");
+	}
+	struct RURI_CONTAINER *container = ruri_read_info(NULL, container_dir);
+	struct RURI_STATS_CGROUP cgroup;
+	ruri_open_stats_cgroup(container, &cgroup);
+	if (cgroup.v2_fd < 0 && cgroup.memory_fd < 0 && cgroup.cpu_fd < 0 && cgroup.cpuacct_fd < 0 && cgroup.io_fd < 0 && cgroup.pids_fd < 0) {
+		ruri_error("{red}Error: cgroup of container not found, is the container running? QwQ\n");
+	}
+	struct RURI_CGROUP_STATS stats[2];
+	struct RURI_CGROUP_STATS *now = &stats[0];
+	struct RURI_CGROUP_STATS *prev = NULL;
+	struct timespec prev_time;
+	struct timespec now_time;
+	clock_gettime(CLOCK_MONOTONIC, &prev_time);
+	for (int i = 0; iterations <= 0 || i < iterations; i++) {
+		read_cgroup_stats(&cgroup, now);
+		if (!now->has_cpu) {
+			read_proc_cpu_stats(container_dir, container, now);
+		}
+		read_ksm_stats(container_dir, container, now);
+		clock_gettime(CLOCK_MONOTONIC, &now_time);
+		double seconds = (double)(now_time.tv_sec - prev_time.tv_sec) + (double)(now_time.tv_nsec - prev_time.tv_nsec) / 1e9;
+		if (json) {
+			show_stats_json(now, prev, seconds);
+		} else {
+			show_stats(now, prev, seconds);
+		}
+		if (prometheus_file != NULL) {
+			write_prometheus_file(prometheus_file, container_dir, now);
+		}
+		// The cgroup is removed after `ruri -U`.
+		if (cgroup.v2_fd >= 0 && faccessat(cgroup.v2_fd, "cgroup.procs", F_OK, 0) != 0) {
+			break;
+		}
+		if (iterations > 0 && i + 1 >= iterations) {
+			break;
+		}
+		prev = now;
+		now = (now == &stats[0]) ? &stats[1] : &stats[0];
+		prev_time = now_time;
+		usleep((useconds_t)interval_ms * 1000);
+	}
+	ruri_close_stats_cgroup(&cgroup);
+	free(container);
+	exit(EXIT_SUCCESS);
+}
+// Show the summary when container exits.
+void ruri_show_exit_summary(const struct RURI_CONTAINER *_Nonnull container, int status, const struct rusage *_Nonnull usage)
+{
+	/*
+	 * Called by the ruri process waiting for the container.
+	 * usage is from wait4(2), it includes the children waited by the container.
+	 * memory.peak and CPU time of the whole cgroup are also shown if available.
+	 */
+	if (container->no_warnings) {
+		return;
+	}
+	char buf[2][32];
+	if (WIFSIGNALED(status)) {
+		cfprintf(stderr, "{base}Container killed by signal %d", WTERMSIG(status));
+	} else {
+		cfprintf(stderr, "{base}Container exited with status %d", WEXITSTATUS(status));
+	}
+	double user = (double)usage->ru_utime.tv_sec + (double)usage->ru_utime.tv_usec / 1e6;
+	double system = (double)usage->ru_stime.tv_sec + (double)usage->ru_stime.tv_usec / 1e6;
+	// ru_maxrss is in KiB.
+	cfprintf(stderr, "{base}, CPU time %.2fs (user %.2fs, system %.2fs), max RSS %s", user + system, user, system, format_bytes((double)usage->ru_maxrss * 1024, buf[0]));
+	struct RURI_STATS_CGROUP cgroup;
+	ruri_open_stats_cgroup(container, &cgroup);
+	struct RURI_CGROUP_STATS stats;
+	read_cgroup_stats(&cgroup, &stats);
+	ruri_close_stats_cgroup(&cgroup);
+	if (stats.has_memory && stats.memory_peak > 0) {
+		cfprintf(stderr, "{base}, memory.peak %s", format_bytes((double)stats.memory_peak, buf[1]));
+	}
+	if (stats.has_cpu) {
+		cfprintf(stderr, "{base}, cgroup CPU time %.2fs", (double)stats.cpu_usage / 1e6);
+	}
+	cfprintf(stderr, "{clear}\n");
+}
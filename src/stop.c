@@ -0,0 +1,261 @@
+// SPDX-License-Identifier: MIT
+/*
+ *
+ * This file is part of ruri, with ABSOLUTELY NO WARRANTY.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022-2024 Moe-hacker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+#include "include/ruri.h"
+/*
+ * This file provides `ruri --stop`, to stop the container gracefully.
+ * We send SIGTERM to every process in container through pidfd,
+ * so that the signal will not be sent to another process if the pid is reused,
+ * and wait for the pidfds with poll(2).
+ * Processes that are still alive after the timeout will be killed
+ * by cgroup.kill or SIGKILL.
+ */
+static long elapsed_ms(const struct timespec *_Nonnull start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+static int send_signal(const struct RURI_STOP_PROC *_Nonnull proc, int sig)
+{
+	/*
+	 * Send signal through pidfd, or fallback to kill(2).
+	 */
+	if (proc->pidfd >= 0) {
+		return (int)syscall(SYS_pidfd_send_signal, proc->pidfd, sig, NULL, 0);
+	}
+	return kill(proc->pid, sig);
+}
+static bool is_alive(const struct RURI_STOP_PROC *_Nonnull proc)
+{
+	/*
+	 * Check if the process is alive without pidfd.
+	 * Zombies are treated as exited.
+	 */
+	struct RURI_PROC_STAT st;
+	if (!ruri_read_proc_stat(proc->pid, &st)) {
+		return false;
+	}
+	return st.state != 'Z' && st.state != 'X';
+}
+static void add_proc(struct RURI_STOP_PROC **_Nonnull procs, size_t *_Nonnull count, size_t *_Nonnull size, pid_t pid)
+{
+	/*
+	 * Open pidfd for pid, and send SIGTERM to it.
+	 */
+	struct RURI_PROC_STAT st;
+	if (!ruri_read_proc_stat(pid, &st)) {
+		return;
+	}
+	if (*count == *size) {
+		*size *= 2;
+		*procs = realloc(*procs, sizeof(struct RURI_STOP_PROC) * *size);
+	}
+	struct RURI_STOP_PROC *proc = &(*procs)[*count];
+	proc->pid = pid;
+	proc->pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+	strcpy(proc->comm, st.comm);
+	proc->exit_ms = -1;
+	proc->killed = false;
+	// The process might exit between reading stat and pidfd_open().
+	if (proc->pidfd < 0 && errno == ESRCH) {
+		return;
+	}
+	ruri_log("{base}Sending SIGTERM to %d\n", pid);
+	send_signal(proc, SIGTERM);
+	(*count)++;
+}
+static bool have_proc(const struct RURI_STOP_PROC *_Nonnull procs, size_t count, pid_t pid)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (procs[i].pid == pid) {
+			return true;
+		}
+	}
+	return false;
+}
+static size_t wait_procs(struct RURI_STOP_PROC **_Nonnull procs_p, size_t *_Nonnull count, size_t *_Nonnull size, struct RURI_PROC_TRACKER *_Nullable tracker, const struct timespec *_Nonnull start, long deadline_ms, bool killed)
+{
+	/*
+	 * Wait for processes to exit until deadline_ms.
+	 * New processes forked in container are reported by tracker,
+	 * they will also get SIGTERM.
+	 * Return the number of processes still running.
+	 */
+	size_t running = 0;
+	struct pollfd *fds = NULL;
+	size_t *index = NULL;
+	while (true) {
+		// procs might be realloc()ed by add_proc().
+		struct RURI_STOP_PROC *procs = *procs_p;
+		running = 0;
+		free(fds);
+		free(index);
+		fds = malloc(sizeof(struct pollfd) * (*count + 1));
+		index = malloc(sizeof(size_t) * (*count + 1));
+		size_t nfds = 0;
+		bool need_check = false;
+		for (size_t i = 0; i < *count; i++) {
+			if (procs[i].exit_ms >= 0) {
+				continue;
+			}
+			running++;
+			if (procs[i].pidfd >= 0) {
+				fds[nfds].fd = procs[i].pidfd;
+				fds[nfds].events = POLLIN;
+				fds[nfds].revents = 0;
+				index[nfds] = i;
+				nfds++;
+			} else {
+				need_check = true;
+			}
+		}
+		long left = deadline_ms - elapsed_ms(start);
+		if (running == 0 || left <= 0) {
+			break;
+		}
+		// Without pidfd, we have to check the processes every 10ms.
+		int timeout = (int)(left > 100 ? 100 : left);
+		if (need_check && timeout > 10) {
+			timeout = 10;
+		}
+		poll(fds, nfds, timeout);
+		for (size_t i = 0; i < nfds; i++) {
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+				procs[index[i]].exit_ms = elapsed_ms(start);
+				procs[index[i]].killed = killed;
+			}
+		}
+		for (size_t i = 0; need_check && i < *count; i++) {
+			if (procs[i].exit_ms < 0 && procs[i].pidfd < 0 && !is_alive(&procs[i])) {
+				procs[i].exit_ms = elapsed_ms(start);
+				procs[i].killed = killed;
+			}
+		}
+		// Stop the processes forked while we are waiting.
+		if (tracker != NULL && ruri_proc_tracker_poll(tracker, 0) > 0) {
+			for (size_t i = 0; i < tracker->count; i++) {
+				if (!have_proc(procs, *count, tracker->pids[i])) {
+					add_proc(procs_p, count, size, tracker->pids[i]);
+				}
+			}
+		}
+	}
+	free(fds);
+	free(index);
+	return running;
+}
+// Stop container gracefully.
+void ruri_stop_container(const char *_Nonnull container_dir, int timeout_s)
+{
+	/*
+	 * Send SIGTERM to all processes in container,
+	 * wait for them to exit for timeout_s seconds,
+	 * and kill the stragglers.
+	 * The time used by each process to exit is reported.
+	 */
+	ruri_log("{base}Container directory: {cyan}%s\n", container_dir);
+	if (geteuid() != 0) {
+		ruri_warning("{yellow}Warning: Please run `ruri --stop` with sudo.\n");
+	}
+	if (timeout_s < 0) {
+		ruri_error("{red}Error: invalid timeout QwQ\n");
+	}
+	struct RURI_CONTAINER *container = ruri_read_info(NULL, container_dir);
+	// Subscribe to proc connector before getting pids, so no fork will be missed.
+	struct RURI_PROC_TRACKER *tracker = ruri_proc_tracker_new();
+	size_t pid_count = 0;
+	pid_t *pids = ruri_get_container_pids(container_dir, container, &pid_count);
+	size_t size = pid_count + 16;
+	size_t count = 0;
+	struct RURI_STOP_PROC *procs = malloc(sizeof(struct RURI_STOP_PROC) * size);
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; i < pid_count; i++) {
+		if (tracker != NULL) {
+			ruri_proc_tracker_add(tracker, pids[i]);
+		}
+		add_proc(&procs, &count, &size, pids[i]);
+	}
+	free(pids);
+	// Processes that survived SIGKILL.
+	size_t remaining = 0;
+	if (count == 0) {
+		cprintf("{base}No process in container{clear}\n");
+	} else {
+		size_t running = wait_procs(&procs, &count, &size, tracker, &start, (long)timeout_s * 1000, false);
+		// Kill the stragglers.
+		if (running > 0) {
+			cprintf("{base}Timeout, killing %zu process(es)\n", running);
+			struct RURI_MOUNTINFO *info = ruri_read_mountinfo(0);
+			if (info == NULL || !ruri_kill_cgroup(container, info)) {
+				for (size_t i = 0; i < count; i++) {
+					if (procs[i].exit_ms < 0) {
+						send_signal(&procs[i], SIGKILL);
+					}
+				}
+			}
+			ruri_free_mountinfo(info);
+			wait_procs(&procs, &count, &size, tracker, &start, (long)timeout_s * 1000 + 5000, true);
+		}
+		// Report.
+		size_t killed = 0;
+		long used_ms = 0;
+		for (size_t i = 0; i < count; i++) {
+			if (procs[i].exit_ms < 0) {
+				cprintf("{base}%d %s: {red}still running{clear}\n", procs[i].pid, procs[i].comm);
+				remaining++;
+				continue;
+			}
+			if (procs[i].killed) {
+				killed++;
+				cprintf("{base}%d %s: {yellow}killed{base} after %ldms{clear}\n", procs[i].pid, procs[i].comm, procs[i].exit_ms);
+			} else {
+				cprintf("{base}%d %s: {green}exited{base} after %ldms{clear}\n", procs[i].pid, procs[i].comm, procs[i].exit_ms);
+			}
+			if (procs[i].exit_ms > used_ms) {
+				used_ms = procs[i].exit_ms;
+			}
+		}
+		cprintf("{base}%zu process(es) stopped in %ldms, %zu killed{clear}\n", count - remaining, used_ms, killed);
+		if (remaining > 0) {
+			cprintf("{red}%zu process(es) still running{clear}\n", remaining);
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (procs[i].pidfd >= 0) {
+			close(procs[i].pidfd);
+		}
+	}
+	free(procs);
+	ruri_proc_tracker_free(tracker);
+	free(container);
+	// Let scripts know that the container is not stopped.
+	exit(remaining > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,361 @@
+// SPDX-License-Identifier: MIT
+/*
+ *
+ * This file is part of ruri, with ABSOLUTELY NO WARRANTY.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022-2024 Moe-hacker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+#include "include/ruri.h"
+/*
+ * This file provides `ruri --top`, a top-like mode for container.
+ * It samples /proc/pid/stat, /proc/pid/statm and /proc/pid/io
+ * for the processes in container at an interval,
+ * and shows CPU%, RSS, I/O bytes and state changes of each process,
+ * with pids.current and pids.max of the container cgroup.
+ * The processes are got by ruri_get_container_pids(),
+ * and then tracked by the proc connector if available.
+ */
+static void read_top_sample(pid_t pid, struct RURI_TOP_SAMPLE *_Nonnull sample)
+{
+	/*
+	 * Read /proc/pid/statm and /proc/pid/io.
+	 * /proc/pid/stat should be already read into sample->stat.
+	 * The fields are left to 0 if the files are not readable.
+	 */
+	char path[PATH_MAX];
+	char buf[1024];
+	sample->rss_pages = 0;
+	sample->read_bytes = 0;
+	sample->write_bytes = 0;
+	sprintf(path, "/proc/%d/statm", pid);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		ssize_t len = read(fd, buf, sizeof(buf) - 1);
+		if (len > 0) {
+			buf[len] = '\0';
+			// Format: size resident shared text lib data dt
+			sscanf(buf, "%*d %ld", &sample->rss_pages);
+		}
+		close(fd);
+	}
+	sprintf(path, "/proc/%d/io", pid);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		ssize_t len = read(fd, buf, sizeof(buf) - 1);
+		if (len > 0) {
+			buf[len] = '\0';
+			char *p = strstr(buf, "\nread_bytes:");
+			if (p != NULL) {
+				sample->read_bytes = strtoull(p + strlen("\nread_bytes:"), NULL, 10);
+			}
+			p = strstr(buf, "\nwrite_bytes:");
+			if (p != NULL) {
+				sample->write_bytes = strtoull(p + strlen("\nwrite_bytes:"), NULL, 10);
+			}
+		}
+		close(fd);
+	}
+}
+static struct RURI_TOP_SAMPLE *take_samples(const pid_t *_Nonnull pids, size_t pid_count, size_t *_Nonnull count)
+{
+	/*
+	 * Sample all processes in pids[].
+	 * The return value is sorted by pid if pids[] is sorted.
+	 * Warning: free() after use.
+	 */
+	struct RURI_TOP_SAMPLE *ret = malloc(sizeof(struct RURI_TOP_SAMPLE) * (pid_count + 1));
+	*count = 0;
+	for (size_t i = 0; i < pid_count; i++) {
+		if (!ruri_read_proc_stat(pids[i], &ret[*count].stat)) {
+			continue;
+		}
+		read_top_sample(pids[i], &ret[*count]);
+		(*count)++;
+	}
+	return ret;
+}
+// For bsearch(3).
+static int compare_sample(const void *_Nonnull a, const void *_Nonnull b)
+{
+	pid_t pa = ((const struct RURI_TOP_SAMPLE *)a)->stat.pid;
+	pid_t pb = ((const struct RURI_TOP_SAMPLE *)b)->stat.pid;
+	return (pa > pb) - (pa < pb);
+}
+static void print_json_string(const char *_Nonnull str)
+{
+	/*
+	 * Print str as a JSON string.
+	 */
+	putchar('"');
+	for (const unsigned char *p = (const unsigned char *)str; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\') {
+			printf("\\%c", *p);
+		} else if (*p < 0x20) {
+			printf("\\u%04x", *p);
+		} else {
+			putchar(*p);
+		}
+	}
+	putchar('"');
+}
+static void show_pids(int pids_fd, unsigned long long *_Nonnull max_events, bool json)
+{
+	/*
+	 * Show pids.current and pids.max of the container cgroup,
+	 * and warn if fork() failed because of pids.max since the last sample.
+	 */
+	unsigned long long current = 0;
+	unsigned long long max = ULLONG_MAX;
+	unsigned long long events = 0;
+	if (pids_fd < 0 || !ruri_read_cgroup_value(pids_fd, "pids.current", NULL, &current)) {
+		return;
+	}
+	ruri_read_cgroup_value(pids_fd, "pids.max", NULL, &max);
+	ruri_read_cgroup_value(pids_fd, "pids.events", "max", &events);
+	if (json) {
+		printf(",\"pids\":{\"current\":%llu,\"max\":", current);
+		if (max == ULLONG_MAX) {
+			printf("null");
+		} else {
+			printf("%llu", max);
+		}
+		printf(",\"max_events\":%llu}", events);
+	} else if (max == ULLONG_MAX) {
+		printf("Pids: %llu/max\n", current);
+	} else {
+		printf("Pids: %llu/%llu, pids.max reached %llu times\n", current, max, events);
+	}
+	if (events > *max_events) {
+		ruri_warning("{yellow}Warning: pids.max reached %llu times, fork() failed in container{clear}\n", events - *max_events);
+	}
+	*max_events = events;
+}
+static void show_samples(const struct RURI_TOP_SAMPLE *_Nonnull now, size_t count, const struct RURI_TOP_SAMPLE *_Nullable prev, size_t prev_count, double seconds, int pids_fd, unsigned long long *_Nonnull pids_events, bool json)
+{
+	/*
+	 * Show the deltas between prev and now.
+	 * For the first sample, prev is NULL, and we only show the current values.
+	 */
+	long ticks = sysconf(_SC_CLK_TCK);
+	long page_size = sysconf(_SC_PAGESIZE);
+	double total_cpu = 0;
+	unsigned long long total_rss = 0;
+	double total_read = 0;
+	double total_write = 0;
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	if (json) {
+		printf("{\"time\":%ld.%03ld,\"interval_ms\":%ld,\"processes\":[", (long)ts.tv_sec, ts.tv_nsec / 1000000, (long)(seconds * 1000));
+	} else {
+		// Clear the screen like top(1) if stdout is a terminal.
+		if (isatty(STDOUT_FILENO)) {
+			printf("\033[H\033[2J");
+		}
+		printf("%-8s %-8s %-6s %7s %10s %10s %10s %7s %s\n", "PID", "PPID", "STATE", "CPU%", "RSS(KiB)", "READ/s", "WRITE/s", "THREADS", "NAME");
+	}
+	for (size_t i = 0; i < count; i++) {
+		const struct RURI_TOP_SAMPLE *last = NULL;
+		if (prev != NULL) {
+			last = bsearch(&now[i], prev, prev_count, sizeof(struct RURI_TOP_SAMPLE), compare_sample);
+			// The pid is reused by another process.
+			if (last != NULL && last->stat.starttime != now[i].stat.starttime) {
+				last = NULL;
+			}
+		}
+		double cpu = 0;
+		double read_rate = 0;
+		double write_rate = 0;
+		if (last != NULL && seconds > 0) {
+			cpu = (double)(now[i].stat.utime + now[i].stat.stime - last->stat.utime - last->stat.stime) / (double)ticks / seconds * 100;
+			read_rate = (double)(now[i].read_bytes - last->read_bytes) / seconds;
+			write_rate = (double)(now[i].write_bytes - last->write_bytes) / seconds;
+		}
+		unsigned long long rss = (unsigned long long)now[i].rss_pages * (unsigned long long)page_size;
+		total_cpu += cpu;
+		total_rss += rss;
+		total_read += read_rate;
+		total_write += write_rate;
+		// State delta, `+` means new process.
+		char state[8] = { '\0' };
+		if (prev == NULL || last == NULL || last->stat.state == now[i].stat.state) {
+			sprintf(state, "%s%c", (prev != NULL && last == NULL) ? "+" : "", now[i].stat.state);
+		} else {
+			sprintf(state, "%c->%c", last->stat.state, now[i].stat.state);
+		}
+		if (json) {
+			printf("%s{\"pid\":%d,\"ppid\":%d,\"name\":", i == 0 ? "" : ",", now[i].stat.pid, now[i].stat.ppid);
+			print_json_string(now[i].stat.comm);
+			printf(",\"state\":\"%c\",\"prev_state\":", now[i].stat.state);
+			if (last != NULL) {
+				printf("\"%c\"", last->stat.state);
+			} else {
+				printf("null");
+			}
+			printf(",\"cpu_percent\":%.2f,\"rss_bytes\":%llu,\"read_bytes\":%llu,\"write_bytes\":%llu,\"read_bytes_per_sec\":%.0f,\"write_bytes_per_sec\":%.0f,\"threads\":%ld}", cpu, rss, now[i].read_bytes, now[i].write_bytes, read_rate, write_rate, now[i].stat.num_threads);
+		} else {
+			printf("%-8d %-8d %-6s %7.1f %10llu %10.0f %10.0f %7ld %s\n", now[i].stat.pid, now[i].stat.ppid, state, cpu, rss / 1024, read_rate, write_rate, now[i].stat.num_threads, now[i].stat.comm);
+		}
+	}
+	// Processes exited since last sample.
+	int exited = 0;
+	for (size_t i = 0; prev != NULL && i < prev_count; i++) {
+		if (bsearch(&prev[i], now, count, sizeof(struct RURI_TOP_SAMPLE), compare_sample) == NULL) {
+			exited++;
+		}
+	}
+	if (json) {
+		printf("],\"total\":{\"processes\":%zu,\"exited\":%d,\"cpu_percent\":%.2f,\"rss_bytes\":%llu,\"read_bytes_per_sec\":%.0f,\"write_bytes_per_sec\":%.0f}", count, exited, total_cpu, total_rss, total_read, total_write);
+		show_pids(pids_fd, pids_events, json);
+		printf("}\n");
+	} else {
+		printf("Total: %zu processes, %d exited, CPU %.1f%%, RSS %lluKiB, read %.0fB/s, write %.0fB/s\n", count, exited, total_cpu, total_rss / 1024, total_read, total_write);
+		show_pids(pids_fd, pids_events, json);
+	}
+	fflush(stdout);
+}
+static int open_pids_cgroup(const struct RURI_CONTAINER *_Nonnull container)
+{
+	/*
+	 * Open the cgroup with pids controller of container,
+	 * in cgroup v2 or in cgroup v1 pids hierarchy.
+	 * Return -1 if not found.
+	 */
+	struct RURI_MOUNTINFO *info = ruri_read_mountinfo(0);
+	if (info == NULL) {
+		return -1;
+	}
+	int fd = ruri_open_cgroup(container, info, NULL);
+	if (fd >= 0 && faccessat(fd, "pids.current", F_OK, 0) != 0) {
+		close(fd);
+		fd = -1;
+	}
+	if (fd < 0) {
+		fd = ruri_open_cgroup(container, info, "pids");
+	}
+	ruri_free_mountinfo(info);
+	return fd;
+}
+// Show the processes of container like top(1).
+void ruri_container_top(const char *_Nonnull container_dir, int interval_ms, int iterations, bool json)
+{
+	/*
+	 * Sample the processes in container every interval_ms,
+	 * and show the deltas.
+	 * If iterations > 0, exit after showing iterations samples,
+	 * or it will run until there's no process in container.
+	 */
+	ruri_log("{base}Container directory: {cyan}%s\n", container_dir);
+	if (geteuid() != 0) {
+		ruri_warning("{yellow}Warning: Please run `ruri --top` with sudo.\n");
+	}
+	if (interval_ms <= 0) {
+		ruri_error("{red}Error: invalid interval QwQ\n");
+	}
+	struct RURI_CONTAINER *container = ruri_read_info(NULL, container_dir);
+	// The cgroup to read pids.current and pids.events.
+	int pids_fd = open_pids_cgroup(container);
+	// Count of pids.max reached events, we only warn for new events.
+	unsigned long long pids_events = 0;
+	if (pids_fd >= 0) {
+		ruri_read_cgroup_value(pids_fd, "pids.events", "max", &pids_events);
+	}
+	// Subscribe to proc connector before getting pids, so no fork will be missed.
+	// If it's not available, we get the pids again for every sample.
+	struct RURI_PROC_TRACKER *tracker = ruri_proc_tracker_new();
+	size_t pid_count = 0;
+	pid_t *pids = ruri_get_container_pids(container_dir, container, &pid_count);
+	if (tracker != NULL) {
+		for (size_t i = 0; i < pid_count; i++) {
+			ruri_proc_tracker_add(tracker, pids[i]);
+		}
+	}
+	size_t prev_count = 0;
+	struct RURI_TOP_SAMPLE *prev = NULL;
+	struct timespec prev_time;
+	struct timespec now_time;
+	clock_gettime(CLOCK_MONOTONIC, &prev_time);
+	for (int i = 0; iterations <= 0 || i < iterations; i++) {
+		size_t count = 0;
+		struct RURI_TOP_SAMPLE *now = NULL;
+		if (tracker != NULL) {
+			now = take_samples(tracker->pids, tracker->count, &count);
+		} else {
+			now = take_samples(pids, pid_count, &count);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now_time);
+		double seconds = (double)(now_time.tv_sec - prev_time.tv_sec) + (double)(now_time.tv_nsec - prev_time.tv_nsec) / 1e9;
+		show_samples(now, count, prev, prev_count, seconds, pids_fd, &pids_events, json);
+		free(prev);
+		prev = now;
+		prev_count = count;
+		prev_time = now_time;
+		if (count == 0) {
+			if (!json) {
+				cprintf("{base}No process in container{clear}\n");
+			}
+			break;
+		}
+		if (iterations > 0 && i + 1 >= iterations) {
+			break;
+		}
+		if (tracker == NULL) {
+			usleep((useconds_t)interval_ms * 1000);
+			free(pids);
+			pids = ruri_get_container_pids(container_dir, container, &pid_count);
+			continue;
+		}
+		// Handle fork and exit events until the next sample.
+		// Processes joined by setns(2) are not forked from the container,
+		// so we also get the pids again every 10 samples, or if events are lost.
+		bool resync = (i % 10 == 9);
+		struct timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		long left_ms = interval_ms;
+		while (left_ms > 0) {
+			if (ruri_proc_tracker_poll(tracker, (int)left_ms) < 0) {
+				resync = true;
+			}
+			struct timespec t;
+			clock_gettime(CLOCK_MONOTONIC, &t);
+			left_ms = interval_ms - ((t.tv_sec - deadline.tv_sec) * 1000 + (t.tv_nsec - deadline.tv_nsec) / 1000000);
+		}
+		if (resync) {
+			free(pids);
+			pids = ruri_get_container_pids(container_dir, container, &pid_count);
+			tracker->count = 0;
+			for (size_t j = 0; j < pid_count; j++) {
+				ruri_proc_tracker_add(tracker, pids[j]);
+			}
+		}
+	}
+	ruri_proc_tracker_free(tracker);
+	if (pids_fd >= 0) {
+		close(pids_fd);
+	}
+	free(pids);
+	free(prev);
+	free(container);
+	exit(EXIT_SUCCESS);
+}
@@ -30,117 +30,87 @@
 #include "include/ruri.h"
 /*
  * This file provides function to umount the container.
- * All pids detected in the container will be killed at the same time.
- * TODO:
- * Maybe we should use info in /proc/mounts first?
+ * All pids detected in the container will be killed at the same time,
+ * by cgroup.kill if possible, or by scanning /proc as fallback.
+ * The mount table is read only once by ruri_read_mountinfo(),
+ * and for `ruri -U dir1 dir2 ...` and `ruri -U --all`,
+ * containers are umounted by forked workers in parallel.
  */
-static char *proc_mounts(void)
+// Exit status of umount worker, means processes are not killed by cgroup.
+#define NEED_PROC_SCAN 3
+// Exit status of umount worker, means there are still mountpoints under container.
+#define STILL_MOUNTED 4
+static void umount_subdir(const struct RURI_MOUNTINFO *_Nonnull info, const char *_Nonnull dir)
 {
 	/*
-	 * Read /proc/mounts
-	 * Warning: free() after use.
-	 */
-	// As procfs does not support stat(),
-	// that means we can not know the size of /proc/mounts,
-	// so we have to use a buffer to read it.
-	int fd = open("/proc/mounts", O_RDONLY | O_CLOEXEC);
-	if (fd < 0) {
-		return NULL;
-	}
-	char buf[1024 + 1];
-	size_t bufsize = 1024;
-	ssize_t bytes_read = 0;
-	char *ret = malloc(bufsize);
-	ret[0] = '\0';
-	while ((bytes_read = read(fd, buf, 1024)) > 0) {
-		bufsize += 1024;
-		ret = realloc(ret, bufsize);
-		buf[bytes_read] = '\0';
-		strcat(ret, buf);
-	}
-	close(fd);
-	return ret;
-}
-static char *goto_next_line(const char *_Nonnull buf)
-{
-	/*
-	 * Goto next line, without any check.
-	 * We assume all input is legal.
-	 */
-	if (strchr(buf, '\n') == NULL) {
-		return NULL;
-	}
-	return strchr(buf, '\n') + 1;
-}
-static void umount_subdir(const char *_Nonnull dir)
-{
-	/*
-	 * Umount subdir, use info in /proc/mounts
+	 * Umount subdir, use info in /proc/self/mountinfo
 	 * This is another implementation of umount_container,
 	 * we use it as a double-check.
 	 */
 
 	/*
-	 * /proc/mounts format:
-	 * device mount_point filesystem_type options dump fsck_order
-	 * We just use strstr to find `dir` in /proc/mounts,
-	 * and umount it.
-	 * This is okey in most scenarios.
+	 * The mount table is parsed by ruri_read_mountinfo(),
+	 * escaped paths like `\040` are decoded,
+	 * and `/foobar` will never be matched as `/foo`.
+	 * The mountpoints are umounted in reverse mount order.
 	 */
-	char *mount_info = proc_mounts();
-	if (mount_info == NULL) {
-		return;
-	}
+	size_t count = 0;
+	struct RURI_MOUNTINFO_ENTRY **list = ruri_mountinfo_under(info, dir, &count);
 	// A simple way to check if container is umounted.
-	if (strstr(mount_info, dir) != NULL) {
-		ruri_log("{base}There's still umounted dirs, using info in /proc/mounts to umount them\n");
-	} else {
-		// Make ASAN happy.
-		free(mount_info);
-		return;
-	}
-	char *umount_point = NULL;
-	char *p = mount_info;
-	while ((p = strstr(p, dir)) != NULL) {
-		if (p == NULL) {
-			break;
-		}
-		// To avoid that we have dir=/foo but strstr find /foobar.
-		if (p[strlen(dir)] != '/' && p[strlen(dir) - 1] != '/' && p[strlen(dir)] != ' ') {
-			p = goto_next_line(p);
-			continue;
-		}
-		umount_point = strdup(p);
-		*strchr(umount_point, ' ') = '\0';
-		ruri_log("{base}Umounting %s{green}\n", umount_point);
-		umount2(umount_point, MNT_DETACH | MNT_FORCE);
-		free(umount_point);
-		p = goto_next_line(p);
+	if (count > 0) {
+		ruri_log("{base}There's still umounted dirs, using info in /proc/self/mountinfo to umount them\n");
+	}
+	for (size_t i = 0; i < count; i++) {
+		ruri_log("{base}Umounting %s{green}\n", list[i]->mount_point);
+		umount2(list[i]->mount_point, MNT_DETACH | MNT_FORCE);
 	}
 	// Make ASAN happy.
-	free(mount_info);
+	free(list);
 }
-// Umount container.
-void ruri_umount_container(const char *_Nonnull container_dir)
+static size_t mounts_left(const char *_Nonnull dir)
 {
 	/*
-	 * Read /.rurienv file and umount all mountpoints,
-	 * including extra_mountpoint and extra_ro_mountpoint,
-	 * and umount system runtime directories.
+	 * Read the mount table again, and return the number of mountpoints still under dir.
 	 */
+	struct RURI_MOUNTINFO *info = ruri_read_mountinfo(0);
+	if (info == NULL) {
+		return 0;
+	}
+	size_t count = 0;
+	free(ruri_mountinfo_under(info, dir, &count));
+	ruri_free_mountinfo(info);
+	return count;
+}
+// Check the container directory, return the error message or NULL.
+static const char *check_container_dir(const char *_Nullable container_dir)
+{
 	if (container_dir == NULL) {
-		ruri_error("{red}Error: container directory does not exist QwQ\n");
+		return "container directory does not exist";
 	}
 	// Do not use '/' for container_dir.
 	if (strcmp(container_dir, "/") == 0) {
-		ruri_error("{red}Error: `/` is not allowed to use as a container directory QwQ\n");
+		return "`/` is not allowed to use as a container directory";
 	}
 	// Check if container_dir exist.
 	char *test = realpath(container_dir, NULL);
 	if (test == NULL) {
-		ruri_error("{red}Error: container directory does not exist QwQ\n");
+		return "container directory does not exist";
 	}
 	free(test);
+	return NULL;
+}
+static int umount_container__(const char *_Nonnull container_dir, const struct RURI_MOUNTINFO *_Nullable info)
+{
+	/*
+	 * Read /.rurienv file and umount all mountpoints,
+	 * including extra_mountpoint and extra_ro_mountpoint,
+	 * and umount system runtime directories.
+	 * This is the core function of ruri_umount_container(),
+	 * the processes in container are killed by its cgroup.
+	 * Return NEED_PROC_SCAN if the cgroup of container is not found,
+	 * so the caller should scan /proc to kill the processes.
+	 */
+	int ret = NEED_PROC_SCAN;
 	struct RURI_CONTAINER *container = ruri_read_info(NULL, container_dir);
 	ruri_log("{base}Umounting container...\n");
 	char infofile[PATH_MAX] = { '\0' };
@@ -159,90 +129,288 @@ void ruri_umount_container(const char *_Nonnull container_dir)
 	} else {
 		ruri_warning("{yellow}Warning: .rurienv does not exist\n");
 	}
-	// Get path to umount.
-	char sys_dir[PATH_MAX];
-	char proc_dir[PATH_MAX];
-	char dev_dir[PATH_MAX];
-	char to_umountpoint[PATH_MAX];
-	strcpy(sys_dir, container_dir);
-	strcpy(proc_dir, container_dir);
-	strcpy(dev_dir, container_dir);
-	strcat(sys_dir, "/sys");
-	strcat(proc_dir, "/proc");
-	strcat(dev_dir, "/dev");
-	// Umount other mountpoints.
-	if (container != NULL) {
-		// Umount extra_mountpoint.
-		for (int i = 1; true; i += 2) {
-			if (container->extra_mountpoint[i] != NULL) {
-				strcpy(to_umountpoint, container_dir);
-				strcat(to_umountpoint, container->extra_mountpoint[i]);
-				ruri_log("{base}Umounting %s\n", to_umountpoint);
-				for (int j = 0; j < 10; j++) {
-					umount2(to_umountpoint, MNT_DETACH);
-					umount(to_umountpoint);
-					usleep(20000);
-				}
-				// Remove the empty file we created for mounting files into container.
-				remove(to_umountpoint);
-				// Make ASAN happy.
-				free(container->extra_mountpoint[i]);
-				free(container->extra_mountpoint[i - 1]);
-			} else {
-				break;
+	// Umount all mountpoints in container, including extra mountpoints
+	// and system runtime directories, in reverse mount order,
+	// so we don't need to retry umount(2) for many times.
+	if (info != NULL) {
+		umount_subdir(info, container_dir);
+	} else {
+		// Fallback, force umount system runtime directories for 10 times.
+		char to_umountpoint[PATH_MAX];
+		const char *runtime_dirs[] = { "/sys", "/dev", "/proc", "" };
+		for (int i = 1; i < 10; i++) {
+			for (size_t j = 0; j < sizeof(runtime_dirs) / sizeof(runtime_dirs[0]); j++) {
+				sprintf(to_umountpoint, "%s%s", container_dir, runtime_dirs[j]);
+				umount2(to_umountpoint, MNT_DETACH | MNT_FORCE);
 			}
+			usleep(2000);
 		}
-		// Umount extra_ro_mountpoint.
-		for (int i = 1; true; i += 2) {
-			if (container->extra_ro_mountpoint[i] != NULL) {
-				strcpy(to_umountpoint, container_dir);
-				strcat(to_umountpoint, container->extra_ro_mountpoint[i]);
-				for (int j = 0; j < 10; j++) {
-					ruri_log("{base}Umounting %s\n", to_umountpoint);
-					umount2(to_umountpoint, MNT_DETACH);
-					umount(to_umountpoint);
-					usleep(20000);
-				}
-				// Remove the empty file we created for mounting files into container.
-				// Not rmdir(), so directory wipl not be removed 
-				remove(to_umountpoint);
-				// Make ASAN happy.
-				free(container->extra_mountpoint[i]);
-				free(container->extra_mountpoint[i - 1]);
-			} else {
-				break;
-			}
+	}
+	if (container != NULL) {
+		char to_umountpoint[PATH_MAX];
+		// Remove the empty file we created for mounting files into container.
+		// Not rmdir(), so directory will not be removed.
+		for (int i = 1; container->extra_mountpoint[i] != NULL; i += 2) {
+			sprintf(to_umountpoint, "%s%s", container_dir, container->extra_mountpoint[i]);
+			umount2(to_umountpoint, MNT_DETACH);
+			remove(to_umountpoint);
+			// Make ASAN happy.
+			free(container->extra_mountpoint[i]);
+			free(container->extra_mountpoint[i - 1]);
+		}
+		for (int i = 1; container->extra_ro_mountpoint[i] != NULL; i += 2) {
+			sprintf(to_umountpoint, "%s%s", container_dir, container->extra_ro_mountpoint[i]);
+			umount2(to_umountpoint, MNT_DETACH);
+			remove(to_umountpoint);
+			// Make ASAN happy.
+			free(container->extra_ro_mountpoint[i]);
+			free(container->extra_ro_mountpoint[i - 1]);
+		}
+		// Kill processes by cgroup.
+		// We need ns_pid to find the cgroup, so do it before killing ns_pid.
+		if (info != NULL && ruri_kill_cgroup(container, info)) {
+			ret = 0;
+		}
+		// Kill ns_pid.
+		if (container->ns_pid > 0) {
+			ruri_log("Kill ns pid: %d\n", container->ns_pid);
+			kill(container->ns_pid, SIGKILL);
 		}
 	}
-	// Force umount system runtime directories for 10 times.
-	// Not necessary, but I think it's more secure.
-	ruri_log("{base}Umounting %s\n", sys_dir);
-	ruri_log("{base}Umounting %s\n", proc_dir);
-	ruri_log("{base}Umounting %s\n", dev_dir);
-	ruri_log("{base}Umounting %s\n", container_dir);
-	for (int i = 1; i < 10; i++) {
-		umount2(sys_dir, MNT_DETACH | MNT_FORCE);
-		usleep(2000);
-		umount2(dev_dir, MNT_DETACH | MNT_FORCE);
-		usleep(2000);
-		umount2(proc_dir, MNT_DETACH | MNT_FORCE);
-		usleep(2000);
-		umount2(container_dir, MNT_DETACH | MNT_FORCE);
-		usleep(2000);
-	}
-	// Kill ns_pid.
-	if (container->ns_pid > 0) {
-		ruri_log("Kill ns pid: %d\n", container->ns_pid);
-		kill(container->ns_pid, SIGKILL);
+	// Make Asan happy.
+	free(container);
+	return ret;
+}
+static int umount_worker(const char *_Nonnull container_dir, const struct RURI_MOUNTINFO *_Nullable info)
+{
+	/*
+	 * Umount the container, and check if it's really umounted.
+	 * For NEED_PROC_SCAN, processes are still alive and might keep the mountpoints busy,
+	 * so it's checked by the caller after they are killed.
+	 */
+	int ret = umount_container__(container_dir, info);
+	if (ret == 0 && mounts_left(container_dir) > 0) {
+		ret = STILL_MOUNTED;
+	}
+	return ret;
+}
+// Umount container.
+void ruri_umount_container(const char *_Nonnull container_dir)
+{
+	/*
+	 * Read /.rurienv file and umount all mountpoints,
+	 * including extra_mountpoint and extra_ro_mountpoint,
+	 * and umount system runtime directories.
+	 */
+	const char *err = check_container_dir(container_dir);
+	if (err != NULL) {
+		ruri_error("{red}Error: %s QwQ\n", err);
 	}
+	struct RURI_MOUNTINFO *info = ruri_read_mountinfo(0);
+	int stat = umount_container__(container_dir, info);
+	ruri_free_mountinfo(info);
 	// Kill all processes in container.
 	// For container with PID ns enabled, when ns_pid is killed,
 	// all process will die, but without PID ns, we still need to
 	// find & kill other process.
-	ruri_kill_container(container_dir);
-	// Make Asan happy.
-	free(container);
-	// Use info in /proc/mounts to umount container.
+	// If we have killed them by cgroup, we don't need to scan /proc.
+	if (stat == NEED_PROC_SCAN) {
+		ruri_kill_container(container_dir);
+	}
+	// Use info in /proc/self/mountinfo to umount container.
 	// This is a double check.
-	umount_subdir(container_dir);
+	info = ruri_read_mountinfo(0);
+	if (info != NULL) {
+		umount_subdir(info, container_dir);
+		ruri_free_mountinfo(info);
+	}
+}
+static long elapsed_ms(const struct timespec *_Nonnull start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+static int umount_containers__(char *const *_Nonnull container_dirs, int count, const struct RURI_MOUNTINFO *_Nullable info)
+{
+	/*
+	 * Umount containers in parallel.
+	 * Every container is umounted by a forked worker,
+	 * the mount table is read by the caller and shared by all workers.
+	 * Processes are killed by the cgroup of each container in workers,
+	 * for containers without cgroup, we scan /proc only once after
+	 * all workers exit, and then do the double check.
+	 * Return the number of containers failed to umount.
+	 */
+	// Status of each container, RURI_INIT_VALUE means not finished.
+	int *status = malloc(sizeof(int) * (size_t)count);
+	pid_t *workers = malloc(sizeof(pid_t) * (size_t)count);
+	struct timespec *start = malloc(sizeof(struct timespec) * (size_t)count);
+	long *used_ms = malloc(sizeof(long) * (size_t)count);
+	const char **errors = malloc(sizeof(char *) * (size_t)count);
+	long max_workers = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+	if (max_workers < 1) {
+		max_workers = 1;
+	}
+	int running = 0;
+	int next = 0;
+	int finished = 0;
+	fflush(stdout);
+	fflush(stderr);
+	while (finished < count) {
+		// Start new workers.
+		while (next < count && running < max_workers) {
+			status[next] = RURI_INIT_VALUE;
+			workers[next] = -1;
+			used_ms[next] = 0;
+			errors[next] = check_container_dir(container_dirs[next]);
+			if (errors[next] != NULL) {
+				status[next] = 1;
+				finished++;
+				next++;
+				continue;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &start[next]);
+			pid_t pid = fork();
+			if (pid < 0) {
+				// Fallback to umount it by ourself.
+				ruri_warning("{yellow}Warning: fork() failed, umounting %s in current process\n", container_dirs[next]);
+				status[next] = umount_worker(container_dirs[next], info);
+				used_ms[next] = elapsed_ms(&start[next]);
+				finished++;
+			} else if (pid == 0) {
+				exit(umount_worker(container_dirs[next], info));
+			} else {
+				ruri_log("{base}Worker %d is umounting %s\n", pid, container_dirs[next]);
+				workers[next] = pid;
+				running++;
+			}
+			next++;
+		}
+		if (running == 0) {
+			continue;
+		}
+		// Reap a worker.
+		int stat = 0;
+		pid_t pid = wait(&stat);
+		if (pid < 0) {
+			break;
+		}
+		for (int i = 0; i < next; i++) {
+			if (workers[i] == pid) {
+				used_ms[i] = elapsed_ms(&start[i]);
+				if (WIFEXITED(stat)) {
+					status[i] = WEXITSTATUS(stat);
+				} else {
+					status[i] = 128 + WTERMSIG(stat);
+				}
+				workers[i] = -1;
+				running--;
+				finished++;
+				break;
+			}
+		}
+	}
+	// Kill processes in the containers without cgroup, scan /proc only once.
+	const char **to_kill = malloc(sizeof(char *) * (size_t)(count + 1));
+	int kill_count = 0;
+	for (int i = 0; i < count; i++) {
+		if (errors[i] == NULL && status[i] == NEED_PROC_SCAN) {
+			to_kill[kill_count] = container_dirs[i];
+			kill_count++;
+		}
+	}
+	ruri_kill_containers(to_kill, kill_count);
+	free(to_kill);
+	// Double check, the mount table has changed, so we read it again.
+	struct RURI_MOUNTINFO *new_info = ruri_read_mountinfo(0);
+	int failed = 0;
+	for (int i = 0; i < count; i++) {
+		if (errors[i] == NULL && new_info != NULL) {
+			umount_subdir(new_info, container_dirs[i]);
+		}
+		// The processes are killed now, check the mountpoints.
+		if (errors[i] == NULL && status[i] == NEED_PROC_SCAN) {
+			status[i] = mounts_left(container_dirs[i]) > 0 ? STILL_MOUNTED : 0;
+		}
+		if (errors[i] != NULL) {
+			cprintf("{base}%s: {red}failed{base}, %s\n", container_dirs[i], errors[i]);
+			failed++;
+		} else if (status[i] == STILL_MOUNTED) {
+			cprintf("{base}%s: {red}failed{base}, mountpoints under it are still busy\n", container_dirs[i]);
+			failed++;
+		} else if (status[i] != 0) {
+			cprintf("{base}%s: {red}failed{base}, worker exited with status %d\n", container_dirs[i], status[i]);
+			failed++;
+		} else {
+			cprintf("{base}%s: {green}umounted{base} in %ldms\n", container_dirs[i], used_ms[i]);
+		}
+	}
+	cprintf("{base}%d container(s) umounted, %d failed{clear}\n", count - failed, failed);
+	ruri_free_mountinfo(new_info);
+	free(status);
+	free(workers);
+	free(start);
+	free(used_ms);
+	free(errors);
+	return failed;
+}
+// Umount multiple containers.
+int ruri_umount_containers(char *const *_Nonnull container_dirs, int count)
+{
+	/*
+	 * Umount containers in parallel, and report the result of each container.
+	 * Return the number of containers failed to umount.
+	 */
+	struct RURI_MOUNTINFO *info = ruri_read_mountinfo(0);
+	int ret = umount_containers__(container_dirs, count, info);
+	ruri_free_mountinfo(info);
+	return ret;
+}
+// Umount all containers.
+int ruri_umount_all_containers(void)
+{
+	/*
+	 * Every running container has a .rurienv file bind-mounted to itself,
+	 * so we find all mountpoints named .rurienv in the mount table,
+	 * and umount their parent directories.
+	 * Note that containers created with `-N` (no .rurienv) can not be found.
+	 * Return the number of containers failed to umount.
+	 */
+	struct RURI_MOUNTINFO *info = ruri_read_mountinfo(0);
+	if (info == NULL) {
+		ruri_error("{red}Error: failed to read /proc/self/mountinfo QwQ\n");
+	}
+	char **container_dirs = malloc(sizeof(char *) * (info->count + 1));
+	int count = 0;
+	const char *suffix = "/.rurienv";
+	size_t suffix_len = strlen(suffix);
+	// Iterate in sorted order, so the same mountpoint is continuous.
+	for (size_t i = 0; i < info->count; i++) {
+		const char *mount_point = info->entries[info->sorted[i]].mount_point;
+		size_t len = strlen(mount_point);
+		if (len <= suffix_len || strcmp(mount_point + len - suffix_len, suffix) != 0) {
+			continue;
+		}
+		char *container_dir = strndup(mount_point, len - suffix_len);
+		if (count > 0 && strcmp(container_dirs[count - 1], container_dir) == 0) {
+			free(container_dir);
+			continue;
+		}
+		container_dirs[count] = container_dir;
+		count++;
+	}
+	if (count == 0) {
+		cprintf("{base}No running container found{clear}\n");
+		ruri_free_mountinfo(info);
+		free(container_dirs);
+		return 0;
+	}
+	int ret = umount_containers__(container_dirs, count, info);
+	for (int i = 0; i < count; i++) {
+		free(container_dirs[i]);
+	}
+	free(container_dirs);
+	ruri_free_mountinfo(info);
+	return ret;
 }
@@ -112,7 +112,9 @@ static pid_t init_unshare_container(struct RURI_CONTAINER *_Nonnull container)
 		}
 		// Fix `can't access tty` issue.
 		int stat = 0;
-		waitpid(unshare_pid, &stat, 0);
+		struct rusage usage;
+		wait4(unshare_pid, &stat, 0, &usage);
+		ruri_show_exit_summary(container, stat, &usage);
 		exit(stat);
 	} else if (unshare_pid < 0) {
 		ruri_error("{red}Fork error, QwQ?\n");
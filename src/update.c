@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: MIT
+/*
+ *
+ * This file is part of ruri, with ABSOLUTELY NO WARRANTY.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022-2024 Moe-hacker
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+#include "include/ruri.h"
+/*
+ * This file provides `ruri --update`, to change the cgroup limits
+ * of a running container without restarting it.
+ * The control files are rewritten in place by ruri_update_limit(),
+ * and the limits are merged into .rurienv, so that the next
+ * `ruri --update` or `ruri --top` will see them.
+ */
+static void merge_keyed_limits(char *_Nonnull *_Nonnull dst, char *const *_Nonnull src, char sep, int max)
+{
+	/*
+	 * I/O limits are `MAJ:MIN ...` or `default ...`, and hugetlb limits are `2MB=...`,
+	 * the limit of the same key is replaced, and others are appended.
+	 */
+	for (int i = 0; src[i] != NULL; i++) {
+		size_t key_len = strcspn(src[i], (char[]){ sep, '\0' });
+		int j = 0;
+		for (; dst[j] != NULL; j++) {
+			if (strncmp(dst[j], src[i], key_len) == 0 && dst[j][key_len] == sep) {
+				break;
+			}
+		}
+		if (dst[j] == NULL) {
+			if (j >= max) {
+				ruri_error("{red}Error: too many limits QwQ\n");
+			}
+			dst[j + 1] = NULL;
+		}
+		dst[j] = src[i];
+	}
+}
+static void merge_limits(struct RURI_CONTAINER *_Nonnull dst, const struct RURI_CONTAINER *_Nonnull src)
+{
+	/*
+	 * Copy the limits set in src to dst.
+	 */
+	if (src->cpuset != NULL) {
+		dst->cpuset = src->cpuset;
+	}
+	if (src->cpupercent > 0) {
+		dst->cpupercent = src->cpupercent;
+		// cpu.max overrides cpupercent, so unset it.
+		dst->cpu_max = NULL;
+	}
+	if (src->cpu_max != NULL) {
+		dst->cpu_max = src->cpu_max;
+	}
+	if (src->cpu_burst >= 0) {
+		dst->cpu_burst = src->cpu_burst;
+	}
+	if (src->cpu_weight > 0) {
+		dst->cpu_weight = src->cpu_weight;
+		dst->cpu_weight_nice = RURI_INIT_VALUE;
+	}
+	if (src->cpu_weight_nice >= -20 && src->cpu_weight_nice <= 19) {
+		dst->cpu_weight_nice = src->cpu_weight_nice;
+		dst->cpu_weight = RURI_INIT_VALUE;
+	}
+	if (src->cpu_idle != RURI_INIT_VALUE) {
+		dst->cpu_idle = src->cpu_idle;
+	}
+	char *const memory_src[] = { src->memory, src->memory_high, src->memory_low, src->memory_min, src->memory_swap_max, src->memory_zswap_max };
+	char **memory_dst[] = { &dst->memory, &dst->memory_high, &dst->memory_low, &dst->memory_min, &dst->memory_swap_max, &dst->memory_zswap_max };
+	for (int i = 0; i < 6; i++) {
+		if (memory_src[i] != NULL) {
+			*memory_dst[i] = memory_src[i];
+		}
+	}
+	merge_keyed_limits(dst->io_max, src->io_max, ' ', RURI_MAX_IO_DEVS);
+	merge_keyed_limits(dst->io_weight, src->io_weight, ' ', RURI_MAX_IO_DEVS);
+	merge_keyed_limits(dst->io_latency, src->io_latency, ' ', RURI_MAX_IO_DEVS);
+	merge_keyed_limits(dst->hugetlb_max, src->hugetlb_max, '=', RURI_MAX_HUGETLB_SIZES);
+	if (src->pids_max > 0) {
+		dst->pids_max = src->pids_max;
+	}
+}
+void ruri_update_container(const char *_Nonnull container_dir, struct RURI_CONTAINER *_Nonnull limits)
+{
+	/*
+	 * limits is the container struct with only the limits from `-l` set,
+	 * they are merged with the limits in .rurienv,
+	 * other limits of the container are kept.
+	 */
+	ruri_log("{base}Container directory: {cyan}%s\n", container_dir);
+	if (geteuid() != 0) {
+		ruri_warning("{yellow}Warning: Please run `ruri --update` with sudo.\n");
+	}
+	struct RURI_CONTAINER *container = ruri_read_info(NULL, container_dir);
+	if (container->container_id < 0) {
+		ruri_error("{red}Error: no container_id in .rurienv, is the container running? QwQ\n");
+	}
+	// Write all the limits, because some of them depend on each other,
+	// like memory.memsw.limit_in_bytes and memory.limit_in_bytes in cgroup v1.
+	// But do not pick CPUs again for cpuset=auto:N if cpuset is not changed.
+	char *cpuset = container->cpuset;
+	merge_limits(container, limits);
+	container->cpuset = limits->cpuset;
+	container->no_warnings = limits->no_warnings;
+	ruri_update_limit(container);
+	if (limits->cpuset == NULL) {
+		container->cpuset = cpuset;
+	}
+	// Store the limits to .rurienv.
+	struct RURI_CONTAINER *info = malloc(sizeof(struct RURI_CONTAINER));
+	ruri_init_config(info);
+	info->container_dir = (char *)container_dir;
+	info->no_warnings = true;
+	ruri_read_info(info, container_dir);
+	// Only read by ruri_read_info(NULL, container_dir).
+	memcpy(info->extra_mountpoint, container->extra_mountpoint, sizeof(container->extra_mountpoint));
+	memcpy(info->extra_ro_mountpoint, container->extra_ro_mountpoint, sizeof(container->extra_ro_mountpoint));
+	merge_limits(info, container);
+	ruri_store_info(info);
+	cprintf("{base}Limits of container updated{clear}\n");
+	exit(EXIT_SUCCESS);
+}
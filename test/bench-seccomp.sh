@@ -0,0 +1,62 @@
+#!/bin/bash
+# Compare the per-syscall overhead of seccomp filter modes.
+# Usage: sudo ./bench-seccomp.sh /path/to/ruri /path/to/rootfs [iterations]
+source $(dirname $0)/global.sh
+
+RURI=$(realpath $1)
+ROOTFS=$(realpath $2)
+ITERATIONS=${3:-1000000}
+PROFILE=$(realpath $(dirname $0)/seccomp/docker-default.profile)
+if [[ ! -x ${RURI} || ! -d ${ROOTFS} ]]; then
+    echo "Usage: $0 /path/to/ruri /path/to/rootfs [iterations]"
+    exit 1
+fi
+${CC:-cc} -static -O2 -o ${ROOTFS}/bench $(dirname $0)/bench.c || exit 1
+
+# Clear the filter cache, so the instruction count of every new filter can be read from its cache file.
+CACHE_DIR=/var/cache/ruri/seccomp
+rm -f ${CACHE_DIR}/*.bpf
+MARKER=$(mktemp)
+INSNS=0
+
+function run_bench() {
+    echo -e "${BASE}==> $1${CLEAR}"
+    shift
+    touch ${MARKER}
+    local start=$(date +%s%N)
+    ${RURI} -N "$@" ${ROOTFS} /bench 1 >/dev/null
+    local end=$(date +%s%N)
+    echo "start            $(((end - start) / 1000)) us"
+    if [[ $# -gt 0 ]]; then
+        # A new cache file is written if the filter is built, or the filter is the same as the last one.
+        # The header has the instruction count at offset 16.
+        local cache=$(find ${CACHE_DIR} -name '*.bpf' -newer ${MARKER} 2>/dev/null | head -n 1)
+        if [[ -n ${cache} ]]; then
+            INSNS=$(od -An -tu4 -j16 -N4 ${cache} | tr -d ' ')
+        fi
+        echo "filter           ${INSNS} instructions"
+    fi
+    ${RURI} -N "$@" ${ROOTFS} /bench ${ITERATIONS}
+    ${RURI} -U ${ROOTFS} >/dev/null 2>&1
+}
+
+# 2000 distinct deny rules on the syscalls used by the benchmark.
+# libseccomp merges rules with the same syscall, action and arguments,
+# so every rule compares arg0 with a different value, which the benchmark never uses
+# (fds and addresses are far from 1000000).
+# The values start at a random offset, so the first run is not cached.
+DENY_PROFILE=$(mktemp)
+HOT=(read write close futex munmap)
+OFFSET=$((1000000 + RANDOM))
+echo "default allow" >${DENY_PROFILE}
+for ((i = 0; i < 2000; i++)); do
+    echo "EPERM:${HOT[$((i % ${#HOT[@]}))]} arg0==$((OFFSET + i))" >>${DENY_PROFILE}
+done
+
+run_bench "No seccomp"
+run_bench "Built-in profile (-s)" -s
+run_bench "2000 deny rules" --seccomp-profile ${DENY_PROFILE}
+run_bench "2000 deny rules, cached BPF filter" --seccomp-profile ${DENY_PROFILE}
+run_bench "Allowlist profile" --seccomp-profile ${PROFILE}
+run_bench "Allowlist profile, spec allow" --seccomp-profile ${PROFILE} --seccomp-spec-allow
+rm -f ${ROOTFS}/bench ${DENY_PROFILE} ${MARKER}
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Syscall overhead benchmark, it runs inside the container.
+ * Build it with `cc -static -O2 -o bench bench.c`, so it runs in any rootfs.
+ * Usage: bench [iterations]
+ * Every syscall is called with syscall(2), so libc caches and vDSO are bypassed.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+static int pipefd[2] = { -1, -1 };
+static int futex_word = 0;
+static long long now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+static void bench_getpid(long n)
+{
+	for (long i = 0; i < n; i++) {
+		syscall(SYS_getpid);
+	}
+}
+static void bench_clock_gettime(long n)
+{
+	// The fallback path of clock_gettime(3) when vDSO is not usable.
+	struct timespec ts;
+	for (long i = 0; i < n; i++) {
+		syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+	}
+}
+static void bench_pipe(long n)
+{
+	char c = 'x';
+	for (long i = 0; i < n; i++) {
+		syscall(SYS_write, pipefd[1], &c, 1);
+		syscall(SYS_read, pipefd[0], &c, 1);
+	}
+}
+static void bench_openat(long n)
+{
+	for (long i = 0; i < n; i++) {
+		long fd = syscall(SYS_openat, AT_FDCWD, "/dev/null", O_RDONLY | O_CLOEXEC);
+		syscall(SYS_close, fd);
+	}
+}
+static void bench_futex(long n)
+{
+	// Wake with no waiter, it does not sleep.
+	for (long i = 0; i < n; i++) {
+		syscall(SYS_futex, &futex_word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+}
+static void bench_mmap(long n)
+{
+	for (long i = 0; i < n; i++) {
+		void *addr = (void *)syscall(SYS_mmap, NULL, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		syscall(SYS_munmap, addr, 4096);
+	}
+}
+struct BENCH {
+	const char *name;
+	void (*func)(long n);
+	// Syscalls in each iteration.
+	int syscalls;
+};
+static const struct BENCH benches[] = {
+	{ "getpid", bench_getpid, 1 },
+	{ "clock_gettime", bench_clock_gettime, 1 },
+	{ "pipe write/read", bench_pipe, 2 },
+	{ "openat/close", bench_openat, 2 },
+	{ "futex wake", bench_futex, 1 },
+	{ "mmap/munmap", bench_mmap, 2 },
+};
+int main(int argc, char **argv)
+{
+	long n = argc > 1 ? atol(argv[1]) : 1000000;
+	if (n <= 0) {
+		fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+	if (pipe(pipefd) != 0) {
+		perror("pipe");
+		return 1;
+	}
+	for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		// Warm up.
+		benches[i].func(n / 10 + 1);
+		long long start = now();
+		benches[i].func(n);
+		long long end = now();
+		printf("%-16s %8.1f ns/syscall\n", benches[i].name, (double)(end - start) / (double)n / benches[i].syscalls);
+	}
+	return 0;
+}
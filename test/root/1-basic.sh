@@ -75,4 +75,21 @@ fi
 echo -e "${BASE}==> unshare container create /nullfile in container successfully"
 pass_subtest
 
+export SUBTEST_NO=6
+export SUBTEST_DESCRIPTION="Umount all containers with -U --all"
+show_subtest_description
+cd ${TMPDIR}
+./ruri -m /tmp /tm ./test /bin/true
+check_if_succeed $?
+./ruri -U --all
+check_if_succeed $?
+if mountpoint -q ./test/sys; then
+    error "Seems that container did not unmounted properly!"
+fi
+if mountpoint -q ./test/tm; then
+    error "Umount /tm failed!"
+fi
+echo -e "${BASE}==> -U --all umount container successfully"
+pass_subtest
+
 pass_test
@@ -0,0 +1,192 @@
+cd ${TEST_ROOT}
+source global.sh
+
+export TEST_NO=10
+export DESCRIPTION="Test if cgroup limits work properly"
+show_test_description
+
+export SUBTEST_NO=1
+export SUBTEST_DESCRIPTION="I/O limits"
+show_subtest_description
+cd ${TMPDIR}
+if [[ "$(grep -w io /sys/fs/cgroup/cgroup.controllers 2>/dev/null)" == "" ]]; then
+    echo -e "${YELLOW}==> No cgroup v2 io controller, skipping${CLEAR}\n"
+else
+    cat <<EOF >test/test.sh
+grep '^0::' /proc/self/cgroup | cut -d: -f3 > /cgroup
+sleep 3
+EOF
+    chmod 777 test/test.sh
+    ./ruri -l io.max=./test:rbps=1048576,wiops=120 -l io.weight=200 ./test /bin/sh /test.sh &
+    check_if_succeed $?
+    sleep 1
+    if [[ "$(grep 'rbps=1048576' /sys/fs/cgroup$(cat test/cgroup)/io.max | grep 'wiops=120')" == "" ]]; then
+        error "io.max is not set!"
+    fi
+    if [[ "$(grep 'default 200' /sys/fs/cgroup$(cat test/cgroup)/io.weight)" == "" ]]; then
+        error "io.weight is not set!"
+    fi
+    wait
+    echo -e "${BASE}==> I/O limits work properly${CLEAR}\n"
+fi
+./ruri -U ./test
+pass_subtest
+
+export SUBTEST_NO=2
+export SUBTEST_DESCRIPTION="pids limit"
+show_subtest_description
+cd ${TMPDIR}
+./ruri -l pids=16 ./test /bin/sleep 3 &
+check_if_succeed $?
+sleep 1
+if [[ "$(./ruri --top --json --count 1 ./test | grep '"max":16')" == "" ]]; then
+    error "pids.max is not set!"
+fi
+wait
+echo -e "${BASE}==> pids limit works properly${CLEAR}\n"
+./ruri -U ./test
+pass_subtest
+
+export SUBTEST_NO=3
+export SUBTEST_DESCRIPTION="Memory limits"
+show_subtest_description
+cd ${TMPDIR}
+if [[ "$(grep -w memory /sys/fs/cgroup/cgroup.controllers 2>/dev/null)" == "" ]]; then
+    echo -e "${YELLOW}==> No cgroup v2 memory controller, skipping${CLEAR}\n"
+else
+    cat <<EOF >test/test.sh
+grep '^0::' /proc/self/cgroup | cut -d: -f3 > /cgroup
+sleep 3
+EOF
+    chmod 777 test/test.sh
+    ./ruri -l memory=4G -l memory.high=3G -l memory.low=256M ./test /bin/sh /test.sh &
+    check_if_succeed $?
+    sleep 1
+    if [[ "$(cat /sys/fs/cgroup$(cat test/cgroup)/memory.max)" != "4294967296" ]]; then
+        error "memory.max is not set!"
+    fi
+    if [[ "$(cat /sys/fs/cgroup$(cat test/cgroup)/memory.high)" != "3221225472" ]]; then
+        error "memory.high is not set!"
+    fi
+    if [[ "$(cat /sys/fs/cgroup$(cat test/cgroup)/memory.low)" != "268435456" ]]; then
+        error "memory.low is not set!"
+    fi
+    wait
+    echo -e "${BASE}==> Memory limits work properly${CLEAR}\n"
+fi
+./ruri -l memory=1X ./test /bin/true
+check_if_failed $?
+./ruri -U ./test
+pass_subtest
+
+export SUBTEST_NO=4
+export SUBTEST_DESCRIPTION="CPU limits"
+show_subtest_description
+cd ${TMPDIR}
+if [[ "$(grep -w cpu /sys/fs/cgroup/cgroup.controllers 2>/dev/null)" == "" ]]; then
+    echo -e "${YELLOW}==> No cgroup v2 cpu controller, skipping${CLEAR}\n"
+elif [[ $(nproc --all) -lt 4 ]]; then
+    echo -e "${YELLOW}==> Less than 4 CPUs, skipping${CLEAR}\n"
+else
+    cat <<EOF >test/test.sh
+grep '^0::' /proc/self/cgroup | cut -d: -f3 > /cgroup
+sleep 3
+EOF
+    chmod 777 test/test.sh
+    ./ruri -l cpu=350% -l cpu.max.burst=50000 -l cpu.weight=200 ./test /bin/sh /test.sh &
+    check_if_succeed $?
+    sleep 1
+    if [[ "$(cat /sys/fs/cgroup$(cat test/cgroup)/cpu.max)" != "350000 100000" ]]; then
+        error "cpu.max is not set!"
+    fi
+    if [[ "$(cat /sys/fs/cgroup$(cat test/cgroup)/cpu.weight)" != "200" ]]; then
+        error "cpu.weight is not set!"
+    fi
+    wait
+    echo -e "${BASE}==> CPU limits work properly${CLEAR}\n"
+fi
+./ruri -l cpu.weight=0 ./test /bin/true
+check_if_failed $?
+./ruri -l cpu=100000 ./test /bin/true
+check_if_failed $?
+./ruri -U ./test
+pass_subtest
+
+export SUBTEST_NO=5
+export SUBTEST_DESCRIPTION="Update limits of running container"
+show_subtest_description
+cd ${TMPDIR}
+./ruri -l pids=16 ./test /bin/sleep 3 &
+check_if_succeed $?
+sleep 1
+./ruri --update ./test -l pids=32
+check_if_succeed $?
+if [[ "$(./ruri --top --json --count 1 ./test | grep '"max":32')" == "" ]]; then
+    error "pids.max is not updated!"
+fi
+if [[ "$(grep 'pids_max="32"' test/.rurienv)" == "" ]]; then
+    error "pids_max is not updated in .rurienv!"
+fi
+wait
+echo -e "${BASE}==> Limits are updated properly${CLEAR}\n"
+./ruri -U ./test
+pass_subtest
+
+export SUBTEST_NO=6
+export SUBTEST_DESCRIPTION="Resource usage stats"
+show_subtest_description
+cd ${TMPDIR}
+./ruri -l pids=16 ./test /bin/sleep 3 &
+check_if_succeed $?
+sleep 1
+if [[ "$(./ruri --stats --json --count 1 --prometheus ./stats.prom ./test | grep '"pids":{"current":1,"max":16}')" == "" ]]; then
+    error "pids stats are not shown!"
+fi
+if [[ "$(grep '^ruri_pids_max{' ./stats.prom)" == "" ]]; then
+    error "Prometheus textfile is not written!"
+fi
+rm -f ./stats.prom
+wait
+echo -e "${BASE}==> Stats are shown properly${CLEAR}\n"
+./ruri -U ./test
+pass_subtest
+
+export SUBTEST_NO=7
+export SUBTEST_DESCRIPTION="Resource event monitor"
+show_subtest_description
+cd ${TMPDIR}
+./ruri -l pids=4 ./test /bin/sh -c 'sleep 2; for i in 1 2 3 4 5; do sleep 1 & done; wait' &
+sleep 1
+timeout 4 ./ruri --monitor --json --log ./events.log ./test
+if [[ "$(grep '"file":"pids.events","key":"max"' ./events.log)" == "" ]]; then
+    error "pids.events is not reported!"
+fi
+rm -f ./events.log
+wait
+echo -e "${BASE}==> Events are reported properly${CLEAR}\n"
+./ruri -U ./test
+pass_subtest
+
+export SUBTEST_NO=8
+export SUBTEST_DESCRIPTION="Hugetlb limits and hugetlbfs"
+show_subtest_description
+cd ${TMPDIR}
+if [[ ! -e /sys/kernel/mm/hugepages/hugepages-2048kB ]]; then
+    echo -e "${YELLOW}==> No 2MB hugepages, skipping${CLEAR}\n"
+else
+    ./ruri -l hugetlb.2M=64M ./test /bin/sh -c 'cat /proc/mounts > /mounts'
+    check_if_succeed $?
+    if [[ "$(grep 'hugetlbfs /dev/hugepages ' test/mounts | grep 'size=67108864')" == "" ]]; then
+        error "hugetlbfs is not mounted!"
+    fi
+    if [[ "$(grep 'hugetlb_max=\["2MB=64M"\]' test/.rurienv)" == "" ]]; then
+        error "hugetlb_max is not stored in .rurienv!"
+    fi
+    echo -e "${BASE}==> Hugetlb limits work properly${CLEAR}\n"
+fi
+./ruri -U ./test
+./ruri -l hugetlb.3MB=1G ./test /bin/true
+check_if_failed $?
+pass_subtest
+
+pass_test
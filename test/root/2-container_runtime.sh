@@ -113,4 +113,68 @@ echo -e "${BASE}==> /proc/sys/fs/pipe-max-size is masked"
 ./ruri -U ./test
 pass_subtest
 
+export SUBTEST_NO=8
+export SUBTEST_DESCRIPTION="Scheduling attributes"
+show_subtest_description
+cd ${TMPDIR}
+./ruri --sched policy=batch --sched nice=5 --sched timerslack=100000 ./test /bin/sh -c 'cat /proc/self/stat /proc/self/timerslack_ns > /sched'
+check_if_succeed $?
+if [[ "$(awk 'NR==1{print $41,$19} NR==2{print $1}' test/sched | tr '\n' ' ')" != "3 5 100000 " ]]; then
+    error "Scheduling attributes are not set!"
+fi
+./ruri -U ./test
+./ruri --sched policy=fifo ./test /bin/true
+check_if_failed $?
+echo -e "${BASE}==> Scheduling attributes work properly"
+pass_subtest
+
+export SUBTEST_NO=9
+export SUBTEST_DESCRIPTION="Resource limits"
+show_subtest_description
+cd ${TMPDIR}
+./ruri --rlimit nofile=512:1024 --rlimit core=unlimited ./test /bin/sh -c 'cat /proc/self/limits > /limits'
+check_if_succeed $?
+if [[ "$(grep 'Max open files *512 *1024 ' test/limits)" == "" ]]; then
+    error "RLIMIT_NOFILE is not set!"
+fi
+if [[ "$(grep 'Max core file size *unlimited *unlimited ' test/limits)" == "" ]]; then
+    error "RLIMIT_CORE is not set!"
+fi
+./ruri -U ./test
+./ruri --rlimit nofile=1024:512 ./test /bin/true
+check_if_failed $?
+echo -e "${BASE}==> Resource limits work properly"
+pass_subtest
+
+export SUBTEST_NO=10
+export SUBTEST_DESCRIPTION="THP and memory policy"
+show_subtest_description
+cd ${TMPDIR}
+./ruri --thp-disable --mempolicy interleave:0 ./test /bin/sh -c 'cat /proc/self/status /proc/self/numa_maps > /memory'
+check_if_succeed $?
+if [[ "$(grep THP_enabled /proc/self/status)" != "" ]] && [[ "$(grep 'THP_enabled:.*0' test/memory)" == "" ]]; then
+    error "THP is not disabled!"
+fi
+if [[ -e /proc/self/numa_maps ]] && [[ "$(grep ' interleave:0 ' test/memory)" == "" ]]; then
+    error "Memory policy is not set!"
+fi
+./ruri -U ./test
+./ruri --mempolicy bind ./test /bin/true
+check_if_failed $?
+echo -e "${BASE}==> THP and memory policy work properly"
+pass_subtest
+
+export SUBTEST_NO=11
+export SUBTEST_DESCRIPTION="KSM"
+show_subtest_description
+cd ${TMPDIR}
+./ruri --ksm ./test /bin/sh -c 'cat /proc/self/ksm_stat > /ksm'
+check_if_succeed $?
+if [[ -e /proc/self/ksm_stat ]] && [[ "$(grep 'ksm_merge_any' /proc/self/ksm_stat)" != "" ]] && [[ "$(grep 'ksm_merge_any: yes' test/ksm)" == "" ]]; then
+    error "KSM is not enabled!"
+fi
+./ruri -U ./test
+echo -e "${BASE}==> KSM works properly"
+pass_subtest
+
 pass_test
@@ -25,10 +25,26 @@ echo -e "${BASE}==> -P for common chroot container passed!${CLEAR}\n"
 ./ruri -U ./test
 pass_subtest
 
+export SUBTEST_NO=2
+export SUBTEST_DESCRIPTION="--top with common chroot container"
+show_subtest_description
+cd ${TMPDIR}
+./ruri ./test /bin/sh /test.sh &
+check_if_succeed $?
+sleep 1
+if [[ "$(./ruri --top --count 2 --interval 100 ./test | grep sleep)" == "" ]]; then
+    error "ruri --top has no output"
+fi
+if [[ "$(./ruri --top --json --count 1 ./test | grep '"processes"')" == "" ]]; then
+    error "ruri --top --json has no output"
+fi
+echo -e "${BASE}==> --top for common chroot container passed!${CLEAR}\n"
+pass_subtest
+
 cd ${TMPDIR}
 ./ruri -P ./test | awk '{print $1}' | xargs kill -9
 
-export SUBTEST_NO=2
+export SUBTEST_NO=3
 export SUBTEST_DESCRIPTION="-P with stopped container"
 show_subtest_description
 cd ${TMPDIR}
@@ -81,4 +81,38 @@ echo -e "${BASE}==> Mount host runtime works properly"
 ./ruri -U ./test
 pass_subtest
 
+export SUBTEST_NO=6
+export SUBTEST_DESCRIPTION="Allowlist seccomp profile"
+show_subtest_description
+cd ${TMPDIR}
+grep -v '^mkdir' ${TEST_ROOT}/seccomp/docker-default.profile > ./test.profile
+./ruri --seccomp-profile ./test.profile ./test /bin/sh -c 'grep Seccomp: /proc/self/status'
+check_if_succeed $?
+./ruri -U ./test
+./ruri --seccomp-profile ./test.profile ./test /bin/mkdir /test-dir
+check_if_failed $?
+./ruri -U ./test
+./ruri --seccomp-profile ./nonexistent.profile ./test /bin/true
+check_if_failed $?
+rm -f ./test.profile
+echo -e "${BASE}==> Allowlist seccomp profile works properly"
+pass_subtest
+
+export SUBTEST_NO=7
+export SUBTEST_DESCRIPTION="Record seccomp profile"
+show_subtest_description
+cd ${TMPDIR}
+./ruri --seccomp-learn ./learned.profile ./test /bin/sh -c 'cat /proc/self/status > /dev/null'
+check_if_succeed $?
+if [[ "$(grep '^execve$' ./learned.profile)" == "" ]]; then
+    error "Syscalls are not recorded!"
+fi
+./ruri -U ./test
+./ruri --seccomp-profile ./learned.profile ./test /bin/sh -c 'cat /proc/self/status > /dev/null'
+check_if_succeed $?
+rm -f ./learned.profile
+echo -e "${BASE}==> Record seccomp profile works properly"
+./ruri -U ./test
+pass_subtest
+
 pass_test